@@ -116,6 +116,30 @@ void test_cellular_info_serial_number_imei()
 }
 
 // test cases description
+void test_uart_baudrate()
+{
+    int err;
+    char buf[32];
+    CellularInformation *info = modem->get_information();
+
+    err = modem->set_uart_baudrate(460800);
+    TEST_ASSERT_EQUAL(0, err);
+    TEST_ASSERT_EQUAL(460800, modem->get_uart_baudrate());
+    err = info->get_manufacturer(buf, 32);
+    TEST_ASSERT_EQUAL(0, err);
+
+    // baudrate should be restored after reset
+    err = modem->reset();
+    TEST_ASSERT_EQUAL(0, err);
+    TEST_ASSERT_EQUAL(460800, modem->get_uart_baudrate());
+    err = info->get_manufacturer(buf, 32);
+    TEST_ASSERT_EQUAL(0, err);
+
+    err = modem->set_uart_baudrate(115200);
+    TEST_ASSERT_EQUAL(0, err);
+    TEST_ASSERT_EQUAL(115200, modem->get_uart_baudrate());
+}
+
 #define SIM5320Case(test_fun) Case(#test_fun, case_setup_handler, test_fun, greentea_case_teardown_handler, greentea_case_failure_continue_handler)
 Case cases[] = {
     SIM5320Case(test_init_state),
@@ -124,6 +148,7 @@ Case cases[] = {
     SIM5320Case(test_cellular_info_revision),
     SIM5320Case(test_cellular_info_serial_number_sn),
     SIM5320Case(test_cellular_info_serial_number_imei),
+    SIM5320Case(test_uart_baudrate),
 };
 Specification specification(test_setup_handler, cases, test_teardown_handler);
 
@@ -0,0 +1,1982 @@
+#include "sim5320_ModemEmulator.h"
+#include "stdarg.h"
+#include "string.h"
+
+using namespace sim5320;
+
+#define EMULATOR_DEFAULT_LATENCY 5
+#define EMULATOR_RESET_DELAY 500
+#define EMULATOR_MAX_SEND_SIZE 1500
+#define EMULATOR_MAX_CACHE_READ_SIZE 1024
+#define EMULATOR_TIME_NEVER UINT64_MAX
+#define EMULATOR_ESCAPE_GUARD_TIME 1000
+#define EMULATOR_CONNECT_BAUDRATE 115200
+// multiplexer channel of the URCs that aren't related to any command
+#define EMULATOR_URC_DLCI 1
+
+#define CTRL_Z 0x1A
+#define ESC 0x1B
+#define CMUX_FLAG 0xF9
+
+/**
+ * GSM 07.10 frame codec
+ */
+
+// reversed CRC-8 table (3GPP TS 27.010 annex B)
+static const uint8_t cmux_crc_table[256] = {
+    0x00, 0x91, 0xE3, 0x72, 0x07, 0x96, 0xE4, 0x75,
+    0x0E, 0x9F, 0xED, 0x7C, 0x09, 0x98, 0xEA, 0x7B,
+    0x1C, 0x8D, 0xFF, 0x6E, 0x1B, 0x8A, 0xF8, 0x69,
+    0x12, 0x83, 0xF1, 0x60, 0x15, 0x84, 0xF6, 0x67,
+    0x38, 0xA9, 0xDB, 0x4A, 0x3F, 0xAE, 0xDC, 0x4D,
+    0x36, 0xA7, 0xD5, 0x44, 0x31, 0xA0, 0xD2, 0x43,
+    0x24, 0xB5, 0xC7, 0x56, 0x23, 0xB2, 0xC0, 0x51,
+    0x2A, 0xBB, 0xC9, 0x58, 0x2D, 0xBC, 0xCE, 0x5F,
+    0x70, 0xE1, 0x93, 0x02, 0x77, 0xE6, 0x94, 0x05,
+    0x7E, 0xEF, 0x9D, 0x0C, 0x79, 0xE8, 0x9A, 0x0B,
+    0x6C, 0xFD, 0x8F, 0x1E, 0x6B, 0xFA, 0x88, 0x19,
+    0x62, 0xF3, 0x81, 0x10, 0x65, 0xF4, 0x86, 0x17,
+    0x48, 0xD9, 0xAB, 0x3A, 0x4F, 0xDE, 0xAC, 0x3D,
+    0x46, 0xD7, 0xA5, 0x34, 0x41, 0xD0, 0xA2, 0x33,
+    0x54, 0xC5, 0xB7, 0x26, 0x53, 0xC2, 0xB0, 0x21,
+    0x5A, 0xCB, 0xB9, 0x28, 0x5D, 0xCC, 0xBE, 0x2F,
+    0xE0, 0x71, 0x03, 0x92, 0xE7, 0x76, 0x04, 0x95,
+    0xEE, 0x7F, 0x0D, 0x9C, 0xE9, 0x78, 0x0A, 0x9B,
+    0xFC, 0x6D, 0x1F, 0x8E, 0xFB, 0x6A, 0x18, 0x89,
+    0xF2, 0x63, 0x11, 0x80, 0xF5, 0x64, 0x16, 0x87,
+    0xD8, 0x49, 0x3B, 0xAA, 0xDF, 0x4E, 0x3C, 0xAD,
+    0xD6, 0x47, 0x35, 0xA4, 0xD1, 0x40, 0x32, 0xA3,
+    0xC4, 0x55, 0x27, 0xB6, 0xC3, 0x52, 0x20, 0xB1,
+    0xCA, 0x5B, 0x29, 0xB8, 0xCD, 0x5C, 0x2E, 0xBF,
+    0x90, 0x01, 0x73, 0xE2, 0x97, 0x06, 0x74, 0xE5,
+    0x9E, 0x0F, 0x7D, 0xEC, 0x99, 0x08, 0x7A, 0xEB,
+    0x8C, 0x1D, 0x6F, 0xFE, 0x8B, 0x1A, 0x68, 0xF9,
+    0x82, 0x13, 0x61, 0xF0, 0x85, 0x14, 0x66, 0xF7,
+    0xA8, 0x39, 0x4B, 0xDA, 0xAF, 0x3E, 0x4C, 0xDD,
+    0xA6, 0x37, 0x45, 0xD4, 0xA1, 0x30, 0x42, 0xD3,
+    0xB4, 0x25, 0x57, 0xC6, 0xB3, 0x22, 0x50, 0xC1,
+    0xBA, 0x2B, 0x59, 0xC8, 0xBD, 0x2C, 0x5E, 0xCF,
+};
+
+static uint8_t cmux_crc(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xFF;
+    while (len--) {
+        crc = cmux_crc_table[crc ^ *data++];
+    }
+    return crc;
+}
+
+SIM5320ModemEmulator::CMUXCodec::CMUXCodec()
+    : dlci(0)
+    , cr(false)
+    , control(0)
+    , len(0)
+{
+    reset();
+}
+
+size_t SIM5320ModemEmulator::CMUXCodec::encode(uint8_t *buf, int dlci, bool cr, uint8_t control, const uint8_t *data, size_t len)
+{
+    // the emulator doesn't send frames with two bytes length field
+    buf[0] = CMUX_FLAG;
+    buf[1] = 0x01 | (cr ? 0x02 : 0x00) | (dlci << 2);
+    buf[2] = control;
+    buf[3] = 0x01 | (len << 1);
+    if (len > 0) {
+        memcpy(buf + 4, data, len);
+    }
+    // check sequence of the SABM, UA, DM, DISC and UIH frames covers address, control and length fields
+    buf[4 + len] = 0xFF - cmux_crc(buf + 1, 3);
+    buf[5 + len] = CMUX_FLAG;
+    return len + 6;
+}
+
+void SIM5320ModemEmulator::CMUXCodec::reset()
+{
+    _frame_len = 0;
+    _synchronized = false;
+}
+
+bool SIM5320ModemEmulator::CMUXCodec::decode(uint8_t sym)
+{
+    if (!_synchronized || (_frame_len == 0 && sym == CMUX_FLAG)) {
+        // wait opening flag and skip repeated flags
+        _synchronized = sym == CMUX_FLAG;
+        return false;
+    }
+    // header: address, control and one or two bytes of the length
+    size_t header_len = _frame_len >= 3 && !(_frame[2] & 0x01) ? 4 : 3;
+    size_t data_len = 0;
+    if (_frame_len >= header_len) {
+        data_len = _frame[2] >> 1;
+        if (header_len == 4) {
+            data_len |= _frame[3] << 7;
+        }
+        if (data_len > MAX_DATA_SIZE) {
+            reset();
+            return false;
+        }
+    }
+    if (_frame_len < header_len || _frame_len < header_len + data_len + 1) {
+        _frame[_frame_len++] = sym;
+        return false;
+    }
+
+    // complete frame should be followed by closing flag, that can be opening flag of the next frame
+    _frame_len = 0;
+    if (sym != CMUX_FLAG) {
+        _synchronized = false;
+        return false;
+    }
+    // check sequence with the received FCS field gives constant value
+    uint8_t crc = cmux_crc(_frame, header_len);
+    if (cmux_crc_table[crc ^ _frame[header_len + data_len]] != 0xCF) {
+        return false;
+    }
+    dlci = _frame[0] >> 2;
+    cr = (_frame[0] & 0x02) != 0;
+    control = _frame[1];
+    len = data_len;
+    memcpy(data, _frame + header_len, data_len);
+    return true;
+}
+
+/**
+ * Split command arguments into separate strings.
+ *
+ * Quotes are removed from the result strings.
+ *
+ * @param args arguments string (text after '=')
+ * @param argv output buffers
+ * @param max_argc maximum number of the arguments
+ * @return number of the found arguments
+ */
+#define MAX_ARG_LEN 64
+#define MAX_ARG_NUM 8
+static int parse_args(const char *args, char argv[][MAX_ARG_LEN], int max_argc)
+{
+    int argc = 0;
+    size_t arg_len = 0;
+    bool in_quotes = false;
+
+    if (*args == '\0') {
+        return 0;
+    }
+    argv[0][0] = '\0';
+    for (; *args != '\0'; args++) {
+        char sym = *args;
+        if (sym == '"') {
+            in_quotes = !in_quotes;
+        } else if (sym == ',' && !in_quotes) {
+            argc++;
+            if (argc >= max_argc) {
+                return argc;
+            }
+            arg_len = 0;
+            argv[argc][0] = '\0';
+        } else if (arg_len < MAX_ARG_LEN - 1) {
+            argv[argc][arg_len++] = sym;
+            argv[argc][arg_len] = '\0';
+        }
+    }
+    return argc + 1;
+}
+
+static inline uint8_t get_stream_byte(uint32_t offset)
+{
+    return offset & 0xFF;
+}
+
+SIM5320ModemEmulator::SIM5320ModemEmulator()
+    : _wakeup_time(EMULATOR_TIME_NEVER)
+    , _output_read_total(0)
+    , _output_notified_total(0)
+    , _blocking(true)
+    , _default_latency(EMULATOR_DEFAULT_LATENCY)
+    , _command_latency_num(0)
+    , _uart_baudrate(0)
+    , _link_bandwidth(0)
+    , _output_start(0)
+    , _output_end(0)
+    , _output_segment_num(0)
+    , _delayed_urc_num(0)
+    , _input_state(INPUT_COMMAND)
+    , _input_line_len(0)
+    , _input_data_len(0)
+    , _input_data_expected(0)
+    , _input_data_link(-1)
+    , _input_time(0)
+    , _suppress_ok(false)
+    , _command_failed(false)
+    , _cmux_mode(false)
+    , _cmux_frame_size(31)
+    , _output_dlci(EMULATOR_URC_DLCI)
+    , _input_dlci(EMULATOR_URC_DLCI)
+    , _echo(true)
+    , _cfun(0)
+    , _cgreg_mode(0)
+    , _cgreg_status(1)
+    , _cgreg_dlci(EMULATOR_URC_DLCI)
+    , _cnsmod_mode(0)
+    , _cnsmod_status(4)
+    , _cnsmod_dlci(EMULATOR_URC_DLCI)
+    , _cmgf(1)
+    , _net_opened(false)
+    , _net_state_time(0)
+    , _net_dlci(EMULATOR_URC_DLCI)
+    , _cipmode(0)
+    , _ciprxget_mode(0)
+    , _peer_mode(PEER_SINK)
+    , _receive_urc_drop_count(0)
+    , _transparent_link(-1)
+    , _transparent_data_time(0)
+    , _dns_entry_num(0)
+    , _gps_active(false)
+    , _gps_mode(1)
+    , _gps_accuracy(50)
+    , _sms_sent_count(0)
+    , _ftp_started(false)
+    , _ftp_logged_in(false)
+    , _ftp_cache_active(false)
+    , _ftp_cache_list(false)
+    , _ftp_cache_size(0)
+    , _ftp_cache_pos(0)
+    , _ftp_cache_time(0)
+    , _ftp_put_file(-1)
+    , _ftp_put_pending(0)
+    , _ftp_put_time(0)
+{
+    _input_data_target[0] = '\0';
+    _gps_info[0] = '\0';
+    strcpy(_ftp_cwd, "/");
+    memset(_links, 0, sizeof(_links));
+    memset(_sms, 0, sizeof(_sms));
+    memset(_ftp_files, 0, sizeof(_ftp_files));
+    memset(_cmux_lines, 0, sizeof(_cmux_lines));
+    reset_stats();
+}
+
+SIM5320ModemEmulator::~SIM5320ModemEmulator()
+{
+    _wakeup_timeout.detach();
+}
+
+/**
+ * FileHandle interface
+ */
+
+ssize_t SIM5320ModemEmulator::read(void *buffer, size_t size)
+{
+    while (true) {
+        _mutex.lock();
+        _update();
+        size_t len = _get_readable_len(_get_time());
+        if (len > size) {
+            len = size;
+        }
+        if (len > 0) {
+            memcpy(buffer, _output_buf + _output_start, len);
+            _output_start += len;
+            _output_read_total += len;
+            _stats.uart_tx_bytes += len;
+            // remove read segments
+            int i = 0;
+            while (i < _output_segment_num && _output_segments[i].end <= _output_start) {
+                i++;
+            }
+            if (i > 0) {
+                memmove(_output_segments, _output_segments + i, sizeof(output_segment_t) * (_output_segment_num - i));
+                _output_segment_num -= i;
+            }
+            if (_output_start == _output_end) {
+                _output_start = 0;
+                _output_end = 0;
+            }
+        }
+        _mutex.unlock();
+
+        if (len > 0) {
+            return len;
+        } else if (!_blocking) {
+            return -EAGAIN;
+        }
+        rtos::ThisThread::sleep_for(1);
+    }
+}
+
+ssize_t SIM5320ModemEmulator::write(const void *buffer, size_t size)
+{
+    const uint8_t *data = (const uint8_t *)buffer;
+    _mutex.lock();
+    uint64_t now = _get_time();
+    _update();
+    if (_input_time < now) {
+        _input_time = now;
+    }
+    if (!_cmux_mode && _input_state == INPUT_TRANSPARENT && size == 3 && memcmp(data, "+++", 3) == 0
+        && now >= _transparent_data_time + EMULATOR_ESCAPE_GUARD_TIME) {
+        // escape sequence: switch to command mode after guard time
+        _input_state = INPUT_COMMAND;
+        _input_line_len = 0;
+        _output_ok(_input_time + _get_uart_time(3) + EMULATOR_ESCAPE_GUARD_TIME);
+        size = 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+        // each byte arrives to the modem with UART speed
+        _input_time += _get_uart_time(1);
+        if (!_cmux_mode) {
+            _process_input_byte(data[i]);
+        } else if (_cmux_codec.decode(data[i])) {
+            _cmux_process_frame();
+        }
+    }
+    if (_input_state == INPUT_TRANSPARENT && size > 0) {
+        _transparent_data_time = now;
+        _process_transparent_data();
+    }
+    _stats.uart_rx_bytes += size;
+    _schedule_wakeup(now);
+    _mutex.unlock();
+    return size;
+}
+
+off_t SIM5320ModemEmulator::seek(off_t offset, int whence)
+{
+    return -ESPIPE;
+}
+
+int SIM5320ModemEmulator::close()
+{
+    return 0;
+}
+
+int SIM5320ModemEmulator::set_blocking(bool blocking)
+{
+    _blocking = blocking;
+    return 0;
+}
+
+bool SIM5320ModemEmulator::is_blocking() const
+{
+    return _blocking;
+}
+
+short SIM5320ModemEmulator::poll(short events) const
+{
+    short revents = POLLOUT;
+    SIM5320ModemEmulator *self = const_cast<SIM5320ModemEmulator *>(this);
+    _mutex.lock();
+    self->_update();
+    if (_get_readable_len(_get_time()) > 0) {
+        revents |= POLLIN;
+    }
+    _mutex.unlock();
+    return revents & events;
+}
+
+void SIM5320ModemEmulator::sigio(Callback<void()> func)
+{
+    _mutex.lock();
+    _sigio_cb = func;
+    // notify about pending data, like UART does
+    _output_notified_total = _output_read_total;
+    _schedule_wakeup(_get_time());
+    _mutex.unlock();
+}
+
+/**
+ * Configuration
+ */
+
+void SIM5320ModemEmulator::set_default_latency(int latency_ms)
+{
+    _mutex.lock();
+    _default_latency = latency_ms < 0 ? 0 : latency_ms;
+    _mutex.unlock();
+}
+
+nsapi_error_t SIM5320ModemEmulator::set_command_latency(const char *cmd_prefix, int latency_ms)
+{
+    if (!cmd_prefix || strlen(cmd_prefix) >= sizeof(_command_latency[0].prefix) || latency_ms < 0) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    nsapi_error_t err = NSAPI_ERROR_OK;
+    _mutex.lock();
+    int i;
+    for (i = 0; i < _command_latency_num; i++) {
+        if (strcmp(_command_latency[i].prefix, cmd_prefix) == 0) {
+            break;
+        }
+    }
+    if (i < MAX_COMMAND_LATENCY_NUM) {
+        strcpy(_command_latency[i].prefix, cmd_prefix);
+        _command_latency[i].latency = latency_ms;
+        if (i == _command_latency_num) {
+            _command_latency_num++;
+        }
+    } else {
+        err = NSAPI_ERROR_NO_MEMORY;
+    }
+    _mutex.unlock();
+    return err;
+}
+
+void SIM5320ModemEmulator::set_uart_baudrate(int baudrate)
+{
+    _mutex.lock();
+    _uart_baudrate = baudrate < 0 ? 0 : baudrate;
+    _mutex.unlock();
+}
+
+int SIM5320ModemEmulator::get_uart_baudrate() const
+{
+    return _uart_baudrate;
+}
+
+void SIM5320ModemEmulator::set_link_bandwidth(int bytes_per_second)
+{
+    _mutex.lock();
+    _link_bandwidth = bytes_per_second < 0 ? 0 : bytes_per_second;
+    _mutex.unlock();
+}
+
+void SIM5320ModemEmulator::set_peer_mode(SIM5320ModemEmulator::PeerMode mode)
+{
+    _mutex.lock();
+    _peer_mode = mode;
+    _mutex.unlock();
+}
+
+void SIM5320ModemEmulator::drop_receive_urcs(int count)
+{
+    _mutex.lock();
+    _receive_urc_drop_count = count < 0 ? 0 : count;
+    _mutex.unlock();
+}
+
+nsapi_error_t SIM5320ModemEmulator::start_peer_stream(int link_id, size_t size)
+{
+    if (link_id < 0 || link_id >= LINK_NUM) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    nsapi_error_t err = NSAPI_ERROR_OK;
+    _mutex.lock();
+    link_t *link = &_links[link_id];
+    if (link->opened) {
+        if (link->stream_left == 0) {
+            link->stream_time = _get_time();
+        }
+        link->stream_left += size;
+        _update();
+    } else {
+        err = NSAPI_ERROR_NO_SOCKET;
+    }
+    _mutex.unlock();
+    return err;
+}
+
+nsapi_size_or_error_t SIM5320ModemEmulator::inject_socket_data(int link_id, const void *data, size_t size)
+{
+    if (link_id < 0 || link_id >= LINK_NUM) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    nsapi_size_or_error_t result;
+    _mutex.lock();
+    if (_links[link_id].opened) {
+        uint64_t now = _get_time();
+        _update();
+        result = _link_push(link_id, (const uint8_t *)data, size);
+        if (result > 0) {
+            _link_deliver(link_id, result, now);
+        }
+        _schedule_wakeup(now);
+    } else {
+        result = NSAPI_ERROR_NO_SOCKET;
+    }
+    _mutex.unlock();
+    return result;
+}
+
+nsapi_error_t SIM5320ModemEmulator::close_by_peer(int link_id)
+{
+    if (link_id < 0 || link_id >= LINK_NUM) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    nsapi_error_t err = NSAPI_ERROR_OK;
+    _mutex.lock();
+    if (_links[link_id].opened) {
+        uint64_t now = _get_time();
+        _update();
+        _output_dlci = _links[link_id].dlci;
+        if (link_id == _transparent_link) {
+            // modem leaves data mode
+            _link_close(link_id);
+            _output_line(now, "CLOSED");
+        } else {
+            _link_close(link_id);
+            _output_line(now, "+IPCLOSE: %d,1", link_id);
+        }
+        _schedule_wakeup(now);
+    } else {
+        err = NSAPI_ERROR_NO_SOCKET;
+    }
+    _mutex.unlock();
+    return err;
+}
+
+nsapi_error_t SIM5320ModemEmulator::drop_network()
+{
+    nsapi_error_t err = NSAPI_ERROR_OK;
+    _mutex.lock();
+    uint64_t now = _get_time();
+    _update();
+    if (_is_net_opened(now) && _transparent_link < 0) {
+        for (int i = 0; i < LINK_NUM; i++) {
+            _link_close(i);
+        }
+        _net_opened = false;
+        _net_state_time = now;
+        _output_dlci = _net_dlci;
+        _output_line(now, "+CIPEVENT: NETWORK CLOSED UNEXPECTEDLY");
+        _schedule_wakeup(now);
+    } else {
+        err = NSAPI_ERROR_NO_CONNECTION;
+    }
+    _mutex.unlock();
+    return err;
+}
+
+void SIM5320ModemEmulator::set_network_registration(int status, int system_mode)
+{
+    _mutex.lock();
+    uint64_t now = _get_time();
+    _update();
+    if (status != _cgreg_status) {
+        _cgreg_status = status;
+        _output_dlci = _cgreg_dlci;
+        if (_cgreg_mode == 1) {
+            _output_line(now, "+CGREG: %d", _cgreg_status);
+        } else if (_cgreg_mode == 2 && (_cgreg_status == 1 || _cgreg_status == 5)) {
+            _output_line(now, "+CGREG: %d,\"00C3\",\"0000A13F\"", _cgreg_status);
+        } else if (_cgreg_mode == 2) {
+            // location is reported only in registered states
+            _output_line(now, "+CGREG: %d", _cgreg_status);
+        }
+    }
+    if (system_mode != _cnsmod_status) {
+        _cnsmod_status = system_mode;
+        _output_dlci = _cnsmod_dlci;
+        if (_cnsmod_mode == 1) {
+            _output_line(now, "+CNSMOD: %d", _cnsmod_status);
+        }
+    }
+    _schedule_wakeup(now);
+    _mutex.unlock();
+}
+
+nsapi_error_t SIM5320ModemEmulator::inject_urc(const char *urc)
+{
+    if (!urc) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    _mutex.lock();
+    uint64_t now = _get_time();
+    _update();
+    _output_dlci = EMULATOR_URC_DLCI;
+    _output_line(now, "%s", urc);
+    _schedule_wakeup(now);
+    _mutex.unlock();
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t SIM5320ModemEmulator::add_dns_entry(const char *host, const char *ip_address)
+{
+    if (!host || !ip_address || strlen(host) >= sizeof(_dns_entries[0].host) || strlen(ip_address) >= NSAPI_IP_SIZE) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    nsapi_error_t err = NSAPI_ERROR_OK;
+    _mutex.lock();
+    if (_dns_entry_num < MAX_DNS_ENTRY_NUM) {
+        strcpy(_dns_entries[_dns_entry_num].host, host);
+        strcpy(_dns_entries[_dns_entry_num].ip_address, ip_address);
+        _dns_entry_num++;
+    } else {
+        err = NSAPI_ERROR_NO_MEMORY;
+    }
+    _mutex.unlock();
+    return err;
+}
+
+nsapi_error_t SIM5320ModemEmulator::set_gps_info(const char *cgpsinfo)
+{
+    if (!cgpsinfo || strlen(cgpsinfo) >= sizeof(_gps_info)) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    _mutex.lock();
+    strcpy(_gps_info, cgpsinfo);
+    _mutex.unlock();
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t SIM5320ModemEmulator::inject_sms(const char *phone_number, const char *message)
+{
+    if (!phone_number || !message || strlen(phone_number) >= sizeof(_sms[0].phone_number) || strlen(message) >= sizeof(_sms[0].message)) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    nsapi_error_t err = NSAPI_ERROR_NO_MEMORY;
+    _mutex.lock();
+    for (int i = 0; i < MAX_SMS_NUM; i++) {
+        if (!_sms[i].used) {
+            uint64_t now = _get_time();
+            _update();
+            _sms[i].used = true;
+            _sms[i].read = false;
+            strcpy(_sms[i].phone_number, phone_number);
+            strcpy(_sms[i].message, message);
+            _output_dlci = EMULATOR_URC_DLCI;
+            _output_line(now, "+CMTI: \"SM\",%d", i);
+            _schedule_wakeup(now);
+            err = NSAPI_ERROR_OK;
+            break;
+        }
+    }
+    _mutex.unlock();
+    return err;
+}
+
+nsapi_error_t SIM5320ModemEmulator::add_ftp_file(const char *path, size_t size)
+{
+    if (!path || path[0] != '/' || strlen(path) >= sizeof(_ftp_files[0].path)) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    _mutex.lock();
+    int file_i = _ftp_find_file(path);
+    if (file_i < 0) {
+        file_i = _ftp_add_file(path, size, false);
+    } else {
+        _ftp_files[file_i].size = size;
+    }
+    _mutex.unlock();
+    return file_i < 0 ? NSAPI_ERROR_NO_MEMORY : NSAPI_ERROR_OK;
+}
+
+void SIM5320ModemEmulator::get_stats(SIM5320ModemEmulator::stats_t &stats)
+{
+    _mutex.lock();
+    stats = _stats;
+    _mutex.unlock();
+}
+
+void SIM5320ModemEmulator::reset_stats()
+{
+    _mutex.lock();
+    memset(&_stats, 0, sizeof(_stats));
+    _mutex.unlock();
+}
+
+/**
+ * Timing model
+ */
+
+uint64_t SIM5320ModemEmulator::_get_time() const
+{
+    return rtos::Kernel::get_ms_count();
+}
+
+int SIM5320ModemEmulator::_get_command_latency(const char *cmd) const
+{
+    int latency = _default_latency;
+    size_t best_len = 0;
+    for (int i = 0; i < _command_latency_num; i++) {
+        size_t prefix_len = strlen(_command_latency[i].prefix);
+        if (prefix_len > best_len && strncmp(cmd, _command_latency[i].prefix, prefix_len) == 0) {
+            best_len = prefix_len;
+            latency = _command_latency[i].latency;
+        }
+    }
+    return latency;
+}
+
+uint64_t SIM5320ModemEmulator::_get_uart_time(size_t len) const
+{
+    // 8N1 format: 10 bits per byte
+    return _uart_baudrate > 0 ? (uint64_t)len * 10000 / _uart_baudrate : 0;
+}
+
+uint64_t SIM5320ModemEmulator::_get_link_time(size_t len) const
+{
+    return _link_bandwidth > 0 ? (uint64_t)len * 1000 / _link_bandwidth : 0;
+}
+
+bool SIM5320ModemEmulator::_is_net_opened(uint64_t now) const
+{
+    return now >= _net_state_time ? _net_opened : !_net_opened;
+}
+
+void SIM5320ModemEmulator::_update()
+{
+    uint64_t now = _get_time();
+
+    // move delayed URCs to output
+    while (_delayed_urc_num > 0 && _delayed_urcs[0].time <= now) {
+        _output_dlci = _delayed_urcs[0].dlci;
+        _output_line(_delayed_urcs[0].time, "%s", _delayed_urcs[0].text);
+        _delayed_urc_num--;
+        memmove(_delayed_urcs, _delayed_urcs + 1, sizeof(delayed_urc_t) * _delayed_urc_num);
+    }
+    _update_links(now);
+    _update_ftp(now);
+    _schedule_wakeup(now);
+}
+
+void SIM5320ModemEmulator::_update_links(uint64_t now)
+{
+    for (int link_id = 0; link_id < LINK_NUM; link_id++) {
+        link_t *link = &_links[link_id];
+        while (link->opened && link->stream_left > 0) {
+            size_t packet_size = link->stream_left < MAX_PACKET_SIZE ? link->stream_left : MAX_PACKET_SIZE;
+            size_t free_space = _link_free_space(link_id);
+            if (_ciprxget_mode == 0 || link_id == _transparent_link) {
+                // in the push and transparent modes data is transferred directly to output
+                size_t output_free_space = _get_output_free_space();
+                if (_cmux_mode) {
+                    // take into account frame headers
+                    output_free_space = output_free_space * _cmux_frame_size / (_cmux_frame_size + 6);
+                }
+                output_free_space = output_free_space > 32 ? output_free_space - 32 : 0;
+                free_space = free_space < output_free_space ? free_space : output_free_space;
+            }
+            if (packet_size > free_space) {
+                packet_size = free_space;
+            }
+            if (packet_size == 0) {
+                // modem buffer is full, so peer should wait
+                link->stream_time = now;
+                break;
+            }
+            uint64_t arrival_time = link->stream_time + _get_link_time(packet_size);
+            if (arrival_time > now) {
+                break;
+            }
+            for (size_t i = 0; i < packet_size; i++) {
+                uint8_t sym = get_stream_byte(link->stream_offset++);
+                _link_push(link_id, &sym, 1);
+            }
+            link->stream_left -= packet_size;
+            link->stream_time = arrival_time;
+            _link_deliver(link_id, packet_size, arrival_time);
+        }
+    }
+}
+
+void SIM5320ModemEmulator::_update_ftp(uint64_t now)
+{
+    if (_ftp_put_pending > 0) {
+        size_t sent = _link_bandwidth > 0 ? (now - _ftp_put_time) * _link_bandwidth / 1000 : _ftp_put_pending;
+        if (sent > 0) {
+            _ftp_put_pending = sent < _ftp_put_pending ? _ftp_put_pending - sent : 0;
+            _ftp_put_time = now;
+        }
+    }
+}
+
+size_t SIM5320ModemEmulator::_get_readable_len(uint64_t now) const
+{
+    size_t len = 0;
+    size_t seg_start = _output_start;
+    for (int i = 0; i < _output_segment_num; i++) {
+        const output_segment_t *seg = &_output_segments[i];
+        if (now >= seg->end_time) {
+            len = seg->end - _output_start;
+        } else {
+            if (now > seg->start_time && _uart_baudrate > 0) {
+                size_t part = (now - seg->start_time) * _uart_baudrate / 10000;
+                if (seg_start + part > seg->end) {
+                    part = seg->end - seg_start;
+                }
+                len = seg_start + part - _output_start;
+            }
+            break;
+        }
+        seg_start = seg->end;
+    }
+    return len;
+}
+
+size_t SIM5320ModemEmulator::_get_output_free_space() const
+{
+    return OUTPUT_BUFFER_SIZE - (_output_end - _output_start);
+}
+
+void SIM5320ModemEmulator::_schedule_wakeup(uint64_t now)
+{
+    // notify host about new data
+    uint32_t readable_total = _output_read_total + _get_readable_len(now);
+    if (readable_total != _output_notified_total) {
+        _output_notified_total = readable_total;
+        _notify();
+    }
+
+    // find time of the next event
+    uint64_t next_time = EMULATOR_TIME_NEVER;
+    for (int i = 0; i < _output_segment_num; i++) {
+        const output_segment_t *seg = &_output_segments[i];
+        if (seg->end_time > now) {
+            next_time = seg->start_time > now ? seg->start_time : seg->end_time;
+            break;
+        }
+    }
+    if (_delayed_urc_num > 0 && _delayed_urcs[0].time < next_time) {
+        next_time = _delayed_urcs[0].time;
+    }
+    for (int link_id = 0; link_id < LINK_NUM; link_id++) {
+        const link_t *link = &_links[link_id];
+        if (link->opened && link->stream_left > 0 && _link_free_space(link_id) > 0) {
+            size_t packet_size = link->stream_left < MAX_PACKET_SIZE ? link->stream_left : MAX_PACKET_SIZE;
+            uint64_t arrival_time = link->stream_time + _get_link_time(packet_size);
+            if (arrival_time < next_time) {
+                next_time = arrival_time;
+            }
+        }
+    }
+
+    if (next_time == EMULATOR_TIME_NEVER || next_time == _wakeup_time) {
+        return;
+    }
+    _wakeup_time = next_time;
+    uint64_t delay_ms = next_time > now ? next_time - now : 1;
+    _wakeup_timeout.attach_us(callback(this, &SIM5320ModemEmulator::_wakeup_handler), delay_ms * 1000);
+}
+
+void SIM5320ModemEmulator::_wakeup_handler()
+{
+    // note: it's invoked from interrupt context, so only notify host. All work will be done during poll/read.
+    _wakeup_time = EMULATOR_TIME_NEVER;
+    _notify();
+}
+
+void SIM5320ModemEmulator::_notify()
+{
+    if (_sigio_cb) {
+        _sigio_cb();
+    }
+}
+
+/**
+ * Output helpers
+ */
+
+void SIM5320ModemEmulator::_output_uart(uint64_t time, const void *data, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    // compact buffer
+    if (_output_end + len > OUTPUT_BUFFER_SIZE && _output_start > 0) {
+        memmove(_output_buf, _output_buf + _output_start, _output_end - _output_start);
+        for (int i = 0; i < _output_segment_num; i++) {
+            _output_segments[i].end -= _output_start;
+        }
+        _output_end -= _output_start;
+        _output_start = 0;
+    }
+    if (_output_end + len > OUTPUT_BUFFER_SIZE) {
+        // modem UART buffer overflow
+        _stats.overrun_bytes += len;
+        return;
+    }
+    memcpy(_output_buf + _output_end, data, len);
+    _output_end += len;
+
+    // calculate transmission time
+    uint64_t start_time = time;
+    if (_output_segment_num > 0 && _output_segments[_output_segment_num - 1].end_time > start_time) {
+        start_time = _output_segments[_output_segment_num - 1].end_time;
+    }
+    if (_output_segment_num >= MAX_OUTPUT_SEGMENT_NUM) {
+        // merge with last segment
+        output_segment_t *seg = &_output_segments[_output_segment_num - 1];
+        seg->end = _output_end;
+        seg->end_time = start_time + _get_uart_time(len);
+    } else {
+        output_segment_t *seg = &_output_segments[_output_segment_num++];
+        seg->end = _output_end;
+        seg->start_time = start_time;
+        seg->end_time = start_time + _get_uart_time(len);
+    }
+}
+
+void SIM5320ModemEmulator::_output_frame(uint64_t time, int dlci, uint8_t control, const uint8_t *data, size_t len)
+{
+    uint8_t frame[CMUXCodec::MAX_DATA_SIZE + 6];
+    // note: modem responses have C/R bit, as modem is responder
+    size_t frame_len = CMUXCodec::encode(frame, dlci, control != CMUXCodec::UIH, control, data, len);
+    _output_uart(time, frame, frame_len);
+}
+
+void SIM5320ModemEmulator::_output_raw(uint64_t time, const void *data, size_t len)
+{
+    if (!_cmux_mode) {
+        _output_uart(time, data, len);
+        return;
+    }
+    // split output into UIH frames of the current channel
+    const uint8_t *buf = (const uint8_t *)data;
+    while (len > 0) {
+        size_t frame_data_len = len < _cmux_frame_size ? len : _cmux_frame_size;
+        _output_frame(time, _output_dlci, CMUXCodec::UIH, buf, frame_data_len);
+        buf += frame_data_len;
+        len -= frame_data_len;
+    }
+}
+
+void SIM5320ModemEmulator::_output_line(uint64_t time, const char *format, ...)
+{
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line + 2, sizeof(line) - 4, format, args);
+    va_end(args);
+    if (len < 0) {
+        return;
+    }
+    if (len > (int)sizeof(line) - 5) {
+        len = sizeof(line) - 5;
+    }
+    line[0] = '\r';
+    line[1] = '\n';
+    line[len + 2] = '\r';
+    line[len + 3] = '\n';
+    _output_raw(time, line, len + 4);
+}
+
+void SIM5320ModemEmulator::_output_ok(uint64_t time)
+{
+    if (_suppress_ok) {
+        // intermediate command of the command line
+        return;
+    }
+    _output_line(time, "OK");
+}
+
+void SIM5320ModemEmulator::_output_error(uint64_t time)
+{
+    _command_failed = true;
+    _output_line(time, "ERROR");
+}
+
+void SIM5320ModemEmulator::_output_delayed_urc(uint64_t time, const char *format, ...)
+{
+    if (_delayed_urc_num >= MAX_DELAYED_URC_NUM) {
+        _stats.overrun_bytes++;
+        return;
+    }
+    // keep URCs sorted by time
+    int i = _delayed_urc_num;
+    while (i > 0 && _delayed_urcs[i - 1].time > time) {
+        _delayed_urcs[i] = _delayed_urcs[i - 1];
+        i--;
+    }
+    delayed_urc_t *urc = &_delayed_urcs[i];
+    urc->time = time;
+    urc->dlci = _output_dlci;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(urc->text, sizeof(urc->text), format, args);
+    va_end(args);
+    _delayed_urc_num++;
+}
+
+/**
+ * Input processing
+ */
+
+void SIM5320ModemEmulator::_process_input_byte(uint8_t sym)
+{
+    switch (_input_state) {
+    case INPUT_COMMAND:
+        if (sym == '\r') {
+            _input_line[_input_line_len] = '\0';
+            if (_input_line_len > 0) {
+                _process_command_line(_input_line);
+            }
+            _input_line_len = 0;
+        } else if (sym == '\n') {
+            // ignore
+        } else if (_input_line_len < INPUT_LINE_SIZE - 1) {
+            _input_line[_input_line_len++] = sym;
+        }
+        break;
+    case INPUT_DATA:
+        _input_data[_input_data_len++] = sym;
+        if (_input_data_len >= _input_data_expected) {
+            _input_state = INPUT_COMMAND;
+            _process_data();
+        }
+        break;
+    case INPUT_SMS_TEXT:
+        if (sym == CTRL_Z) {
+            _input_state = INPUT_COMMAND;
+            _process_sms_text();
+        } else if (sym == ESC) {
+            _input_state = INPUT_COMMAND;
+            _output_ok(_input_time + _default_latency);
+        } else if (_input_data_len < INPUT_DATA_SIZE) {
+            _input_data[_input_data_len++] = sym;
+        }
+        break;
+    case INPUT_TRANSPARENT:
+        _input_data[_input_data_len++] = sym;
+        if (_input_data_len >= INPUT_DATA_SIZE) {
+            _process_transparent_data();
+        }
+        break;
+    }
+}
+
+void SIM5320ModemEmulator::_process_command_line(const char *line)
+{
+    char cmd[INPUT_LINE_SIZE];
+    uint64_t time = _input_time;
+
+    _stats.command_lines++;
+
+    if (_echo) {
+        _output_raw(time, line, strlen(line));
+        _output_raw(time, "\r", 1);
+    }
+
+    // skip "AT" prefix
+    if (!((line[0] == 'A' || line[0] == 'a') && (line[1] == 'T' || line[1] == 't'))) {
+        _stats.commands++;
+        _output_error(time + _default_latency);
+        return;
+    }
+    // execute commands that are separated by ';' one by one, until first error
+    const char *part = line + 2;
+    while (true) {
+        const char *end = part;
+        bool quoted = false;
+        while (*end != '\0' && (quoted || *end != ';')) {
+            if (*end == '"') {
+                quoted = !quoted;
+            }
+            end++;
+        }
+        bool last = *end == '\0' || *(end + 1) == '\0';
+        size_t len = end - part;
+        cmd[0] = 'A';
+        cmd[1] = 'T';
+        memcpy(cmd + 2, part, len);
+        cmd[len + 2] = '\0';
+
+        _suppress_ok = !last;
+        _command_failed = false;
+        time = _process_command(cmd, time);
+        _suppress_ok = false;
+        if (last || _command_failed) {
+            break;
+        }
+        part = end + 1;
+    }
+}
+
+uint64_t SIM5320ModemEmulator::_process_command(const char *cmd, uint64_t start_time)
+{
+    char name[16];
+    size_t name_len = 0;
+    const char *args;
+    uint64_t time = start_time + _get_command_latency(cmd);
+
+    _stats.commands++;
+
+    if (!((cmd[0] == 'A' || cmd[0] == 'a') && (cmd[1] == 'T' || cmd[1] == 't'))) {
+        _output_error(time);
+        return time;
+    }
+    args = cmd + 2;
+    // extract command name
+    while (*args != '\0' && *args != '=' && *args != '?' && name_len < sizeof(name) - 1) {
+        name[name_len++] = *args;
+        args++;
+    }
+    name[name_len] = '\0';
+
+    if (strncmp(name, "+CIP", 4) == 0 || strcmp(name, "+NETOPEN") == 0 || strcmp(name, "+NETCLOSE") == 0) {
+        if (strcmp(name, "+NETOPEN") == 0 || strcmp(name, "+NETCLOSE") == 0) {
+            _cmd_network(name, args, time);
+        } else {
+            _cmd_socket(name, args, time);
+        }
+    } else if (strcmp(name, "+CDNSGIP") == 0) {
+        _cmd_dns(name, args, time);
+    } else if (strncmp(name, "+CGPS", 5) == 0) {
+        _cmd_gps(name, args, time);
+    } else if (strncmp(name, "+CMG", 4) == 0) {
+        _cmd_sms(name, args, time);
+    } else if (strncmp(name, "+CFTPS", 6) == 0) {
+        _cmd_ftp(name, args, time);
+    } else if (strcmp(name, "+CREG") == 0 || strcmp(name, "+CGREG") == 0 || strcmp(name, "+COPS") == 0
+        || strcmp(name, "+CGATT") == 0 || strcmp(name, "+CNSMOD") == 0 || strcmp(name, "+CSQ") == 0) {
+        _cmd_network(name, args, time);
+    } else if (strcmp(name, "+CGMI") == 0 || strcmp(name, "+CGMM") == 0 || strcmp(name, "+CGMR") == 0
+        || strcmp(name, "+CGSN") == 0 || strcmp(name, "+CIMI") == 0 || strcmp(name, "+CICCID") == 0
+        || strcmp(name, "+CNUM") == 0) {
+        _cmd_info(name, args, time);
+    } else {
+        _cmd_basic(name, args, time);
+    }
+    return time;
+}
+
+void SIM5320ModemEmulator::_process_data()
+{
+    uint64_t time = _input_time + _default_latency;
+
+    if (strcmp(_input_data_target, "CIPSEND") == 0) {
+        link_t *link = &_links[_input_data_link];
+        if (!link->opened) {
+            _output_error(time);
+            return;
+        }
+        _output_ok(time);
+        // simulate transmission over network link
+        uint64_t tx_time = link->tx_time > _input_time ? link->tx_time : _input_time;
+        tx_time += _get_link_time(_input_data_len);
+        link->tx_time = tx_time;
+        uint64_t cnf_time = tx_time + _get_command_latency("AT+CIPSEND");
+        _output_delayed_urc(cnf_time, "+CIPSEND: %d,%d,%d", _input_data_link, (int)_input_data_len, (int)_input_data_len);
+        _stats.link_tx_bytes += _input_data_len;
+        if (link->peer_mode == PEER_ECHO) {
+            size_t len = _link_push(_input_data_link, _input_data, _input_data_len);
+            _link_deliver(_input_data_link, len, cnf_time);
+        }
+    } else if (strcmp(_input_data_target, "CFTPSPUT") == 0) {
+        if (_ftp_put_file >= 0) {
+            _ftp_files[_ftp_put_file].size += _input_data_len;
+        }
+        if (_ftp_put_pending == 0) {
+            _ftp_put_time = _input_time;
+        }
+        _ftp_put_pending += _input_data_len;
+        _output_ok(time);
+    }
+}
+
+void SIM5320ModemEmulator::_process_transparent_data()
+{
+    if (_input_data_len == 0 || _transparent_link < 0) {
+        return;
+    }
+    link_t *link = &_links[_transparent_link];
+    // simulate transmission over network link
+    uint64_t tx_time = link->tx_time > _input_time ? link->tx_time : _input_time;
+    tx_time += _get_link_time(_input_data_len);
+    link->tx_time = tx_time;
+    _stats.link_tx_bytes += _input_data_len;
+    if (link->peer_mode == PEER_ECHO) {
+        size_t len = _link_push(_transparent_link, _input_data, _input_data_len);
+        _link_deliver(_transparent_link, len, tx_time);
+    }
+    _input_data_len = 0;
+}
+
+void SIM5320ModemEmulator::_process_sms_text()
+{
+    uint64_t time = _input_time + _get_command_latency("AT+CMGS");
+    _sms_sent_count++;
+    _output_line(time, "+CMGS: %d", _sms_sent_count);
+    _output_ok(time);
+}
+
+void SIM5320ModemEmulator::_cmux_process_frame()
+{
+    int dlci = _cmux_codec.dlci;
+    uint8_t frame_type = _cmux_codec.control & ~CMUXCodec::PF;
+    uint64_t time = _input_time + _default_latency;
+
+    if (dlci > CMUX_CHANNEL_NUM) {
+        _output_frame(time, dlci, CMUXCodec::DM | CMUXCodec::PF, NULL, 0);
+        return;
+    }
+    switch (frame_type) {
+    case CMUXCodec::SABM:
+        _output_frame(time, dlci, CMUXCodec::UA | CMUXCodec::PF, NULL, 0);
+        if (dlci > 0) {
+            _cmux_lines[dlci - 1].len = 0;
+        }
+        break;
+    case CMUXCodec::DISC:
+        _output_frame(time, dlci, CMUXCodec::UA | CMUXCodec::PF, NULL, 0);
+        if (dlci == 0) {
+            _cmux_stop();
+        }
+        break;
+    case CMUXCodec::UIH:
+        if (dlci > 0) {
+            for (size_t i = 0; i < _cmux_codec.len; i++) {
+                _cmux_process_input(dlci, _cmux_codec.data[i]);
+            }
+            if (_input_state == INPUT_TRANSPARENT && _input_dlci == dlci) {
+                _process_transparent_data();
+            }
+        } else if (_cmux_codec.len >= 2 && (_cmux_codec.data[0] & 0x02)) {
+            // confirm control channel command (MSC, CLD, etc.)
+            uint8_t msg_type = _cmux_codec.data[0];
+            _cmux_codec.data[0] &= ~0x02;
+            _output_frame(time, 0, CMUXCodec::UIH, _cmux_codec.data, _cmux_codec.len);
+            if (msg_type == 0xC3) {
+                // close down command
+                _cmux_stop();
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void SIM5320ModemEmulator::_cmux_process_input(int dlci, uint8_t sym)
+{
+    if (_input_state != INPUT_COMMAND && dlci == _input_dlci) {
+        _output_dlci = dlci;
+        _process_input_byte(sym);
+        return;
+    }
+    // each channel has own command line buffer
+    cmux_line_t *line = &_cmux_lines[dlci - 1];
+    if (sym == '\r') {
+        line->text[line->len] = '\0';
+        if (line->len > 0) {
+            _output_dlci = dlci;
+            _input_dlci = dlci;
+            _process_command_line(line->text);
+        }
+        line->len = 0;
+    } else if (sym != '\n' && line->len < INPUT_LINE_SIZE - 1) {
+        line->text[line->len++] = sym;
+    }
+}
+
+void SIM5320ModemEmulator::_cmux_stop()
+{
+    _cmux_mode = false;
+    _output_dlci = EMULATOR_URC_DLCI;
+    if (_input_state != INPUT_COMMAND && _input_state != INPUT_TRANSPARENT) {
+        _input_state = INPUT_COMMAND;
+    }
+}
+
+/**
+ * Command handlers
+ */
+
+void SIM5320ModemEmulator::_cmd_basic(const char *name, const char *args, uint64_t time)
+{
+    char argv[MAX_ARG_NUM][MAX_ARG_LEN];
+
+    if (strcmp(name, "E0") == 0) {
+        _echo = false;
+    } else if (strcmp(name, "E1") == 0) {
+        _echo = true;
+    } else if (strcmp(name, "+CFUN") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CFUN: %d", _cfun);
+        } else if (args[0] == '=' && parse_args(args + 1, argv, MAX_ARG_NUM) >= 1) {
+            _cfun = atoi(argv[0]);
+        }
+    } else if (strcmp(name, "O") == 0) {
+        // return to data mode of the transparent link
+        if (_transparent_link < 0) {
+            _output_error(time);
+            return;
+        }
+        _output_line(time, "CONNECT %d", EMULATOR_CONNECT_BAUDRATE);
+        _input_state = INPUT_TRANSPARENT;
+        _input_data_len = 0;
+        // deliver data that has been received in command mode
+        _link_deliver(_transparent_link, _links[_transparent_link].rx_len, time + _default_latency);
+        return;
+    } else if (strcmp(name, "+IPR") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+IPR: %d", _uart_baudrate);
+        } else if (args[0] == '=' && parse_args(args + 1, argv, MAX_ARG_NUM) >= 1 && atoi(argv[0]) > 0) {
+            // response is sent with previous baudrate
+            _output_ok(time);
+            _uart_baudrate = atoi(argv[0]);
+            return;
+        }
+    } else if (strcmp(name, "+CMUX") == 0) {
+        // format: AT+CMUX=<mode>[,<subset>[,<port_speed>[,<N1>]]]
+        int argc = args[0] == '=' ? parse_args(args + 1, argv, MAX_ARG_NUM) : 0;
+        int frame_size = argc >= 4 && argv[3][0] != '\0' ? atoi(argv[3]) : 31;
+        if (argc < 1 || strcmp(argv[0], "0") != 0 || frame_size < 1 || frame_size > (int)CMUXCodec::MAX_DATA_SIZE || _cmux_mode) {
+            // only basic option is supported
+            _output_error(time);
+            return;
+        }
+        // response is sent in AT command mode
+        _output_ok(time);
+        _cmux_mode = true;
+        _cmux_frame_size = frame_size;
+        _cmux_codec.reset();
+        memset(_cmux_lines, 0, sizeof(_cmux_lines));
+        return;
+    } else if (strcmp(name, "+CPIN") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CPIN: READY");
+        }
+    } else if (strcmp(name, "+CRESET") == 0) {
+        _output_ok(time);
+        // modem starts in AT command mode
+        _cmux_stop();
+        // reset modem state
+        for (int i = 0; i < LINK_NUM; i++) {
+            _link_close(i);
+        }
+        _net_opened = false;
+        _net_state_time = 0;
+        _echo = true;
+        _cfun = 1;
+        _cgreg_mode = 0;
+        _cnsmod_mode = 0;
+        _ciprxget_mode = 0;
+        _cipmode = 0;
+        _gps_active = false;
+        _ftp_started = false;
+        _ftp_logged_in = false;
+        _output_delayed_urc(time + EMULATOR_RESET_DELAY, "START");
+        _output_delayed_urc(time + EMULATOR_RESET_DELAY * 2, "PB DONE");
+        return;
+    }
+    _output_ok(time);
+}
+
+void SIM5320ModemEmulator::_cmd_info(const char *name, const char *args, uint64_t time)
+{
+    if (strcmp(name, "+CGMI") == 0) {
+        _output_line(time, "SIMCOM INCORPORATED");
+    } else if (strcmp(name, "+CGMM") == 0) {
+        _output_line(time, "SIMCOM_SIM5320E");
+    } else if (strcmp(name, "+CGMR") == 0) {
+        _output_line(time, "+CGMR: 1575B13SIM5320E");
+    } else if (strcmp(name, "+CGSN") == 0) {
+        _output_line(time, "351234567890123");
+    } else if (strcmp(name, "+CIMI") == 0) {
+        _output_line(time, "250011234567890");
+    } else if (strcmp(name, "+CICCID") == 0) {
+        _output_line(time, "+ICCID: 8970101234567890123");
+    } else if (strcmp(name, "+CNUM") == 0) {
+        _output_line(time, "+CNUM: \"\",\"+70000000000\",145");
+    }
+    _output_ok(time);
+}
+
+void SIM5320ModemEmulator::_cmd_network(const char *name, const char *args, uint64_t time)
+{
+    char argv[MAX_ARG_NUM][MAX_ARG_LEN];
+    uint64_t ok_time = _input_time + _default_latency;
+
+    if (strcmp(name, "+CREG") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CREG: 0,1");
+        }
+    } else if (strcmp(name, "+CGREG") == 0) {
+        if (args[0] == '?') {
+            if (_cgreg_mode == 2 && (_cgreg_status == 1 || _cgreg_status == 5)) {
+                _output_line(time, "+CGREG: 2,%d,\"00C3\",\"0000A13F\"", _cgreg_status);
+            } else {
+                _output_line(time, "+CGREG: %d,%d", _cgreg_mode, _cgreg_status);
+            }
+        } else if (args[0] == '=' && parse_args(args + 1, argv, MAX_ARG_NUM) >= 1) {
+            _cgreg_mode = atoi(argv[0]);
+            _cgreg_dlci = _output_dlci;
+        }
+    } else if (strcmp(name, "+COPS") == 0) {
+        if (strcmp(args, "?") == 0) {
+            _output_line(time, "+COPS: 0,0,\"EMULATOR\",2");
+        } else if (strcmp(args, "=?") == 0) {
+            _output_line(time, "+COPS: (2,\"EMULATOR\",\"EMU\",\"25001\",2),,(0-4),(0-2)");
+        }
+    } else if (strcmp(name, "+CGATT") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CGATT: 1");
+        }
+    } else if (strcmp(name, "+CNSMOD") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CNSMOD: %d,%d", _cnsmod_mode, _cnsmod_status);
+        } else if (args[0] == '=' && parse_args(args + 1, argv, MAX_ARG_NUM) >= 1) {
+            _cnsmod_mode = atoi(argv[0]);
+            _cnsmod_dlci = _output_dlci;
+        }
+    } else if (strcmp(name, "+CSQ") == 0) {
+        _output_line(time, "+CSQ: 20,99");
+    } else if (strcmp(name, "+NETOPEN") == 0) {
+        uint64_t now = ok_time;
+        if (args[0] == '?') {
+            _output_line(ok_time, "+NETOPEN: %d,0", _is_net_opened(now) ? 1 : 0);
+        } else if (_is_net_opened(now) || _net_opened) {
+            _output_line(ok_time, "+IP ERROR: Network is already opened");
+            _output_error(ok_time);
+            return;
+        } else {
+            _output_ok(ok_time);
+            _net_opened = true;
+            _net_state_time = time;
+            _net_dlci = _output_dlci;
+            _output_delayed_urc(time, "+NETOPEN: 0");
+            return;
+        }
+    } else if (strcmp(name, "+NETCLOSE") == 0) {
+        uint64_t now = ok_time;
+        if (!_is_net_opened(now) || !_net_opened) {
+            _output_line(ok_time, "+NETCLOSE: 2");
+            _output_error(ok_time);
+            return;
+        }
+        _output_ok(ok_time);
+        for (int i = 0; i < LINK_NUM; i++) {
+            _link_close(i);
+        }
+        _net_opened = false;
+        _net_state_time = time;
+        _output_delayed_urc(time, "+NETCLOSE: 0");
+        return;
+    }
+    _output_ok(time);
+}
+
+void SIM5320ModemEmulator::_cmd_socket(const char *name, const char *args, uint64_t time)
+{
+    char argv[MAX_ARG_NUM][MAX_ARG_LEN];
+    uint64_t ok_time = _input_time + _default_latency;
+    int argc = args[0] == '=' ? parse_args(args + 1, argv, MAX_ARG_NUM) : 0;
+    int link_id = argc >= 1 ? atoi(argv[0]) : -1;
+    link_t *link = link_id >= 0 && link_id < LINK_NUM ? &_links[link_id] : NULL;
+
+    if (strcmp(name, "+CIPMODE") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CIPMODE: %d", _cipmode);
+        } else if (argc >= 1) {
+            _cipmode = atoi(argv[0]);
+        }
+    } else if (strcmp(name, "+CIPRXGET") == 0) {
+        int mode = argc >= 1 ? atoi(argv[0]) : -1;
+        link_id = argc >= 2 ? atoi(argv[1]) : -1;
+        link = link_id >= 0 && link_id < LINK_NUM ? &_links[link_id] : NULL;
+        if (mode == 0 || mode == 1) {
+            _ciprxget_mode = mode;
+        } else if (mode == 2 || mode == 3) {
+            size_t len = argc >= 3 ? atoi(argv[2]) : EMULATOR_MAX_SEND_SIZE;
+            if (len > EMULATOR_MAX_SEND_SIZE) {
+                len = EMULATOR_MAX_SEND_SIZE;
+            }
+            if (!link || link->rx_len == 0) {
+                _output_line(time, "+IP ERROR: No data");
+                _output_error(time);
+                return;
+            }
+            uint8_t data[EMULATOR_MAX_SEND_SIZE];
+            len = _link_pop(link_id, data, len);
+            _output_line(time, "+CIPRXGET: 2,%d,%d,%d", link_id, (int)len, (int)link->rx_len);
+            _output_raw(time, data, len);
+            _stats.link_rx_bytes += len;
+        } else if (mode == 4) {
+            if (!link) {
+                _output_error(time);
+                return;
+            }
+            _output_line(time, "+CIPRXGET: 4,%d,%d", link_id, (int)link->rx_len);
+        } else {
+            _output_error(time);
+            return;
+        }
+    } else if (strcmp(name, "+CIPOPEN") == 0) {
+        if (args[0] == '?') {
+            for (int i = 0; i < LINK_NUM; i++) {
+                if (_links[i].opened) {
+                    _output_line(time, "+CIPOPEN: %d,\"%s\",\"%s\",%d,-1", i, _links[i].tcp ? "TCP" : "UDP", _links[i].remote_ip, _links[i].remote_port);
+                } else {
+                    _output_line(time, "+CIPOPEN: %d", i);
+                }
+            }
+        } else {
+            if (!link || argc < 2 || !_is_net_opened(ok_time)) {
+                _output_error(ok_time);
+                return;
+            }
+            if (link->opened) {
+                _output_line(ok_time, "+CIPOPEN: %d,4", link_id);
+                _output_error(ok_time);
+                return;
+            }
+            _link_close(link_id);
+            link->opened = true;
+            link->tcp = strcmp(argv[1], "TCP") == 0;
+            link->peer_mode = _peer_mode;
+            strncpy(link->remote_ip, argc >= 3 ? argv[2] : "", NSAPI_IP_SIZE - 1);
+            link->remote_port = argc >= 4 ? atoi(argv[3]) : 0;
+            link->dlci = _output_dlci;
+            if (_cipmode == 1) {
+                // transparent mode supports only one TCP link
+                if (link_id != 0 || !link->tcp) {
+                    _link_close(link_id);
+                    _output_error(ok_time);
+                    return;
+                }
+                _transparent_link = link_id;
+                _output_line(time, "CONNECT %d", EMULATOR_CONNECT_BAUDRATE);
+                _input_state = INPUT_TRANSPARENT;
+                _input_data_len = 0;
+                _transparent_data_time = _get_time();
+            } else if (link->tcp) {
+                _output_ok(ok_time);
+                _output_delayed_urc(time, "+CIPOPEN: %d,0", link_id);
+            } else {
+                // note: the driver reads only "+CIPOPEN:" line for UDP sockets
+                _output_line(time, "+CIPOPEN: %d,0", link_id);
+            }
+            return;
+        }
+    } else if (strcmp(name, "+CIPSEND") == 0) {
+        int len = argc >= 2 ? atoi(argv[1]) : -1;
+        if (!link || !link->opened || len <= 0 || len > EMULATOR_MAX_SEND_SIZE) {
+            _output_error(ok_time);
+            return;
+        }
+        if (!link->tcp && argc >= 4) {
+            strncpy(link->remote_ip, argv[2], NSAPI_IP_SIZE - 1);
+            link->remote_port = atoi(argv[3]);
+        }
+        _output_raw(ok_time, "\r\n>", 3);
+        _input_state = INPUT_DATA;
+        _input_data_len = 0;
+        _input_data_expected = len;
+        _input_data_link = link_id;
+        strcpy(_input_data_target, "CIPSEND");
+        return;
+    } else if (strcmp(name, "+CIPCLOSE") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CIPCLOSE: %d,%d,%d,%d,%d,%d,%d,%d,%d,%d",
+                _links[0].opened, _links[1].opened, _links[2].opened, _links[3].opened, _links[4].opened,
+                _links[5].opened, _links[6].opened, _links[7].opened, _links[8].opened, _links[9].opened);
+        } else {
+            if (!link || !link->opened) {
+                _output_line(ok_time, "+CIPCLOSE: %d,4", link_id);
+                _output_error(ok_time);
+                return;
+            }
+            _link_close(link_id);
+            _output_ok(ok_time);
+            _output_delayed_urc(time, "+CIPCLOSE: %d,0", link_id);
+            return;
+        }
+    }
+    _output_ok(time);
+}
+
+void SIM5320ModemEmulator::_cmd_dns(const char *name, const char *args, uint64_t time)
+{
+    char argv[MAX_ARG_NUM][MAX_ARG_LEN];
+    int argc = args[0] == '=' ? parse_args(args + 1, argv, MAX_ARG_NUM) : 0;
+    if (argc < 1) {
+        _output_error(_input_time + _default_latency);
+        return;
+    }
+    for (int i = 0; i < _dns_entry_num; i++) {
+        if (strcmp(_dns_entries[i].host, argv[0]) == 0) {
+            _output_delayed_urc(time, "+CDNSGIP: 1,\"%s\",\"%s\"", _dns_entries[i].host, _dns_entries[i].ip_address);
+            _output_delayed_urc(time, "OK");
+            return;
+        }
+    }
+    _output_delayed_urc(time, "+CDNSGIP: 0,10");
+    _output_delayed_urc(time, "ERROR");
+}
+
+void SIM5320ModemEmulator::_cmd_gps(const char *name, const char *args, uint64_t time)
+{
+    char argv[MAX_ARG_NUM][MAX_ARG_LEN];
+    int argc = args[0] == '=' ? parse_args(args + 1, argv, MAX_ARG_NUM) : 0;
+
+    if (strcmp(name, "+CGPS") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CGPS: %d,%d", _gps_active ? 1 : 0, _gps_mode);
+        } else if (argc >= 1) {
+            _gps_active = atoi(argv[0]) != 0;
+            if (argc >= 2) {
+                _gps_mode = atoi(argv[1]);
+            }
+        }
+    } else if (strcmp(name, "+CGPSINFO") == 0) {
+        if (_gps_active && _gps_info[0] != '\0') {
+            _output_line(time, "+CGPSINFO: %s", _gps_info);
+        } else {
+            _output_line(time, "+CGPSINFO: ,,,,,,,,");
+        }
+        _output_line(time, "AmpI/AmpQ: 500,500");
+    } else if (strcmp(name, "+CGPSHOR") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CGPSHOR: %d", _gps_accuracy);
+        } else if (argc >= 1) {
+            _gps_accuracy = atoi(argv[0]);
+        }
+    }
+    _output_ok(time);
+}
+
+void SIM5320ModemEmulator::_cmd_sms(const char *name, const char *args, uint64_t time)
+{
+    char argv[MAX_ARG_NUM][MAX_ARG_LEN];
+    int argc = args[0] == '=' ? parse_args(args + 1, argv, MAX_ARG_NUM) : 0;
+
+    if (strcmp(name, "+CMGF") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CMGF: %d", _cmgf);
+        } else if (argc >= 1) {
+            _cmgf = atoi(argv[0]);
+        }
+    } else if (strcmp(name, "+CMGS") == 0) {
+        if (argc < 1) {
+            _output_error(time);
+            return;
+        }
+        _output_raw(_input_time + _default_latency, "\r\n> ", 4);
+        _input_state = INPUT_SMS_TEXT;
+        _input_data_len = 0;
+        return;
+    } else if (strcmp(name, "+CMGL") == 0) {
+        for (int i = 0; i < MAX_SMS_NUM; i++) {
+            if (_sms[i].used) {
+                _output_line(time, "+CMGL: %d,\"%s\",\"%s\",\"\",\"19/05/01,12:00:%02d+12\"", i, _sms[i].read ? "REC READ" : "REC UNREAD", _sms[i].phone_number, i);
+                _output_raw(time, _sms[i].message, strlen(_sms[i].message));
+                _sms[i].read = true;
+            }
+        }
+    } else if (strcmp(name, "+CMGD") == 0) {
+        int index = argc >= 1 ? atoi(argv[0]) : -1;
+        if (index >= 0 && index < MAX_SMS_NUM) {
+            _sms[index].used = false;
+        }
+    }
+    _output_ok(time);
+}
+
+void SIM5320ModemEmulator::_cmd_ftp(const char *name, const char *args, uint64_t time)
+{
+    char argv[MAX_ARG_NUM][MAX_ARG_LEN];
+    char path[sizeof(_ftp_files[0].path)];
+    uint64_t ok_time = _input_time + _default_latency;
+    int argc = args[0] == '=' ? parse_args(args + 1, argv, MAX_ARG_NUM) : 0;
+    int file_i;
+
+    if (strcmp(name, "+CFTPSSTART") == 0) {
+        if (_ftp_started) {
+            _output_error(ok_time);
+            return;
+        }
+        _ftp_started = true;
+        _output_ok(ok_time);
+        _output_delayed_urc(time, "+CFTPSSTART: 0");
+        return;
+    } else if (strcmp(name, "+CFTPSSTOP") == 0) {
+        _ftp_started = false;
+        _ftp_logged_in = false;
+        _output_ok(ok_time);
+        _output_delayed_urc(time, "+CFTPSSTOP: 0");
+        return;
+    } else if (strcmp(name, "+CFTPSLOGIN") == 0) {
+        if (!_ftp_started || !_is_net_opened(ok_time)) {
+            _output_error(ok_time);
+            return;
+        }
+        _ftp_logged_in = true;
+        strcpy(_ftp_cwd, "/");
+        _output_ok(ok_time);
+        _output_delayed_urc(time, "+CFTPSLOGIN: 0");
+        return;
+    } else if (strcmp(name, "+CFTPSLOGOUT") == 0) {
+        _ftp_logged_in = false;
+        _output_ok(ok_time);
+        _output_delayed_urc(time, "+CFTPSLOGOUT: 0");
+        return;
+    } else if (strcmp(name, "+CFTPSTO") == 0 || strcmp(name, "+CFTPSTYPE") == 0) {
+        // nothing to do
+    } else if (!_ftp_logged_in) {
+        _output_error(ok_time);
+        return;
+    } else if (strcmp(name, "+CFTPSPWD") == 0) {
+        _output_line(time, "+CFTPSPWD: \"%s\"", _ftp_cwd);
+    } else if (strcmp(name, "+CFTPSCWD") == 0) {
+        if (argc < 1) {
+            _output_error(time);
+            return;
+        }
+        _ftp_resolve_path(argv[0], path, sizeof(path));
+        file_i = _ftp_find_file(path);
+        if (strcmp(path, "/") != 0 && (file_i < 0 || !_ftp_files[file_i].is_dir)) {
+            _output_error(time);
+            return;
+        }
+        strcpy(_ftp_cwd, path);
+    } else if (strcmp(name, "+CFTPSSIZE") == 0) {
+        _ftp_resolve_path(argc >= 1 ? argv[0] : "", path, sizeof(path));
+        file_i = _ftp_find_file(path);
+        if (file_i < 0 || _ftp_files[file_i].is_dir) {
+            _output_error(time);
+            return;
+        }
+        _output_line(time, "+CFTPSSIZE: 0,%d", (int)_ftp_files[file_i].size);
+    } else if (strcmp(name, "+CFTPSMKD") == 0) {
+        _ftp_resolve_path(argc >= 1 ? argv[0] : "", path, sizeof(path));
+        if (_ftp_find_file(path) >= 0 || _ftp_add_file(path, 0, true) < 0) {
+            _output_error(time);
+            return;
+        }
+    } else if (strcmp(name, "+CFTPSRMD") == 0 || strcmp(name, "+CFTPSDELE") == 0) {
+        bool is_dir = strcmp(name, "+CFTPSRMD") == 0;
+        _ftp_resolve_path(argc >= 1 ? argv[0] : "", path, sizeof(path));
+        file_i = _ftp_find_file(path);
+        if (file_i < 0 || _ftp_files[file_i].is_dir != is_dir) {
+            _output_error(time);
+            return;
+        }
+        _ftp_files[file_i].used = false;
+    } else if (strcmp(name, "+CFTPSGET") == 0 || strcmp(name, "+CFTPSLIST") == 0) {
+        bool is_list = strcmp(name, "+CFTPSLIST") == 0;
+        _ftp_resolve_path(argc >= 1 ? argv[0] : "", path, sizeof(path));
+        file_i = _ftp_find_file(path);
+        if (is_list) {
+            if (strcmp(path, "/") != 0 && (file_i < 0 || !_ftp_files[file_i].is_dir)) {
+                _output_error(time);
+                return;
+            }
+            // prepare directory listing
+            size_t path_len = strcmp(path, "/") == 0 ? 0 : strlen(path);
+            size_t list_len = 0;
+            for (int i = 0; i < MAX_FTP_FILE_NUM; i++) {
+                const ftp_file_t *file = &_ftp_files[i];
+                const char *file_name = file->path + path_len + 1;
+                if (!file->used || strncmp(file->path, path, path_len) != 0 || file->path[path_len] != '/' || strchr(file_name, '/')) {
+                    continue;
+                }
+                int len = snprintf(_ftp_list_buf + list_len, sizeof(_ftp_list_buf) - list_len, "%s 1 ftp ftp %8d Jan 01 00:00 %s\r\n",
+                    file->is_dir ? "drwxr-xr-x" : "-rw-r--r--", (int)file->size, file_name);
+                if (len < 0 || list_len + len >= sizeof(_ftp_list_buf)) {
+                    break;
+                }
+                list_len += len;
+            }
+            _ftp_cache_size = list_len;
+        } else {
+            if (file_i < 0 || _ftp_files[file_i].is_dir) {
+                _output_error(time);
+                return;
+            }
+            _ftp_cache_size = _ftp_files[file_i].size;
+        }
+        _ftp_cache_active = true;
+        _ftp_cache_list = is_list;
+        _ftp_cache_pos = 0;
+        _ftp_cache_time = time;
+    } else if (strcmp(name, "+CFTPSCACHERD") == 0) {
+        if (_ftp_cache_active) {
+            const char *prefix = _ftp_cache_list ? "+CFTPSLIST" : "+CFTPSGET";
+            size_t received = _link_bandwidth > 0 && ok_time > _ftp_cache_time ? (ok_time - _ftp_cache_time) * _link_bandwidth / 1000 : _ftp_cache_size;
+            if (ok_time < _ftp_cache_time) {
+                received = 0;
+            }
+            received = received < _ftp_cache_size ? received : _ftp_cache_size;
+            size_t len = received - _ftp_cache_pos;
+            len = len < EMULATOR_MAX_CACHE_READ_SIZE ? len : EMULATOR_MAX_CACHE_READ_SIZE;
+            if (len > 0) {
+                uint8_t data[EMULATOR_MAX_CACHE_READ_SIZE];
+                for (size_t i = 0; i < len; i++) {
+                    data[i] = _ftp_cache_list ? _ftp_list_buf[_ftp_cache_pos + i] : get_stream_byte(_ftp_cache_pos + i);
+                }
+                _ftp_cache_pos += len;
+                _output_line(time, "%s: DATA,%d", prefix, (int)len);
+                _output_raw(time, data, len);
+            } else if (_ftp_cache_pos >= _ftp_cache_size) {
+                _ftp_cache_active = false;
+                _output_line(time, "%s: 0", prefix);
+            }
+        }
+    } else if (strcmp(name, "+CFTPSPUT") == 0) {
+        if (args[0] == '?') {
+            _output_line(time, "+CFTPSPUT: %d", (int)_ftp_put_pending);
+        } else if (argc == 0) {
+            // finish transmission
+            _output_ok(ok_time);
+            _output_delayed_urc(time + _get_link_time(_ftp_put_pending), "+CFTPSPUT: 0");
+            _ftp_put_file = -1;
+            return;
+        } else {
+            int len = atoi(argv[argc - 1]);
+            if (argc >= 2) {
+                _ftp_resolve_path(argv[0], path, sizeof(path));
+                file_i = _ftp_find_file(path);
+                if (file_i < 0) {
+                    file_i = _ftp_add_file(path, 0, false);
+                } else {
+                    _ftp_files[file_i].size = 0;
+                }
+                _ftp_put_file = file_i;
+            }
+            if (len <= 0 || len > (int)INPUT_DATA_SIZE) {
+                _output_error(ok_time);
+                return;
+            }
+            _output_raw(ok_time, "\r\n>", 3);
+            _input_state = INPUT_DATA;
+            _input_data_len = 0;
+            _input_data_expected = len;
+            strcpy(_input_data_target, "CFTPSPUT");
+            return;
+        }
+    }
+    _output_ok(time);
+}
+
+/**
+ * Socket helpers
+ */
+
+void SIM5320ModemEmulator::_link_close(int link_id)
+{
+    link_t *link = &_links[link_id];
+    if (link_id == _transparent_link) {
+        _transparent_link = -1;
+        if (_input_state == INPUT_TRANSPARENT) {
+            _input_state = INPUT_COMMAND;
+            _input_data_len = 0;
+        }
+    }
+    link->opened = false;
+    link->rx_start = 0;
+    link->rx_len = 0;
+    link->stream_left = 0;
+    link->stream_offset = 0;
+    link->tx_time = 0;
+}
+
+size_t SIM5320ModemEmulator::_link_free_space(int link_id) const
+{
+    return LINK_BUFFER_SIZE - _links[link_id].rx_len;
+}
+
+size_t SIM5320ModemEmulator::_link_push(int link_id, const uint8_t *data, size_t len)
+{
+    link_t *link = &_links[link_id];
+    size_t free_space = _link_free_space(link_id);
+    if (len > free_space) {
+        len = free_space;
+    }
+    for (size_t i = 0; i < len; i++) {
+        link->rx_buf[(link->rx_start + link->rx_len + i) % LINK_BUFFER_SIZE] = data[i];
+    }
+    link->rx_len += len;
+    return len;
+}
+
+size_t SIM5320ModemEmulator::_link_pop(int link_id, uint8_t *data, size_t len)
+{
+    link_t *link = &_links[link_id];
+    if (len > link->rx_len) {
+        len = link->rx_len;
+    }
+    for (size_t i = 0; i < len; i++) {
+        data[i] = link->rx_buf[(link->rx_start + i) % LINK_BUFFER_SIZE];
+    }
+    link->rx_start = (link->rx_start + len) % LINK_BUFFER_SIZE;
+    link->rx_len -= len;
+    return len;
+}
+
+void SIM5320ModemEmulator::_link_deliver(int link_id, size_t len, uint64_t time)
+{
+    if (len == 0) {
+        return;
+    }
+    _output_dlci = _links[link_id].dlci;
+    if (link_id == _transparent_link) {
+        // transparent mode: raw data is sent in data mode, otherwise it's kept in buffer until ATO command
+        if (_input_state != INPUT_TRANSPARENT) {
+            return;
+        }
+        link_t *link = &_links[link_id];
+        len = len < link->rx_len ? len : link->rx_len;
+        size_t first_part = LINK_BUFFER_SIZE - link->rx_start;
+        first_part = first_part < len ? first_part : len;
+        _output_raw(time, link->rx_buf + link->rx_start, first_part);
+        _output_raw(time, link->rx_buf, len - first_part);
+        link->rx_start = (link->rx_start + len) % LINK_BUFFER_SIZE;
+        link->rx_len -= len;
+        _stats.link_rx_bytes += len;
+    } else if (_ciprxget_mode == 0) {
+        // push mode: data follows the URC
+        link_t *link = &_links[link_id];
+        len = len < link->rx_len ? len : link->rx_len;
+        _output_line(time, "+RECEIVE,%d,%d", link_id, (int)len);
+        // copy data directly from ring buffer to avoid big stack buffers
+        size_t first_part = LINK_BUFFER_SIZE - link->rx_start;
+        first_part = first_part < len ? first_part : len;
+        _output_raw(time, link->rx_buf + link->rx_start, first_part);
+        _output_raw(time, link->rx_buf, len - first_part);
+        link->rx_start = (link->rx_start + len) % LINK_BUFFER_SIZE;
+        link->rx_len -= len;
+        _stats.link_rx_bytes += len;
+    } else if (_receive_urc_drop_count > 0) {
+        // manual mode: emulate lost notification
+        _receive_urc_drop_count--;
+    } else {
+        // manual mode: only notify host
+        _output_delayed_urc(time, "+RECEIVE,%d,%d", link_id, (int)len);
+    }
+}
+
+/**
+ * FTP helpers
+ */
+
+int SIM5320ModemEmulator::_ftp_find_file(const char *path)
+{
+    for (int i = 0; i < MAX_FTP_FILE_NUM; i++) {
+        if (_ftp_files[i].used && strcmp(_ftp_files[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int SIM5320ModemEmulator::_ftp_add_file(const char *path, size_t size, bool is_dir)
+{
+    for (int i = 0; i < MAX_FTP_FILE_NUM; i++) {
+        if (!_ftp_files[i].used) {
+            _ftp_files[i].used = true;
+            _ftp_files[i].is_dir = is_dir;
+            _ftp_files[i].size = size;
+            strncpy(_ftp_files[i].path, path, sizeof(_ftp_files[i].path) - 1);
+            _ftp_files[i].path[sizeof(_ftp_files[i].path) - 1] = '\0';
+            return i;
+        }
+    }
+    return -1;
+}
+
+void SIM5320ModemEmulator::_ftp_resolve_path(const char *path, char *full_path, size_t full_path_size)
+{
+    if (path[0] == '/') {
+        snprintf(full_path, full_path_size, "%s", path);
+    } else if (strcmp(_ftp_cwd, "/") == 0) {
+        snprintf(full_path, full_path_size, "/%s", path);
+    } else {
+        snprintf(full_path, full_path_size, "%s/%s", _ftp_cwd, path);
+    }
+    // remove trailing slash
+    size_t len = strlen(full_path);
+    if (len > 1 && full_path[len - 1] == '/') {
+        full_path[len - 1] = '\0';
+    }
+}
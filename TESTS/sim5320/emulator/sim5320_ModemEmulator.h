@@ -0,0 +1,540 @@
+#ifndef SIM5320_MODEMEMULATOR_H
+#define SIM5320_MODEMEMULATOR_H
+
+#include "mbed.h"
+
+namespace sim5320 {
+
+/**
+ * Scripted emulator of the SIM5320 AT command interface.
+ *
+ * The emulator implements @c FileHandle interface, so it can be used instead of UART:
+ *
+ * @code
+ * SIM5320ModemEmulator emulator;
+ * emulator.set_uart_baudrate(115200);
+ * emulator.set_link_bandwidth(48000);
+ * SIM5320 modem(&emulator);
+ * @endcode
+ *
+ * It supports subset of the SIM5320 AT commands that is used by the driver (base commands, TCP/UDP sockets,
+ * DNS, FTP, GPS and SMS), and simulates command latency, UART transfer rate and network link bandwidth.
+ * Remote peers of the sockets are simulated by an internal data generator, echo mode or explicit data injection.
+ *
+ * GSM 07.10 multiplexer mode (AT+CMUX=0) is supported. Responses are sent to the channel of the command,
+ * socket URCs are sent to the channel that has opened network or socket, other URCs are sent to the channel 1.
+ *
+ * The emulator doesn't use any hardware, so it allows to measure driver overhead and throughput without board
+ * and modem.
+ */
+class SIM5320ModemEmulator : public FileHandle, private NonCopyable<SIM5320ModemEmulator> {
+public:
+    SIM5320ModemEmulator();
+    virtual ~SIM5320ModemEmulator();
+
+    static const int LINK_NUM = 10;
+    static const size_t LINK_BUFFER_SIZE = 2048;
+    static const size_t OUTPUT_BUFFER_SIZE = 8192;
+    static const size_t INPUT_LINE_SIZE = 256;
+    static const size_t INPUT_DATA_SIZE = 1536;
+    static const size_t MAX_PACKET_SIZE = 1400;
+    // number of the multiplexer channels (DLCI 1..CMUX_CHANNEL_NUM)
+    static const int CMUX_CHANNEL_NUM = 3;
+
+    /**
+     * GSM 07.10 basic option frame codec.
+     *
+     * It doesn't share code with SIM5320CMUX (the check sequence is calculated with the table of the
+     * 3GPP TS 27.010 annex B), so the same framing error on both sides isn't hidden by the tests.
+     */
+    class CMUXCodec {
+    public:
+        CMUXCodec();
+
+        // maximal information field size
+        static const size_t MAX_DATA_SIZE = 127;
+        // frame types (control field without P/F bit)
+        static const uint8_t SABM = 0x2F;
+        static const uint8_t UA = 0x63;
+        static const uint8_t DM = 0x0F;
+        static const uint8_t DISC = 0x43;
+        static const uint8_t UIH = 0xEF;
+        static const uint8_t PF = 0x10;
+
+        /**
+         * Encode frame.
+         *
+         * @param buf output buffer. It should have size at least len + 6 bytes
+         * @param dlci data link connection identifier
+         * @param cr command/response bit
+         * @param control control field
+         * @param data information field
+         * @param len information field length (0..MAX_DATA_SIZE)
+         * @return frame length
+         */
+        static size_t encode(uint8_t *buf, int dlci, bool cr, uint8_t control, const uint8_t *data, size_t len);
+
+        /**
+         * Process next byte of the stream.
+         *
+         * @param sym
+         * @return @c true if a valid frame has been received
+         */
+        bool decode(uint8_t sym);
+
+        /**
+         * Reset decoder state.
+         */
+        void reset();
+
+        // fields of the last received frame
+        int dlci;
+        bool cr;
+        uint8_t control;
+        uint8_t data[MAX_DATA_SIZE];
+        size_t len;
+
+    private:
+        // received frame without flags
+        uint8_t _frame[MAX_DATA_SIZE + 5];
+        size_t _frame_len;
+        bool _synchronized;
+    };
+
+    // FileHandle
+    virtual ssize_t read(void *buffer, size_t size);
+    virtual ssize_t write(const void *buffer, size_t size);
+    virtual off_t seek(off_t offset, int whence = SEEK_SET);
+    virtual int close();
+    virtual int set_blocking(bool blocking);
+    virtual bool is_blocking() const;
+    virtual short poll(short events) const;
+    virtual void sigio(Callback<void()> func);
+
+    /**
+     * Set default latency of the command processing.
+     *
+     * @param latency_ms
+     */
+    void set_default_latency(int latency_ms);
+
+    /**
+     * Set latency of the commands that start with @p cmd_prefix (for example "AT+CIPOPEN").
+     *
+     * For commands with an asynchronous result (AT+CIPOPEN, AT+NETOPEN, AT+CDNSGIP, etc.) the latency
+     * is applied to the result URC.
+     *
+     * @param cmd_prefix command prefix
+     * @param latency_ms
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t set_command_latency(const char *cmd_prefix, int latency_ms);
+
+    /**
+     * Set UART transfer rate in bauds. If it's 0, then UART transfer time is ignored.
+     *
+     * @param baudrate
+     */
+    void set_uart_baudrate(int baudrate);
+
+    /**
+     * Get current UART transfer rate in bauds.
+     *
+     * @return
+     */
+    int get_uart_baudrate() const;
+
+    /**
+     * Set bandwidth of the network link in bytes per second. If it's 0, then link transfer time is ignored.
+     *
+     * @param bytes_per_second
+     */
+    void set_link_bandwidth(int bytes_per_second);
+
+    /**
+     * Remote peer behavior.
+     */
+    enum PeerMode {
+        /** discard sent data */
+        PEER_SINK = 0,
+        /** send back all received data */
+        PEER_ECHO = 1
+    };
+
+    /**
+     * Set behavior of the remote peers of the new sockets.
+     *
+     * @param mode
+     */
+    void set_peer_mode(PeerMode mode);
+
+    /**
+     * Start stream of the @p size bytes from remote peer of the link @p link_id.
+     *
+     * Stream data is a sequence of bytes, where n-th byte is equal to @c n @c & @c 0xFF.
+     * The data arrives with configured link bandwidth.
+     *
+     * @param link_id
+     * @param size
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t start_peer_stream(int link_id, size_t size);
+
+    /**
+     * Put data from remote peer to the link @p link_id immediately.
+     *
+     * @param link_id
+     * @param data
+     * @param size
+     * @return number of the accepted bytes or negative error code
+     */
+    nsapi_size_or_error_t inject_socket_data(int link_id, const void *data, size_t size);
+
+    /**
+     * Close link by remote peer (+IPCLOSE URC).
+     *
+     * @param link_id
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t close_by_peer(int link_id);
+
+    /**
+     * Emulate network loss ("+CIPEVENT: NETWORK CLOSED UNEXPECTEDLY" URC).
+     *
+     * All links are closed and network should be reopened with AT+NETOPEN command.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t drop_network();
+
+    /**
+     * Change network registration state.
+     *
+     * If registration URCs are enabled (AT+CGREG=1/2, AT+CNSMOD=1), then "+CGREG" and "+CNSMOD" URCs are sent.
+     *
+     * @param status registration status code of the AT+CGREG command
+     * @param system_mode network system mode code of the AT+CNSMOD command
+     */
+    void set_network_registration(int status, int system_mode);
+
+    /**
+     * Skip next @p count "+RECEIVE" URCs of the manual receive mode (AT+CIPRXGET=1).
+     *
+     * It emulates lost URCs, but data is still available for AT+CIPRXGET=2 command.
+     *
+     * @param count
+     */
+    void drop_receive_urcs(int count);
+
+    /**
+     * Send arbitrary URC (for example "+CIPEVENT: NETWORK CLOSED").
+     *
+     * @param urc
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t inject_urc(const char *urc);
+
+    /**
+     * Add host to emulator DNS table.
+     *
+     * Unknown hosts are resolved to a failure.
+     *
+     * @param host
+     * @param ip_address
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t add_dns_entry(const char *host, const char *ip_address);
+
+    /**
+     * Set GPS coordinates that will be returned by AT+CGPSINFO.
+     *
+     * @param cgpsinfo value of the AT+CGPSINFO response in the modem format (for example "3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0")
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t set_gps_info(const char *cgpsinfo);
+
+    /**
+     * Put incoming SMS to the modem storage.
+     *
+     * @param phone_number
+     * @param message
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t inject_sms(const char *phone_number, const char *message);
+
+    /**
+     * Add file to the emulated FTP server.
+     *
+     * File content is generated like stream data (see @c start_peer_stream).
+     *
+     * @param path
+     * @param size file size
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t add_ftp_file(const char *path, size_t size);
+
+    /**
+     * Emulator counters.
+     */
+    struct stats_t {
+        // number of the processed commands
+        uint32_t commands;
+        // number of the processed command lines (several commands can be joined with ';')
+        uint32_t command_lines;
+        // bytes that have been written by host (commands and data)
+        uint32_t uart_rx_bytes;
+        // bytes that have been read by host (responses, URCs and data)
+        uint32_t uart_tx_bytes;
+        // socket payload that has been sent to remote peers
+        uint32_t link_tx_bytes;
+        // socket payload that has been delivered to host
+        uint32_t link_rx_bytes;
+        // bytes that has been dropped, because output buffer was full
+        uint32_t overrun_bytes;
+    };
+
+    /**
+     * Get emulator counters.
+     *
+     * @param stats
+     */
+    void get_stats(stats_t &stats);
+
+    /**
+     * Reset emulator counters.
+     */
+    void reset_stats();
+
+private:
+    mutable PlatformMutex _mutex;
+    Callback<void()> _sigio_cb;
+    Timeout _wakeup_timeout;
+    uint64_t _wakeup_time;
+    // total amount of the bytes that has been read by host and that host has been notified about
+    uint32_t _output_read_total;
+    uint32_t _output_notified_total;
+    bool _blocking;
+
+    // timing model
+    int _default_latency;
+    struct command_latency_t {
+        char prefix[16];
+        int latency;
+    };
+    static const int MAX_COMMAND_LATENCY_NUM = 16;
+    command_latency_t _command_latency[MAX_COMMAND_LATENCY_NUM];
+    int _command_latency_num;
+    int _uart_baudrate;
+    int _link_bandwidth;
+
+    // output (modem -> host) stream
+    struct output_segment_t {
+        size_t end;
+        uint64_t start_time;
+        uint64_t end_time;
+    };
+    static const int MAX_OUTPUT_SEGMENT_NUM = 64;
+    uint8_t _output_buf[OUTPUT_BUFFER_SIZE];
+    size_t _output_start;
+    size_t _output_end;
+    output_segment_t _output_segments[MAX_OUTPUT_SEGMENT_NUM];
+    int _output_segment_num;
+
+    // delayed URCs
+    struct delayed_urc_t {
+        uint64_t time;
+        int dlci;
+        char text[80];
+    };
+    static const int MAX_DELAYED_URC_NUM = 32;
+    delayed_urc_t _delayed_urcs[MAX_DELAYED_URC_NUM];
+    int _delayed_urc_num;
+
+    // input (host -> modem) stream
+    enum InputState {
+        INPUT_COMMAND = 0,
+        INPUT_DATA,
+        INPUT_SMS_TEXT,
+        // data mode of the transparent link
+        INPUT_TRANSPARENT
+    };
+    InputState _input_state;
+    char _input_line[INPUT_LINE_SIZE];
+    size_t _input_line_len;
+    uint8_t _input_data[INPUT_DATA_SIZE];
+    size_t _input_data_len;
+    size_t _input_data_expected;
+    char _input_data_target[64];
+    int _input_data_link;
+    uint64_t _input_time;
+    // state of the command line with several commands ("AT+CMD1=1;+CMD2=2")
+    bool _suppress_ok;
+    bool _command_failed;
+
+    // multiplexer mode
+    bool _cmux_mode;
+    // maximal information field size of the output frames (N1)
+    size_t _cmux_frame_size;
+    CMUXCodec _cmux_codec;
+    struct cmux_line_t {
+        char text[INPUT_LINE_SIZE];
+        size_t len;
+    };
+    cmux_line_t _cmux_lines[CMUX_CHANNEL_NUM];
+    // channel of the current output and channel that owns data input state
+    int _output_dlci;
+    int _input_dlci;
+
+    // modem state
+    bool _echo;
+    int _cfun;
+    int _cgreg_mode;
+    int _cgreg_status;
+    int _cgreg_dlci;
+    int _cnsmod_mode;
+    int _cnsmod_status;
+    int _cnsmod_dlci;
+    int _cmgf;
+    // network state that is effective since _net_state_time (before it the state is opposite)
+    bool _net_opened;
+    uint64_t _net_state_time;
+    int _net_dlci;
+    int _cipmode;
+    int _ciprxget_mode;
+    PeerMode _peer_mode;
+    // number of the "+RECEIVE" URCs that should be skipped
+    int _receive_urc_drop_count;
+    // link that is opened in the transparent mode (AT+CIPMODE=1) or -1
+    int _transparent_link;
+    // time of the last data in the data mode (it's used for "+++" guard time check)
+    uint64_t _transparent_data_time;
+
+    struct link_t {
+        bool opened;
+        bool tcp;
+        char remote_ip[NSAPI_IP_SIZE];
+        int remote_port;
+        PeerMode peer_mode;
+        // multiplexer channel of the link URCs
+        int dlci;
+        // received data that hasn't been read by host
+        uint8_t rx_buf[LINK_BUFFER_SIZE];
+        size_t rx_start;
+        size_t rx_len;
+        // peer data stream
+        size_t stream_left;
+        uint32_t stream_offset;
+        uint64_t stream_time;
+        // time when link will be ready to send next data
+        uint64_t tx_time;
+    };
+    link_t _links[LINK_NUM];
+
+    struct dns_entry_t {
+        char host[48];
+        char ip_address[NSAPI_IP_SIZE];
+    };
+    static const int MAX_DNS_ENTRY_NUM = 8;
+    dns_entry_t _dns_entries[MAX_DNS_ENTRY_NUM];
+    int _dns_entry_num;
+
+    char _gps_info[80];
+    bool _gps_active;
+    int _gps_mode;
+    int _gps_accuracy;
+
+    struct sms_t {
+        bool used;
+        bool read;
+        char phone_number[20];
+        char message[161];
+    };
+    static const int MAX_SMS_NUM = 8;
+    sms_t _sms[MAX_SMS_NUM];
+    int _sms_sent_count;
+
+    struct ftp_file_t {
+        bool used;
+        bool is_dir;
+        char path[64];
+        size_t size;
+    };
+    static const int MAX_FTP_FILE_NUM = 8;
+    ftp_file_t _ftp_files[MAX_FTP_FILE_NUM];
+    bool _ftp_started;
+    bool _ftp_logged_in;
+    char _ftp_cwd[64];
+    // FTP cache (AT+CFTPSGET/AT+CFTPSLIST with cache usage)
+    bool _ftp_cache_active;
+    bool _ftp_cache_list;
+    size_t _ftp_cache_size;
+    size_t _ftp_cache_pos;
+    uint64_t _ftp_cache_time;
+    char _ftp_list_buf[512];
+    // FTP upload
+    int _ftp_put_file;
+    size_t _ftp_put_pending;
+    uint64_t _ftp_put_time;
+
+    stats_t _stats;
+
+    uint64_t _get_time() const;
+    void _update();
+    void _update_links(uint64_t now);
+    void _update_ftp(uint64_t now);
+    bool _is_net_opened(uint64_t now) const;
+    size_t _get_readable_len(uint64_t now) const;
+    size_t _get_output_free_space() const;
+    void _schedule_wakeup(uint64_t now);
+    void _wakeup_handler();
+    void _notify();
+
+    int _get_command_latency(const char *cmd) const;
+    uint64_t _get_uart_time(size_t len) const;
+    uint64_t _get_link_time(size_t len) const;
+
+    // output helpers
+    void _output_uart(uint64_t time, const void *data, size_t len);
+    void _output_frame(uint64_t time, int dlci, uint8_t control, const uint8_t *data, size_t len);
+    void _output_raw(uint64_t time, const void *data, size_t len);
+    void _output_line(uint64_t time, const char *format, ...);
+    void _output_ok(uint64_t time);
+    void _output_error(uint64_t time);
+    void _output_delayed_urc(uint64_t time, const char *format, ...);
+
+    // input processing
+    void _process_input_byte(uint8_t sym);
+    void _process_command_line(const char *line);
+    uint64_t _process_command(const char *cmd, uint64_t start_time);
+    void _process_data();
+    void _process_sms_text();
+    void _process_transparent_data();
+    void _cmux_process_frame();
+    void _cmux_process_input(int dlci, uint8_t sym);
+    void _cmux_stop();
+
+    // command handlers
+    void _cmd_basic(const char *cmd, const char *args, uint64_t time);
+    void _cmd_info(const char *cmd, const char *args, uint64_t time);
+    void _cmd_network(const char *cmd, const char *args, uint64_t time);
+    void _cmd_socket(const char *cmd, const char *args, uint64_t time);
+    void _cmd_dns(const char *cmd, const char *args, uint64_t time);
+    void _cmd_gps(const char *cmd, const char *args, uint64_t time);
+    void _cmd_sms(const char *cmd, const char *args, uint64_t time);
+    void _cmd_ftp(const char *cmd, const char *args, uint64_t time);
+
+    // socket helpers
+    void _link_close(int link_id);
+    size_t _link_push(int link_id, const uint8_t *data, size_t len);
+    size_t _link_pop(int link_id, uint8_t *data, size_t len);
+    size_t _link_free_space(int link_id) const;
+    void _link_deliver(int link_id, size_t len, uint64_t time);
+
+    // ftp helpers
+    int _ftp_find_file(const char *path);
+    int _ftp_add_file(const char *path, size_t size, bool is_dir);
+    void _ftp_resolve_path(const char *path, char *full_path, size_t full_path_size);
+};
+}
+
+#endif // SIM5320_MODEMEMULATOR_H
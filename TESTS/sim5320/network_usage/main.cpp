@@ -7,7 +7,9 @@
 #include "greentea-client/test_env.h"
 #include "math.h"
 #include "mbed.h"
+#include "nsapi_ppp.h"
 #include "rtos.h"
+#include "sim5320_CellularContext.h"
 #include "sim5320_driver.h"
 #include "string.h"
 #include "unity.h"
@@ -182,12 +184,88 @@ void test_udp_usage()
     TEST_ASSERT(current_time > time_2019);
 }
 
+/**
+ * Download file with HTTP GET request.
+ *
+ * @return number of the received bytes (including headers) or negative error code
+ */
+static int http_download(NetworkInterface *iface, const char *host, const char *path, int &time_ms)
+{
+    int err;
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "GET %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Connection: close\r\n\r\n",
+        path, host);
+
+    TCPSocket socket;
+    socket.set_timeout(10000);
+    if ((err = socket.open(iface))) {
+        return err;
+    }
+    if ((err = socket.connect(host, 80))) {
+        return err;
+    }
+    Timer timer;
+    timer.start();
+    nsapi_size_or_error_t res = socket.send(buf, strlen(buf));
+    if (res < 0) {
+        return res;
+    }
+    int read_bytes = 0;
+    while ((res = socket.recv(buf, sizeof(buf))) > 0) {
+        read_bytes += res;
+    }
+    time_ms = timer.read_ms();
+    socket.close();
+    return res < 0 ? res : read_bytes;
+}
+
+void test_ppp_throughput()
+{
+#if NSAPI_PPP_AVAILABLE
+    int err;
+    SIM5320CellularContext *cellular_context = static_cast<SIM5320CellularContext *>(modem->get_context());
+    const char *host = "speedtest.tele2.net";
+    const char *path = "/100KB.zip";
+    int at_time = 0;
+    int ppp_time = 0;
+
+    // download with SIM5320 sockets
+    int at_bytes = http_download(cellular_context, host, path, at_time);
+
+    // download with PPP
+    err = cellular_context->disconnect();
+    TEST_ASSERT_EQUAL(0, err);
+    cellular_context->set_ppp_mode(true);
+    err = cellular_context->connect();
+    TEST_ASSERT_EQUAL(0, err);
+    int ppp_bytes = http_download(cellular_context, host, path, ppp_time);
+    err = cellular_context->disconnect();
+    TEST_ASSERT_EQUAL(0, err);
+
+    // restore AT socket mode
+    cellular_context->set_ppp_mode(false);
+    err = cellular_context->connect();
+    TEST_ASSERT_EQUAL(0, err);
+
+    TEST_ASSERT(at_bytes > 0);
+    TEST_ASSERT(ppp_bytes > 0);
+    greentea_send_kv("at_socket_download_bps", at_time > 0 ? at_bytes * 1000LL / at_time : 0);
+    greentea_send_kv("ppp_download_bps", ppp_time > 0 ? ppp_bytes * 1000LL / ppp_time : 0);
+#else
+    TEST_IGNORE_MESSAGE("PPP isn't available (lwip.ppp-enabled option)");
+#endif
+}
+
 // test cases description
 #define SIM5320Case(test_fun) Case(#test_fun, case_setup_handler, test_fun, greentea_case_teardown_handler, greentea_case_failure_continue_handler)
 Case cases[] = {
     SIM5320Case(test_dns_usage),
     SIM5320Case(test_tcp_usage),
     SIM5320Case(test_udp_usage),
+    SIM5320Case(test_ppp_throughput),
 };
 Specification specification(test_setup_handler, cases, test_teardown_handler);
 
@@ -0,0 +1,164 @@
+#ifndef SIM5320_ATSCHEDULER_H
+#define SIM5320_ATSCHEDULER_H
+
+#include "ATHandler.h"
+#include "mbed.h"
+
+namespace sim5320 {
+
+/**
+ * Priority-aware arbiter of the @c ATHandler access.
+ *
+ * Operations are submitted with a priority class and a deadline (maximal queueing delay). If a handler is used by
+ * other operation, then waiting operations get it in order of their priority classes, and operations of the same class
+ * are ordered by their deadlines.
+ *
+ * The scheduler doesn't replace @c ATHandler mutex: it only orders threads before handler locking. So operations,
+ * that don't use scheduler (for example, Mbed OS cellular base classes), still compete for the handler mutex directly.
+ * An operation stops waiting its turn, when its deadline has expired, and it locks handler directly, so an operation
+ * that is started under handler lock cannot be blocked by the scheduler forever. Direct locks of the @c ATHandlerLocker
+ * are registered with @c direct_lock/@c direct_unlock, so a scheduled operation, that is nested into a direct lock of
+ * the same thread, doesn't wait turn at all, as the thread holds handler mutex.
+ */
+class SIM5320ATScheduler : private NonCopyable<SIM5320ATScheduler> {
+public:
+    SIM5320ATScheduler();
+    virtual ~SIM5320ATScheduler();
+
+    enum PriorityClass {
+        // short operations that are waited by a user (GPS control and coordinates, modem information, settings)
+        PRIORITY_INTERACTIVE = 0,
+        // network connection and socket operations
+        PRIORITY_DATA = 1,
+        // long operations (modem initialization and reset, network scanning, file transfer, SMS)
+        PRIORITY_BACKGROUND = 2
+    };
+
+    static const int PRIORITY_CLASS_NUM = 3;
+    // maximal number of the handlers that can be used at the same time
+    static const int MAX_HANDLERS = 4;
+
+    /**
+     * Get scheduler that is used by the driver.
+     *
+     * @return
+     */
+    static SIM5320ATScheduler *get_instance();
+
+    /**
+     * Wait turn of the operation.
+     *
+     * Nested invocations from the thread, that holds handler turn or handler mutex (see @c direct_lock), don't wait.
+     *
+     * @param at handler
+     * @param priority priority class of the operation
+     * @param deadline maximal queueing delay in milliseconds. If it's negative, then default deadline of the class is used.
+     * @return @c true if the turn has been granted and @c release should be invoked after operation, otherwise @c false
+     */
+    bool acquire(ATHandler &at, PriorityClass priority, int deadline = -1);
+
+    /**
+     * Finish operation and pass handler to the next waiting operation.
+     *
+     * @param at
+     */
+    void release(ATHandler &at);
+
+    /**
+     * Notify that the current thread has locked handler mutex without turn.
+     *
+     * @param at
+     */
+    void direct_lock(ATHandler &at);
+
+    /**
+     * Notify that the current thread is going to unlock handler mutex, that has been locked without turn.
+     *
+     * @param at
+     */
+    void direct_unlock(ATHandler &at);
+
+    /**
+     * Forget handler state.
+     *
+     * It should be invoked before handler deletion, so its slot can be used by other handlers.
+     * The state of the used handler is kept.
+     *
+     * @param at
+     */
+    void forget(ATHandler &at);
+
+    /**
+     * Set default deadline of the priority class.
+     *
+     * @param priority
+     * @param deadline deadline in milliseconds
+     */
+    void set_default_deadline(PriorityClass priority, int deadline);
+
+    /**
+     * Get default deadline of the priority class.
+     *
+     * @param priority
+     * @return deadline in milliseconds
+     */
+    int get_default_deadline(PriorityClass priority) const;
+
+    struct stats_t {
+        // number of the operations
+        uint32_t requests;
+        // number of the operations that waited other operations
+        uint32_t queued;
+        // number of the operations that have got handler after their deadline
+        uint32_t deadline_misses;
+        // total queueing delay in milliseconds
+        uint64_t total_delay;
+        // maximal queueing delay in milliseconds
+        uint32_t max_delay;
+    };
+
+    /**
+     * Get queueing counters of the priority class.
+     *
+     * @param priority
+     * @param stats
+     */
+    void get_stats(PriorityClass priority, stats_t &stats);
+
+    /**
+     * Reset counters.
+     */
+    void reset_stats();
+
+private:
+    struct waiter_t {
+        PriorityClass priority;
+        uint64_t deadline;
+        waiter_t *next;
+    };
+
+    struct lane_t {
+        ATHandler *at;
+        osThreadId_t owner;
+        int depth;
+        // thread that has locked handler mutex without turn
+        osThreadId_t direct_owner;
+        int direct_depth;
+        waiter_t *waiters;
+    };
+
+    rtos::Mutex _mutex;
+    rtos::ConditionVariable _cond;
+    lane_t _lanes[MAX_HANDLERS];
+    int _default_deadlines[PRIORITY_CLASS_NUM];
+    stats_t _stats[PRIORITY_CLASS_NUM];
+
+    lane_t *_find_lane(ATHandler *at, bool create);
+    void _free_lane_if_idle(lane_t *lane);
+    void _add_waiter(lane_t *lane, waiter_t *waiter);
+    void _remove_waiter(lane_t *lane, waiter_t *waiter);
+    waiter_t *_select_waiter(lane_t *lane);
+};
+}
+
+#endif // SIM5320_ATSCHEDULER_H
@@ -0,0 +1,228 @@
+#ifndef SIM5320_CMUX_H
+#define SIM5320_CMUX_H
+
+#include "mbed.h"
+#include "sim5320_utils.h"
+
+namespace sim5320 {
+
+/**
+ * GSM 07.10 (3GPP TS 27.010) multiplexer with basic option framing.
+ *
+ * The multiplexer splits one physical interface into several virtual channels (DLCI 1..N). Each channel implements
+ * @c FileHandle interface, so it can be used by a separate @c ATHandler.
+ *
+ * Modem should be switched into multiplexer mode with "AT+CMUX=0,0,<port_speed>,127" command (@c FRAME_DATA_SIZE
+ * as N1 parameter) before @c open invocation.
+ *
+ * @note channel reading and polling process physical input too, so channels don't depend on the event queue thread.
+ *       Blocking operations wait for physical interface and demultiplexer events instead of polling.
+ */
+class SIM5320CMUX : private NonCopyable<SIM5320CMUX> {
+public:
+    /**
+     * Constructor.
+     *
+     * @param fh physical interface
+     * @param queue event queue that is used to process input data notifications
+     */
+    SIM5320CMUX(FileHandle *fh, events::EventQueue *queue);
+    virtual ~SIM5320CMUX();
+
+    // maximal number of the virtual channels
+    static const int MAX_CHANNELS = 3;
+    // maximal frame information field size (N1 value that is negotiated with AT+CMUX)
+    static const size_t FRAME_DATA_SIZE = 127;
+    // maximal size of the received frame information field
+    static const size_t MAX_FRAME_DATA_SIZE = 127;
+    // size of the channel receive buffer
+    static const size_t CHANNEL_BUFFER_SIZE = 1536;
+
+    // frame types (control field without P/F bit)
+    static const uint8_t FRAME_SABM = 0x2F;
+    static const uint8_t FRAME_UA = 0x63;
+    static const uint8_t FRAME_DM = 0x0F;
+    static const uint8_t FRAME_DISC = 0x43;
+    static const uint8_t FRAME_UIH = 0xEF;
+    static const uint8_t FRAME_PF = 0x10;
+
+    /**
+     * Encode frame.
+     *
+     * @param buf output buffer. It should have size at least len + 7 bytes
+     * @param dlci data link connection identifier
+     * @param cr command/response bit
+     * @param control control field
+     * @param data information field
+     * @param len information field length
+     * @return frame length
+     */
+    static size_t encode_frame(uint8_t *buf, int dlci, bool cr, uint8_t control, const uint8_t *data, size_t len);
+
+    /**
+     * Frame decoder.
+     */
+    class FrameParser {
+    public:
+        FrameParser();
+
+        /**
+         * Process next byte of the stream.
+         *
+         * @param sym
+         * @return @c true if a valid frame has been received
+         */
+        bool push(uint8_t sym);
+
+        /**
+         * Reset parser state.
+         */
+        void reset();
+
+        // fields of the last received frame
+        int dlci;
+        bool cr;
+        uint8_t control;
+        uint8_t data[MAX_FRAME_DATA_SIZE];
+        size_t len;
+        // number of the frames with invalid check sequence
+        uint32_t fcs_errors;
+
+    private:
+        enum State {
+            STATE_FLAG = 0,
+            STATE_ADDRESS,
+            STATE_CONTROL,
+            STATE_LENGTH,
+            STATE_LENGTH_2,
+            STATE_DATA,
+            STATE_FCS,
+            STATE_END_FLAG
+        };
+        State _state;
+        uint8_t _header[4];
+        size_t _header_len;
+        size_t _data_pos;
+        uint8_t _fcs;
+    };
+
+    /**
+     * Virtual channel.
+     */
+    class Channel : public FileHandle, private NonCopyable<Channel> {
+    public:
+        Channel();
+        virtual ~Channel();
+
+        // FileHandle
+        virtual ssize_t read(void *buffer, size_t size);
+        virtual ssize_t write(const void *buffer, size_t size);
+        virtual off_t seek(off_t offset, int whence = SEEK_SET);
+        virtual int close();
+        virtual int set_blocking(bool blocking);
+        virtual bool is_blocking() const;
+        virtual short poll(short events) const;
+        virtual void sigio(Callback<void()> func);
+
+    private:
+        friend class SIM5320CMUX;
+
+        SIM5320CMUX *_mux;
+        int _dlci;
+        bool _opened;
+        bool _blocking;
+        ByteRingBuffer _rx_buf;
+        Callback<void()> _sigio_cb;
+    };
+
+    /**
+     * Open multiplexer control channel and virtual channels.
+     *
+     * @param channel_num number of the virtual channels
+     * @return 0 on success, otherwise non-zero value
+     */
+    nsapi_error_t open(int channel_num);
+
+    /**
+     * Close virtual channels and multiplexer.
+     *
+     * After closing modem returns to AT command mode.
+     *
+     * @return 0 on success, otherwise non-zero value
+     */
+    nsapi_error_t close();
+
+    /**
+     * Forget multiplexer state without closing frames.
+     *
+     * It should be used, if modem has left multiplexer mode itself (for example, after reset). Blocking channel
+     * operations are interrupted with @c -EIO error.
+     */
+    void detach();
+
+    /**
+     * Check if multiplexer is opened.
+     *
+     * @return
+     */
+    bool is_opened() const;
+
+    /**
+     * Get virtual channel.
+     *
+     * @param dlci channel number (1..MAX_CHANNELS)
+     * @return channel or @c NULL if @p dlci is invalid
+     */
+    FileHandle *get_channel(int dlci);
+
+    struct stats_t {
+        // number of the received valid frames
+        uint32_t rx_frames;
+        // number of the sent frames
+        uint32_t tx_frames;
+        // number of the frames with invalid check sequence
+        uint32_t fcs_errors;
+        // bytes that has been dropped, because channel buffer was full
+        uint32_t overrun_bytes;
+    };
+
+    /**
+     * Get multiplexer counters.
+     *
+     * @param stats
+     */
+    void get_stats(stats_t &stats);
+
+private:
+    FileHandle *_fh;
+    events::EventQueue *_queue;
+    // protects input processing and channel buffers
+    mutable PlatformMutex _mutex;
+    // protects physical interface writing
+    PlatformMutex _write_mutex;
+    volatile bool _input_event_pending;
+    // it's set by detach, so blocking operations don't wait the closed interface
+    volatile bool _aborted;
+    // physical interface, response and channel data events
+    rtos::EventFlags _events;
+    bool _opened;
+    int _channel_num;
+    Channel _channels[MAX_CHANNELS];
+    FrameParser _parser;
+    // last response (UA or DM) of the DLCI 0..MAX_CHANNELS or 0 if there is no response
+    uint8_t _responses[MAX_CHANNELS + 1];
+    stats_t _stats;
+
+    void _sigio_handler();
+    void _wait_events(uint32_t flags, uint32_t timeout);
+    void _input_event_handler();
+    void _process_input();
+    void _process_frame();
+    void _process_control_message();
+    int _write_frame(int dlci, bool cr, uint8_t control, const uint8_t *data, size_t len);
+    nsapi_error_t _send_command(int dlci, uint8_t control);
+    ssize_t _write_channel(int dlci, const void *buffer, size_t size);
+};
+}
+
+#endif // SIM5320_CMUX_H
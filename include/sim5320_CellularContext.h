@@ -6,6 +6,8 @@
 
 namespace sim5320 {
 
+class SIM5320CellularStack;
+
 /**
  * SIM5320 cellular context implementation.
  */
@@ -22,6 +24,88 @@ public:
     virtual nsapi_error_t disconnect();
     virtual bool is_connected();
 
+    /**
+     * Enable or disable socket transparent mode (AT+CIPMODE=1).
+     *
+     * The mode is applied during next connection. See SIM5320CellularStack::set_transparent_mode for details.
+     *
+     * @param enabled
+     */
+    void set_transparent_mode(bool enabled);
+
+    /**
+     * Check if socket transparent mode is enabled.
+     *
+     * @return
+     */
+    bool is_transparent_mode() const;
+
+    /**
+     * Enable or disable push receive mode (AT+CIPRXGET=0).
+     *
+     * The mode is applied during next connection. See SIM5320CellularStack constructor for details.
+     *
+     * @param enabled
+     */
+    void set_rx_push_mode(bool enabled);
+
+    /**
+     * Check if push receive mode is enabled.
+     *
+     * @return
+     */
+    bool is_rx_push_mode() const;
+
+    /**
+     * Enable or disable PPP data mode.
+     *
+     * In the PPP mode the modem dials "ATD*99***1#" and serial interface is passed to the MCU PPP/IP stack,
+     * so sockets use full TCP/IP stack of the MCU (TCP windowing, any number of sockets) instead of the SIM5320
+     * socket AT commands. The mode requires PPP support of the Mbed OS ("lwip.ppp-enabled": true),
+     * otherwise connection fails with @c NSAPI_ERROR_UNSUPPORTED error.
+     *
+     * The mode is applied during next connection.
+     *
+     * @note
+     * AT commands aren't available on the context serial interface during PPP connection, so other interfaces
+     * that share it (network, gps, etc.) cannot be used. Use multiplexer (@c SIM5320::start_cmux) to avoid it.
+     *
+     * @param enabled
+     */
+    void set_ppp_mode(bool enabled);
+
+    /**
+     * Check if PPP data mode is enabled.
+     *
+     * @return
+     */
+    bool is_ppp_mode() const;
+
+    /**
+     * Switch serial port from data mode to command mode, so other modem interfaces can be used.
+     *
+     * See SIM5320CellularStack::suspend_transparent_mode for details.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t suspend_transparent_mode();
+
+    /**
+     * Get socket stack of the context.
+     *
+     * It can be used to access SIM5320 specific socket settings.
+     *
+     * @return
+     */
+    SIM5320CellularStack *get_sim5320_stack();
+
+    /**
+     * Get duration of the last successful disconnect operation (from AT+NETCLOSE till network closing).
+     *
+     * @return duration in milliseconds
+     */
+    int get_disconnect_latency() const;
+
 protected:
     /**
      * Helper method to call callback function if it is provided
@@ -34,8 +118,24 @@ protected:
     NetworkStack *get_stack();
 
 private:
-    bool _is_net_opened;
+    volatile bool _is_net_opened;
+    // network opening has been failed ("+NETOPEN: <err>" URC)
+    volatile bool _net_open_failed;
+    // it's released when network state is changed by "+NETOPEN"/"+NETCLOSE" URC
+    Semaphore _net_state_sem;
+    // duration of the last disconnect operation
+    int _disconnect_latency;
     SIM5320CellularDevice *_sim5320_device;
+    // socket data receive mode (see SIM5320CellularStack constructor)
+    bool _rx_push_mode;
+    // socket transparent mode (AT+CIPMODE=1)
+    bool _transparent_mode;
+    // PPP data mode
+    bool _ppp_mode;
+    volatile bool _is_ppp_connected;
+    // network reopening after unexpected network loss
+    uint64_t _reopen_deadline;
+    int _reopen_event_id;
 
     /**
      * Check if network is opened.
@@ -44,8 +144,57 @@ private:
      */
     nsapi_error_t _check_netstate();
 
+    /**
+     * Wait network opening or closing.
+     *
+     * The method waits semaphore that is released by "+NETOPEN"/"+NETCLOSE" URC handlers. Network state is checked
+     * with AT+NETOPEN? command after timeout, if URC is lost.
+     *
+     * @param opened expected network state
+     * @param timeout timeout in milliseconds
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t _wait_net_state(bool opened, int timeout);
+
+    /**
+     * Wait "+NETOPEN"/"+NETCLOSE" message by reading serial port directly.
+     *
+     * It's used when the method is invoked from the AT handler event queue, so URCs cannot be processed by it.
+     *
+     * @param opened expected network state
+     * @param timeout timeout in milliseconds
+     */
+    void _wait_net_state_urc(bool opened, int timeout);
+
+    /**
+     * Switch serial interface into PPP data mode and start PPP connection.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t _ppp_connect();
+
+    /**
+     * Stop PPP connection and return serial interface into AT command mode.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t _ppp_disconnect();
+
+    void _ppp_status_cb(nsapi_event_t ev, intptr_t ptr);
+
+    /**
+     * Handle unexpected network loss that is reported by socket stack.
+     *
+     * Network is reopened with AT+NETOPEN command, and "+NETOPEN" URC completes recovery.
+     *
+     * @param recovery_timeout recovery timeout in milliseconds. If it's 0, network isn't reopened
+     */
+    void _network_lost(int recovery_timeout);
+    void _reopen_network();
+
     void _urc_netopen();
     void _urc_netclose();
+    void _clear_dns_cache();
 };
 }
 #endif // SIM5320_CELLULARCONTEXT_H
@@ -9,6 +9,7 @@
 #include "mbed.h"
 #include "sim5320_FTPClient.h"
 #include "sim5320_GPSDevice.h"
+#include "sim5320_SettingsCache.h"
 
 namespace sim5320 {
 
@@ -52,6 +53,7 @@ public:
 
     // AT_CellularDevice
     virtual nsapi_error_t init();
+    virtual nsapi_error_t release_at_handler(ATHandler *at_handler);
 
     /**
      * Get GPS device interface.
@@ -99,6 +101,13 @@ public:
      */
     virtual nsapi_error_t set_subscriber_number(const char *number);
 
+    /**
+     * Get shadow copy of the modem settings, that is used to skip redundant configuration commands.
+     *
+     * @return
+     */
+    SIM5320SettingsCache *get_settings_cache();
+
 protected:
     // AT_CellularDevice
     virtual AT_CellularInformation *open_information_impl(ATHandler &at);
@@ -115,6 +124,15 @@ protected:
 
     SIM5320GPSDevice *_gps;
     SIM5320FTPClient *_ftp_client;
+
+    SIM5320SettingsCache _settings_cache;
+
+    /**
+     * The URC handler of the "START" message, that is sent by modem after startup.
+     *
+     * Modem can be restarted unexpectedly (for example, by power failure), so its settings are forgotten.
+     */
+    void _urc_start();
 };
 }
 
@@ -23,6 +23,7 @@ public:
     virtual nsapi_error_t detach();
     virtual nsapi_error_t scan_plmn(operList_t &operators, int &ops_count);
     virtual nsapi_error_t get_registration_params(RegistrationType type, registration_params_t &reg_params);
+    virtual nsapi_error_t set_registration_urc(RegistrationType type, bool on);
 
     /**
      * Get active radio access technology.
@@ -46,12 +47,72 @@ public:
      */
     virtual nsapi_error_t set_preffered_radio_access_technology_mode(SIM5320PreferredRadioAccessTechnologyMode aop);
 
+    /**
+     * Enable/disable registration status cache.
+     *
+     * If cache is enabled, then registration URCs are enabled (AT+CGREG=2 and AT+CNSMOD=1), and
+     * C_GREG registration parameters and active radio access technology are read from the cache without AT commands.
+     *
+     * Default +CGREG URC handler is replaced when cache is enabled first time.
+     *
+     * @note disabling doesn't turn off +CGREG URCs, as they can be used by CellularStateMachine.
+     *
+     * @param enabled
+     * @return 0 on success, otherwise non-zero value
+     */
+    nsapi_error_t set_registration_cache(bool enabled);
+
+    /**
+     * Check if registration status cache is enabled.
+     *
+     * @return
+     */
+    bool is_registration_cache_enabled() const;
+
+    /**
+     * Registration state that is tracked by +CGREG and +CNSMOD URCs.
+     */
+    struct registration_snapshot_t {
+        // registration status
+        RegistrationStatus status;
+        // active radio access technology
+        RadioAccessTechnology act;
+        // location area code or -1 if it's unknown
+        int lac;
+        // cell id or -1 if it's unknown
+        int cell_id;
+        // time of the last status, cell or access technology change (ms)
+        uint64_t change_time;
+    };
+
+    /**
+     * Get cached registration state.
+     *
+     * @param snapshot
+     * @return 0 on success, NSAPI_ERROR_UNSUPPORTED if cache is disabled
+     */
+    nsapi_error_t get_registration_snapshot(registration_snapshot_t &snapshot);
+
 protected:
     // AT_CellularNetwork
     virtual nsapi_error_t set_access_technology_impl(RadioAccessTechnology op_rat);
 
 private:
     static const int _OPERATORS_SCAN_TIMEOUT = 120000;
+
+    mutable PlatformMutex _registration_mutex;
+    bool _registration_cache_enabled;
+    bool _cgreg_handler_replaced;
+    registration_snapshot_t _registration_snapshot;
+
+    nsapi_error_t _read_active_access_technology(RadioAccessTechnology &op_rat);
+    nsapi_error_t _read_registration_snapshot();
+    void _read_registration_location(int &lac, int &cell_id);
+    void _update_registration(RegistrationStatus status, int lac, int cell_id);
+    void _update_access_technology(RadioAccessTechnology act);
+    void _replace_cgreg_handler();
+    void _urc_cgreg();
+    void _urc_cnsmod();
 };
 }
 #endif // SIM5320_CELLULARNETWORK_H
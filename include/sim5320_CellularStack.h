@@ -3,6 +3,8 @@
 
 #include "AT_CellularStack.h"
 #include "mbed.h"
+#include "sim5320_DNSCache.h"
+#include "sim5320_utils.h"
 
 namespace sim5320 {
 
@@ -11,12 +13,313 @@ namespace sim5320 {
  */
 class SIM5320CellularStack : public AT_CellularStack, private NonCopyable<SIM5320CellularStack> {
 public:
-    SIM5320CellularStack(ATHandler &at, int cid, nsapi_ip_stack_t stack_type);
+    /**
+     * Constructor.
+     *
+     * @param at
+     * @param cid
+     * @param stack_type
+     * @param queue event queue that is used for asynchronous operations
+     * @param rx_push_mode if it's @c true, then the stack expects that modem pushes received data with "+RECEIVE" URC (AT+CIPRXGET=0),
+     *                     otherwise data is read with AT+CIPRXGET=2 command (AT+CIPRXGET=1)
+     */
+    SIM5320CellularStack(ATHandler &at, int cid, nsapi_ip_stack_t stack_type, events::EventQueue *queue, bool rx_push_mode = false);
     virtual ~SIM5320CellularStack();
 
     // DNS
     virtual nsapi_error_t gethostbyname(const char *host, SocketAddress *address, nsapi_version_t version = NSAPI_UNSPEC, const char *interface_name = NULL);
 
+    /**
+     * Resolve host name asynchronously.
+     *
+     * The AT+CDNSGIP command is executed from the dedicated thread, so neither the caller nor the driver event queue
+     * is blocked, and @p callback is invoked from this thread too. The modem doesn't accept other commands till the
+     * final result of the AT+CDNSGIP, so AT interface is held by the query until the host is resolved, and other
+     * commands are delayed.
+     *
+     * @param host host name
+     * @param callback result callback
+     * @param version ip version (only IPv4 is supported)
+     * @param interface_name interface name (it's ignored)
+     * @return 0 if result is available immediately (callback is invoked before function returns),
+     *         positive query id if request has been started, or negative error code
+     */
+    virtual nsapi_value_or_error_t gethostbyname_async(const char *host, hostbyname_cb_t callback, nsapi_version_t version = NSAPI_UNSPEC, const char *interface_name = NULL);
+
+    /**
+     * Cancel asynchronous host name resolution.
+     *
+     * @param id query id
+     * @return 0 on success, non-zero on failure
+     */
+    virtual nsapi_error_t gethostbyname_async_cancel(int id);
+
+    /**
+     * Get cache of the resolved host names.
+     *
+     * It can be used to check cache counters, to change ttl or to clear it.
+     *
+     * @return
+     */
+    SIM5320DNSCache *get_dns_cache();
+
+    /**
+     * Start TCP connection.
+     *
+     * The method sends AT+CIPOPEN command and waits "+CIPOPEN:" result.
+     *
+     * If `sim5320-driver.socket_nonblocking_connect` option is enabled, the method returns NSAPI_ERROR_IN_PROGRESS
+     * without waiting of the connection. The socket is notified when "+CIPOPEN:" message is received. Next invocations
+     * return NSAPI_ERROR_ALREADY during connection, NSAPI_ERROR_IS_CONNECTED after successful connection or
+     * NSAPI_ERROR_NO_CONNECTION if connection has failed.
+     *
+     * For UDP sockets the method only stores remote address.
+     */
+    virtual nsapi_error_t socket_connect(nsapi_socket_t handle, const SocketAddress &address);
+
+    virtual void socket_attach(nsapi_socket_t handle, void (*callback)(void *), void *data);
+
+    /**
+     * Close socket.
+     *
+     * If socket callback is being invoked from other thread, the method waits its end.
+     */
+    virtual nsapi_error_t socket_close(nsapi_socket_t handle);
+
+    /**
+     * Enable or disable transparent mode.
+     *
+     * In the transparent mode (AT+CIPMODE=1) only one TCP socket can be used. After connection the serial port is switched
+     * into data mode and the socket data is sent/received without AT commands. The mode should match AT+CIPMODE
+     * value, so it's set by a cellular context before network opening.
+     *
+     * @note other modem interfaces mustn't be used in the data mode, the data mode should be suspended with
+     *       suspend_transparent_mode() at first.
+     * @note connection closing by peer isn't detected in the data mode.
+     *
+     * @param enabled
+     */
+    void set_transparent_mode(bool enabled);
+
+    /**
+     * Enable or disable push receive mode.
+     *
+     * The mode should match AT+CIPRXGET value (see constructor), so it's set by a cellular context before network opening.
+     *
+     * @param enabled
+     */
+    void set_rx_push_mode(bool enabled);
+
+    /**
+     * Check if push receive mode is enabled.
+     *
+     * @return
+     */
+    bool is_rx_push_mode() const;
+
+    /**
+     * Check if transparent mode is enabled.
+     *
+     * @return
+     */
+    bool is_transparent_mode() const;
+
+    /**
+     * Switch serial port from data mode to command mode with "+++" escape sequence.
+     *
+     * The data mode is resumed with ATO command automatically by next socket operation.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t suspend_transparent_mode();
+
+    /**
+     * Set callback that is invoked when modem confirms closing of the link.
+     *
+     * Socket closing doesn't wait modem confirmation, so the callback can be used to track it. The callback
+     * is invoked from the event queue with link (socket) id and closing result.
+     *
+     * @param callback
+     */
+    void set_link_closed_callback(Callback<void(int, nsapi_error_t)> callback);
+
+    /**
+     * Set network loss recovery timeout.
+     *
+     * If network is closed unexpectedly ("+CIPEVENT: NETWORK CLOSED UNEXPECTEDLY"), the context reopens network
+     * (AT+NETOPEN), and the stack reopens links of the open sockets with the same remote endpoints after it.
+     * Sockets return NSAPI_ERROR_WOULD_BLOCK during recovery, and data that hasn't been read or sent before network
+     * loss is dropped.
+     *
+     * @param timeout maximal recovery duration (ms). If it's 0, then recovery is disabled and all sockets are closed
+     *                on network loss.
+     */
+    void set_network_recovery_timeout(int timeout);
+
+    /**
+     * Set callback that is invoked when link recovery after network loss is completed.
+     *
+     * The callback is invoked from the event queue with link (socket) id and recovery result. If result is 0,
+     * then the link has been reconnected, otherwise the socket is closed.
+     *
+     * @param callback
+     */
+    void set_link_recovered_callback(Callback<void(int, nsapi_error_t)> callback);
+
+    /**
+     * Set callback that is invoked when network is closed unexpectedly.
+     *
+     * The callback is invoked from the URC handler with network recovery timeout. If it's positive, then network
+     * should be reopened during this time, otherwise sockets have been closed.
+     *
+     * @note The callback is used by SIM5320CellularContext.
+     *
+     * @param callback
+     */
+    void set_network_lost_callback(Callback<void(int)> callback);
+
+    /**
+     * Reopen links of the sockets after network recovery.
+     *
+     * @note It's invoked by SIM5320CellularContext when network is opened.
+     */
+    void network_reopened();
+
+    struct udp_datagram_t {
+        // destination address
+        SocketAddress address;
+        const void *data;
+        nsapi_size_t size;
+        // result: number of the sent bytes, negative error code or 0 if datagram hasn't been sent after previous failure
+        nsapi_size_or_error_t result;
+    };
+
+    /**
+     * Send several UDP datagrams.
+     *
+     * AT+CIPSEND commands of the datagrams are sent one after another under one AT handler lock without
+     * waiting of the "+CIPSEND:" confirmations of the previous datagrams (up to `sim5320-driver.udp_batch_window`
+     * unconfirmed datagrams). Sending is stopped on the first failed datagram.
+     *
+     * @note SIM5320UDPSocket::sendto_batch can be used to send datagrams with UDPSocket object.
+     *
+     * @param handle UDP socket handle
+     * @param datagrams datagrams, the @c result field of each datagram is set by the method
+     * @param count number of the datagrams
+     * @return index of the first failed datagram (it's @p count if all datagrams have been sent) or negative error code
+     */
+    nsapi_size_or_error_t socket_sendto_batch(nsapi_socket_t handle, udp_datagram_t *datagrams, int count);
+
+    struct iovec_t {
+        const void *data;
+        nsapi_size_t size;
+    };
+
+    /**
+     * Send data of the several buffers (scatter-gather send).
+     *
+     * Fragments are written one after another into AT+CIPSEND payload, so they don't require an intermediate buffer.
+     * TCP data is sent like with Socket::send, but UDP fragments are sent as a single datagram.
+     *
+     * @note SIM5320TCPSocket::sendmsg and SIM5320UDPSocket::sendmsg can be used to send data with socket objects.
+     *
+     * @param handle socket handle
+     * @param address destination address of the UDP datagram. It's ignored for TCP socket.
+     * @param iov data fragments
+     * @param iov_count number of the fragments
+     * @return number of the sent bytes or negative error code
+     */
+    nsapi_size_or_error_t socket_sendmsg(nsapi_socket_t handle, const SocketAddress *address, const iovec_t *iov, int iov_count);
+
+    /**
+     * Level of the SIM5320 specific socket options (see Socket::setsockopt).
+     */
+    static const int SOCKET_OPT_LEVEL = 0x5320;
+
+    enum SocketOption {
+        /**
+         * Coalescing of the small TCP writes (tcp_coalescing_t option value).
+         *
+         * Data of the small send operations is accumulated in the socket buffer and it's sent with one AT+CIPSEND
+         * command, when buffer is full, after flush delay, by SOCKET_OPT_TCP_FLUSH option or on socket closing.
+         */
+        SOCKET_OPT_TCP_COALESCING = 1,
+        /**
+         * Send accumulated data immediately (option value is ignored).
+         */
+        SOCKET_OPT_TCP_FLUSH = 2
+    };
+
+    struct tcp_coalescing_t {
+        // buffer size (it's limited by maximal AT+CIPSEND chunk size). If it's 0, then coalescing is disabled.
+        nsapi_size_t buffer_size;
+        // maximal time that data waits in the buffer (ms). If it is 0, then data is sent only when buffer is full,
+        // on flush or socket closing
+        int flush_delay;
+    };
+
+    virtual nsapi_error_t socket_open(nsapi_socket_t *handle, nsapi_protocol_t proto);
+    // socket_send and socket_recv use these methods, so all socket data operations are scheduled with data priority
+    virtual nsapi_size_or_error_t socket_sendto(nsapi_socket_t handle, const SocketAddress &address, const void *data, nsapi_size_t size);
+    virtual nsapi_size_or_error_t socket_recvfrom(nsapi_socket_t handle, SocketAddress *address, void *buffer, nsapi_size_t size);
+    virtual nsapi_error_t setsockopt(nsapi_socket_t handle, int level, int optname, const void *optval, unsigned optlen);
+
+    struct latency_stats_t {
+        // number of the measurements
+        uint32_t count;
+        uint32_t min_ms;
+        uint32_t avg_ms;
+        uint32_t max_ms;
+        uint64_t total_ms;
+    };
+
+    struct socket_stats_t {
+        // number of the payload bytes that have been sent
+        uint32_t tx_bytes;
+        // number of the payload bytes that have been received
+        uint32_t rx_bytes;
+        // number of the AT commands of the link (AT+CIPOPEN, AT+CIPSEND, AT+CIPRXGET, AT+CIPCLOSE)
+        uint32_t at_round_trips;
+        // number of the send/receive operations that have returned NSAPI_ERROR_WOULD_BLOCK
+        uint32_t would_block;
+        // number of the "+IP ERROR: No data" responses
+        uint32_t no_data_errors;
+        // number of the pending receive bytes corrections (data without "+RECEIVE" URCs or excess counted bytes)
+        uint32_t rx_drift_corrections;
+        // number of the pushed receive bytes that have been dropped because of the receive buffer overflow
+        uint32_t rx_dropped_bytes;
+        // duration of the AT+CIPSEND commands (from command start till OK)
+        latency_stats_t cipsend_latency;
+        // duration of the AT+CIPRXGET=2 commands
+        latency_stats_t ciprxget_latency;
+    };
+
+    /**
+     * Get performance counters of the link.
+     *
+     * Counters are collected per link (socket id), so they aren't reset when socket is closed.
+     *
+     * @param link_id link (socket) id
+     * @param stats
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t get_socket_stats(int link_id, socket_stats_t &stats);
+
+    /**
+     * Reset performance counters of all links.
+     */
+    void reset_socket_stats();
+
+    /**
+     * Synchronize number of the pending receive bytes of the open sockets with modem buffers (AT+CIPRXGET=4).
+     *
+     * The synchronization can be done periodically (``sim5320-driver.socket_rx_reconcile_period`` option), or it can be
+     * forced to pick up data with lost "+RECEIVE" notification. It isn't used in push receive mode.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t reconcile_rx_pending_bytes();
+
 protected:
     virtual int get_max_socket_count();
     virtual bool is_protocol_supported(nsapi_protocol_t protocol);
@@ -37,16 +340,231 @@ protected:
     virtual nsapi_size_or_error_t socket_recvfrom_impl(CellularSocket *socket, SocketAddress *address, void *buffer, nsapi_size_t size);
 
 private:
-    // map with active sockets
-    uint16_t _active_sockets;
+    static const int _SOCKET_COUNT = 10;
+
+    enum LinkState {
+        // link isn't used
+        LINK_CLOSED = 0,
+        // TCP connection is in progress (waiting "+CIPOPEN:" message)
+        LINK_OPENING,
+        // TCP connection has failed
+        LINK_OPEN_FAILED,
+        // link is opened
+        LINK_OPEN,
+        // data hasn't been confirmed, so link should be closed
+        LINK_BROKEN,
+        // link has been closed by peer or network
+        LINK_PEER_CLOSED,
+        // AT+CIPCLOSE has been sent (waiting "+CIPCLOSE:" message)
+        LINK_CLOSING,
+        // network has been lost, so link will be reopened after network recovery
+        LINK_RECOVERING
+    };
+    LinkState _link_states[_SOCKET_COUNT];
+    Callback<void(int, nsapi_error_t)> _link_closed_cb;
+    uint64_t _open_deadlines[_SOCKET_COUNT];
+    int _open_timeout_event_id;
+
+    int _find_socket_id(CellularSocket *socket);
+    nsapi_error_t _start_tcp_open(CellularSocket *socket);
+    nsapi_error_t _wait_tcp_open(CellularSocket *socket);
+    void _process_tcp_open_result(int link_id, int open_code);
+    void _init_opened_socket(CellularSocket *socket);
+    nsapi_error_t _open_udp_link(CellularSocket *socket);
+    /**
+     * Complete link opening and notify socket.
+     *
+     * @param link_id
+     * @param result 0 if link is open, otherwise error code
+     */
+    void _complete_link_open(int link_id, nsapi_error_t result);
+
+    // network loss recovery
+    int _recovery_timeout;
+    int _recovery_event_id;
+    // connected link is reopened by recovery
+    bool _link_recovering[_SOCKET_COUNT];
+    Callback<void(int, nsapi_error_t)> _link_recovered_cb;
+    Callback<void(int)> _network_lost_cb;
+
+    void _start_network_recovery();
+    void _network_recovery_timeout();
+    void _reopen_recovering_links();
+    bool _is_link_recovering(int sock_id);
+    void _schedule_tcp_open_timeout();
+    void _tcp_open_timeout();
+    /**
+     * Wait "+CIPCLOSE:" confirmation of the link, if it's closing.
+     *
+     * @param sock_id
+     */
+    void _wait_link_closed(int sock_id);
+    void _complete_link_close(int link_id, nsapi_error_t result);
+    // coalescing of the small TCP writes
+    struct tx_coalescing_t {
+        uint8_t *buf;
+        nsapi_size_t size;
+        nsapi_size_t len;
+        int flush_delay;
+        uint64_t flush_deadline;
+    };
+    tx_coalescing_t _tx_coalescing[_SOCKET_COUNT];
+    int _tx_flush_event_id;
+
+    nsapi_error_t _set_tx_coalescing(int sock_id, const tcp_coalescing_t *options);
+    nsapi_size_or_error_t _socket_send_coalesced(CellularSocket *socket, const uint8_t *data, nsapi_size_t size);
+    /**
+     * Send accumulated data of the socket.
+     *
+     * @param sock_id
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t _flush_tx_buffer(int sock_id);
+    void _schedule_tx_flush();
+    void _tx_flush_timeout();
+
+    // performance counters
+    socket_stats_t _link_stats[_SOCKET_COUNT];
+    static void _stats_add_latency(latency_stats_t &stats, uint64_t start_time);
+
     // error of the AT+CIPRXGET
     bool _ciprxget_no_data;
+    // number of the sent chunks without +CIPSEND confirmation
+    int _send_pending_chunks[_SOCKET_COUNT];
+    // number of the successfully confirmed chunks
+    uint32_t _send_confirmed_chunks[_SOCKET_COUNT];
+
+    // resolved host names
+    SIM5320DNSCache _dns_cache;
+
+    events::EventQueue *_queue;
+
+    // asynchronous DNS queries
+    enum DNSQueryState {
+        DNS_QUERY_FREE = 0,
+        DNS_QUERY_PENDING,
+        DNS_QUERY_SENT
+    };
+    struct dns_query_t {
+        int id;
+        DNSQueryState state;
+        bool cancelled;
+        char host[SIM5320DNSCache::MAX_HOST_LEN + 1];
+        hostbyname_cb_t callback;
+    };
+    static const int _DNS_QUERY_COUNT = 4;
+    dns_query_t _dns_queries[_DNS_QUERY_COUNT];
+    int _dns_query_id_counter;
+    int _dns_process_event_id;
+    // the queries are modified by DNS and user threads
+    PlatformMutex _dns_mutex;
+    events::EventQueue _dns_queue;
+    rtos::Thread _dns_thread;
+
+    /**
+     * Read +CDNSGIP result after message prefix.
+     *
+     * @param ip_address resolved address (it's set if host is resolved successfully)
+     * @param cacheable it's set to @c true if result can be cached
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t _read_dns_result(char *ip_address, bool &cacheable);
+
+    /**
+     * Execute AT+CDNSGIP command and wait its final result.
+     *
+     * @param host host name
+     * @param ip_address resolved address (it's set if host is resolved successfully)
+     * @param cacheable it's set to @c true if result can be cached
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t _resolve_host(const char *host, char *ip_address, bool &cacheable);
+    void _process_dns_queries();
+
+    // receive mode
+    bool _rx_push_mode;
+    // buffers with data that has been pushed by modem
+    ByteRingBuffer *_rx_buffers[_SOCKET_COUNT];
+
+    nsapi_size_or_error_t _socket_recv_pushed_data(CellularSocket *socket, void *buffer, nsapi_size_t size);
+    // periodic synchronization of the pending bytes
+    int _rx_reconcile_event_id;
+    // bytes that have been counted by AT+CIPRXGET response before their "+RECEIVE" notification
+    int _rx_counted_ahead[_SOCKET_COUNT];
+    nsapi_error_t _reconcile_rx_pending_bytes();
+    void _set_rx_pending_bytes(CellularSocket *socket, int pending_bytes);
+    void _rx_reconcile_timeout();
+    void _receive_pushed_data(CellularSocket *socket, int link_id, int num_bytes);
+
+    // transparent mode
+    bool _transparent_mode;
+    // socket that uses link 0 in the transparent mode
+    CellularSocket *_transparent_socket;
+    // if it's true, then serial port is in data mode and it's used directly
+    bool _transparent_data_mode;
+    uint64_t _transparent_last_write_time;
+    volatile bool _transparent_notify_pending;
+
+    nsapi_error_t _transparent_open(CellularSocket *socket);
+    nsapi_error_t _transparent_close();
+    void _transparent_start_data_mode();
+    nsapi_error_t _transparent_suspend();
+    nsapi_error_t _transparent_resume();
+    nsapi_size_or_error_t _transparent_send(const uint8_t *data, nsapi_size_t size);
+    nsapi_size_or_error_t _transparent_recv(void *buffer, nsapi_size_t size);
+    void _transparent_sigio();
+    void _transparent_notify();
+
+    nsapi_size_or_error_t _socket_sendmsg(CellularSocket *socket, const SocketAddress *address, const iovec_t *iov, int iov_count);
+    nsapi_size_or_error_t _socket_send_iov(CellularSocket *socket, const SocketAddress *address, const iovec_t *iov, int iov_count);
+    nsapi_size_or_error_t _socket_recvfrom(CellularSocket *socket, SocketAddress *address, void *buffer, nsapi_size_t size);
+    nsapi_size_or_error_t _socket_send_tcp(CellularSocket *socket, const uint8_t *data, nsapi_size_t size);
+    nsapi_size_or_error_t _socket_send_tcp(CellularSocket *socket, const iovec_t *iov, int iov_count);
+    nsapi_size_or_error_t _socket_send_udp(CellularSocket *socket, const SocketAddress &address, const iovec_t *iov, int iov_count);
+    /**
+     * Write UDP datagram with AT+CIPSEND command without waiting of the confirmation.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t _write_udp_datagram(CellularSocket *socket, const SocketAddress &address, const iovec_t *iov, int iov_count);
+    /**
+     * Write @p size bytes of the fragments starting from @p offset with ATHandler::write_bytes.
+     */
+    void _write_iov(const iovec_t *iov, int iov_count, nsapi_size_t offset, nsapi_size_t size);
+    static nsapi_size_t _get_iov_size(const iovec_t *iov, int iov_count);
+    /**
+     * Read +CIPSEND confirmations until number of the unconfirmed chunks of the socket is greater than @p max_pending_chunks.
+     *
+     * @param sock_id
+     * @param max_pending_chunks
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t _wait_send_confirmations(int sock_id, int max_pending_chunks);
+    void _process_send_confirmation(int link_id, int req_send_length, int cnf_send_length);
 
     CellularSocket *_get_socket(int link_id);
+    /**
+     * Schedule socket callback invocation.
+     *
+     * Callbacks are invoked from the dedicated thread without AT handler lock, so neither URC handlers nor
+     * driver event queue wait user code. Several notifications of the same link are merged into one invocation.
+     */
     void _notify_socket(int link_id);
     void _notify_socket(CellularSocket *socket);
+    void _dispatch_socket_events();
+    // links with pending notifications
+    uint32_t _socket_event_links;
+    int _socket_events_event_id;
+    events::EventQueue _socket_event_queue;
+    rtos::Thread _socket_event_thread;
+    // protects socket notifications and callbacks
+    rtos::Mutex _socket_event_mutex;
+    rtos::ConditionVariable _socket_event_cond;
+    // link which callback is being invoked or -1
+    int _socket_callback_link;
+    // links which callbacks shouldn't be invoked, as they are being closed
+    uint32_t _socket_closing_links;
     void _disconnect_socket_by_peer(int link_id);
-    void _disconnect_socket_by_peer(CellularSocket *socket);
     // URC handlers
     /**
      * The URC handler of the message:
@@ -75,7 +593,7 @@ private:
      * +RECEIVE,<link_id>,<data length>
      * @endcode
      *
-     * that indicates that some socket has received data.
+     * that indicates that some socket has received data. In the push mode the data follows the message.
      */
     void _urc_receive();
 
@@ -87,6 +605,39 @@ private:
      * @endcode
      */
     void _urc_ciprxget_no_data();
+
+    /**
+     * The URC handler of the message:
+     *
+     * @code
+     * +CIPSEND: <link_id>,<reqSendLength>,<cnfSendLength>
+     * @endcode
+     *
+     * that confirms that data chunk has been sent.
+     */
+    void _urc_cipsend();
+
+    /**
+     * The URC handler of the message:
+     *
+     * @code
+     * +CIPOPEN: <link_id>,<err>
+     * @endcode
+     *
+     * that is a result of the TCP connection.
+     */
+    void _urc_cipopen();
+
+    /**
+     * The URC handler of the message:
+     *
+     * @code
+     * +CIPCLOSE: <link_id>,<err>
+     * @endcode
+     *
+     * that is a result of the AT+CIPCLOSE command.
+     */
+    void _urc_cipclose();
 };
 }
 
@@ -0,0 +1,106 @@
+#ifndef SIM5320_DNSCACHE_H
+#define SIM5320_DNSCACHE_H
+
+#include "mbed.h"
+
+namespace sim5320 {
+
+/**
+ * Bounded LRU cache of the resolved host names.
+ *
+ * The cache stores successful results during "ttl" and resolution failures during "negative ttl".
+ * If cache is full, the least recently used entry is replaced.
+ */
+class SIM5320DNSCache : private NonCopyable<SIM5320DNSCache> {
+public:
+    /**
+     * Constructor.
+     *
+     * @param capacity maximal number of the entries. If it's 0, then cache is disabled.
+     * @param ttl lifetime of the resolved address in milliseconds
+     * @param negative_ttl lifetime of the resolution failure in milliseconds. If it's 0, failures aren't cached.
+     */
+    SIM5320DNSCache(int capacity, int ttl, int negative_ttl);
+    virtual ~SIM5320DNSCache();
+
+    static const size_t MAX_HOST_LEN = 63;
+
+    /**
+     * Find host in the cache.
+     *
+     * @param host host name
+     * @param address resolved address, if the host is found and it was resolved successfully
+     * @param result cached result of the resolution: 0 or NSAPI_ERROR_DNS_FAILURE
+     * @return @c true if host is found, otherwise @c false
+     */
+    bool find(const char *host, SocketAddress *address, nsapi_error_t &result);
+
+    /**
+     * Add result of the host resolution to the cache.
+     *
+     * Only successful results and NSAPI_ERROR_DNS_FAILURE are cached.
+     *
+     * @param host host name
+     * @param address resolved address
+     * @param result result of the resolution
+     */
+    void add(const char *host, const SocketAddress *address, nsapi_error_t result);
+
+    /**
+     * Remove all entries.
+     */
+    void clear();
+
+    /**
+     * Set lifetime of the new entries.
+     *
+     * @param ttl lifetime of the resolved address in milliseconds
+     * @param negative_ttl lifetime of the resolution failure in milliseconds
+     */
+    void set_ttl(int ttl, int negative_ttl);
+
+    struct stats_t {
+        // number of the requests that has been served from the cache
+        uint32_t hits;
+        // number of the requests that hasn't been found in the cache
+        uint32_t misses;
+        // number of the hits with cached failures
+        uint32_t negative_hits;
+        // number of the replaced entries
+        uint32_t evictions;
+    };
+
+    /**
+     * Get cache counters.
+     *
+     * @param stats
+     */
+    void get_stats(stats_t &stats);
+
+    /**
+     * Reset cache counters.
+     */
+    void reset_stats();
+
+private:
+    struct entry_t {
+        char host[MAX_HOST_LEN + 1];
+        char ip_address[NSAPI_IP_SIZE];
+        nsapi_error_t result;
+        uint64_t expire_time;
+        uint32_t last_use;
+    };
+
+    PlatformMutex _mutex;
+    entry_t *_entries;
+    int _capacity;
+    int _ttl;
+    int _negative_ttl;
+    uint32_t _use_counter;
+    stats_t _stats;
+
+    entry_t *_find_entry(const char *host, uint64_t now);
+};
+}
+
+#endif // SIM5320_DNSCACHE_H
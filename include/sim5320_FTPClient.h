@@ -241,8 +241,8 @@ public:
      * If returned value is `0`, then transmission will be finished.
      *
      * @note
-     * This operation can be long and lock ATHandler object, so you cannot use other sim5320 functionality
-     * till end of this operation.
+     * This operation can be long, so ATHandler object is released for other threads between data chunks
+     * (see "sim5320-driver.ftp_lock_slice_time" option).
      *
      * @param path ftp file path
      * @param data_writer callback to provide data
@@ -321,6 +321,10 @@ private:
      * @return
      */
     nsapi_error_t _get_data_impl(const char *path, Callback<ssize_t(uint8_t *data, size_t size)> data_reader, const char *command);
+
+    // result code of the get/listdir transfer, that has been received while ATHandler has been released, or -1
+    volatile int _transfer_result;
+    void _urc_transfer_result();
 };
 }
 
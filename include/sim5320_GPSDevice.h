@@ -3,6 +3,7 @@
 
 #include "AT_CellularBase.h"
 #include "mbed.h"
+#include "sim5320_SettingsCache.h"
 
 namespace sim5320 {
 
@@ -11,7 +12,7 @@ namespace sim5320 {
  */
 class SIM5320GPSDevice : public AT_CellularBase, private NonCopyable<SIM5320GPSDevice> {
 public:
-    SIM5320GPSDevice(ATHandler &at);
+    SIM5320GPSDevice(ATHandler &at, SIM5320SettingsCache &settings_cache);
     virtual ~SIM5320GPSDevice();
 
     /**
@@ -90,6 +91,9 @@ protected:
     // GPS assist server settings
     const virtual char *get_assist_server_url();
     bool virtual use_assist_server_ssl();
+
+private:
+    SIM5320SettingsCache &_settings_cache;
 };
 }
 
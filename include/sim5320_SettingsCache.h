@@ -0,0 +1,90 @@
+#ifndef SIM5320_SETTINGSCACHE_H
+#define SIM5320_SETTINGSCACHE_H
+
+#include "ATHandler.h"
+#include "mbed.h"
+
+namespace sim5320 {
+
+/**
+ * Shadow copy of the modem settings.
+ *
+ * The cache remembers the last confirmed write command of each setting (AT command name before '='),
+ * so the same value isn't sent to modem again. The cache should be cleared, when modem settings
+ * can be changed without driver (modem reset, factory settings restoring, etc.).
+ */
+class SIM5320SettingsCache : private NonCopyable<SIM5320SettingsCache> {
+public:
+    SIM5320SettingsCache();
+    virtual ~SIM5320SettingsCache();
+
+    static const int MAX_SETTINGS = 16;
+
+    /**
+     * Send write command (like "AT+CIPMODE=0"), if the setting has another value.
+     *
+     * The command is sent with ATHandler::cmd_start/ATHandler::cmd_stop_read_resp,
+     * so AT handler should be locked by the caller.
+     *
+     * @param at AT handler
+     * @param cmd full write command
+     * @return 0 on success, otherwise non-zero value
+     */
+    nsapi_error_t write(ATHandler &at, const char *cmd);
+
+    /**
+     * Send several write commands with one command line (see ATCommandBatch). Commands with the same values are skipped.
+     *
+     * AT handler should be locked by the caller.
+     *
+     * @param at AT handler
+     * @param cmds full write commands
+     * @param count number of the commands
+     * @return 0 on success, otherwise error of the failed command
+     */
+    nsapi_error_t write(ATHandler &at, const char *const *cmds, int count);
+
+    /**
+     * Forget all settings.
+     */
+    void clear();
+
+    struct stats_t {
+        // number of the commands that has been sent to modem
+        uint32_t writes;
+        // number of the commands that has been skipped, as the setting has the same value
+        uint32_t skips;
+    };
+
+    /**
+     * Get cache counters.
+     *
+     * @param stats
+     */
+    void get_stats(stats_t &stats);
+
+    /**
+     * Reset cache counters.
+     */
+    void reset_stats();
+
+private:
+    struct entry_t {
+        uint32_t key_hash;
+        uint32_t value_hash;
+    };
+
+    PlatformMutex _mutex;
+    entry_t _entries[MAX_SETTINGS];
+    int _size;
+    stats_t _stats;
+
+    entry_t *_find_entry(uint32_t key_hash);
+    void _set_entry(uint32_t key_hash, uint32_t value_hash);
+    void _remove_entry(uint32_t key_hash);
+    static uint32_t _get_key_hash(const char *cmd);
+    static uint32_t _hash(const char *str, size_t len);
+};
+}
+
+#endif // SIM5320_SETTINGSCACHE_H
@@ -0,0 +1,34 @@
+#ifndef SIM5320_TCPSOCKET_H
+#define SIM5320_TCPSOCKET_H
+
+#include "mbed.h"
+#include "sim5320_CellularStack.h"
+
+namespace sim5320 {
+
+/**
+ * TCP socket with SIM5320 specific extensions.
+ *
+ * The socket should be opened with SIM5320 cellular context.
+ */
+class SIM5320TCPSocket : public TCPSocket {
+public:
+    SIM5320TCPSocket();
+    virtual ~SIM5320TCPSocket();
+
+    /**
+     * Send data of the several buffers without copying them into one buffer.
+     *
+     * See SIM5320CellularStack::socket_sendmsg for details.
+     *
+     * @note Unlike TCPSocket::send, the method doesn't wait connection establishment.
+     *
+     * @param iov data fragments
+     * @param iov_count number of the fragments
+     * @return number of the sent bytes or negative error code
+     */
+    nsapi_size_or_error_t sendmsg(const SIM5320CellularStack::iovec_t *iov, int iov_count);
+};
+}
+
+#endif // SIM5320_TCPSOCKET_H
@@ -0,0 +1,44 @@
+#ifndef SIM5320_UDPSOCKET_H
+#define SIM5320_UDPSOCKET_H
+
+#include "mbed.h"
+#include "sim5320_CellularStack.h"
+
+namespace sim5320 {
+
+/**
+ * UDP socket with SIM5320 specific extensions.
+ *
+ * The socket should be opened with SIM5320 cellular context.
+ */
+class SIM5320UDPSocket : public UDPSocket {
+public:
+    SIM5320UDPSocket();
+    virtual ~SIM5320UDPSocket();
+
+    /**
+     * Send several datagrams under one AT interface lock.
+     *
+     * See SIM5320CellularStack::socket_sendto_batch for details.
+     *
+     * @param datagrams datagrams, the @c result field of each datagram is set by the method
+     * @param count number of the datagrams
+     * @return number of the sent datagrams or negative error code
+     */
+    nsapi_size_or_error_t sendto_batch(SIM5320CellularStack::udp_datagram_t *datagrams, int count);
+
+    /**
+     * Send datagram that consists of several fragments without copying them into one buffer.
+     *
+     * See SIM5320CellularStack::socket_sendmsg for details.
+     *
+     * @param address destination address
+     * @param iov data fragments
+     * @param iov_count number of the fragments
+     * @return number of the sent bytes or negative error code
+     */
+    nsapi_size_or_error_t sendmsg(const SocketAddress &address, const SIM5320CellularStack::iovec_t *iov, int iov_count);
+};
+}
+
+#endif // SIM5320_UDPSOCKET_H
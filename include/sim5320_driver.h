@@ -2,7 +2,10 @@
 #define SIM5320_DRIVER_H
 
 #include "mbed.h"
+#include "sim5320_ATScheduler.h"
+#include "sim5320_CMUX.h"
 #include "sim5320_CellularDevice.h"
+#include "sim5320_CellularStack.h"
 #include "sim5320_FTPClient.h"
 #include "sim5320_GPSDevice.h"
 
@@ -32,6 +35,16 @@ public:
      * @param rst hardware reset pin
      */
     SIM5320(PinName tx, PinName rx, PinName rts = NC, PinName cts = NC, PinName rst = NC);
+    /**
+     * Constructor.
+     *
+     * It allows to use arbitrary file handle instead of the UART (for example @c SIM5320ModemEmulator from the emulator test).
+     * UART configuration methods aren't available in this case.
+     *
+     * @param fh file handle of the modem AT interface
+     * @param rst hardware reset pin
+     */
+    SIM5320(FileHandle *fh, PinName rst = NC);
 
 private:
     /**
@@ -56,6 +69,69 @@ public:
      */
     nsapi_error_t stop_uart_hw_flow_ctrl();
 
+    /**
+     * Set UART baudrate of the board and SIM5320.
+     *
+     * The modem baudrate is changed with AT+IPR command and it's checked with AT command. If modem doesn't respond
+     * with new baudrate, then previous one is restored. The baudrate is restored automatically after reset.
+     *
+     * If baudrate isn't less than "sim5320-driver.uart_hw_flow_ctrl_baudrate" and RTS/CTS pins are set,
+     * hardware flow control is enabled automatically.
+     *
+     * @param baudrate
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t set_uart_baudrate(int baudrate);
+
+    /**
+     * Get current UART baudrate.
+     *
+     * @return
+     */
+    int get_uart_baudrate() const;
+
+    /**
+     * Switch modem interface into GSM 07.10 multiplexer mode.
+     *
+     * The multiplexer provides 3 virtual channels:
+     *
+     * 1. device, information, network and sms interfaces
+     * 2. cellular context (network stack)
+     * 3. gps and ftp client
+     *
+     * So long operations of the one interface (for example FTP transfer) don't block other ones.
+     *
+     * The method can be invoked only when module is stopped (see @c request_to_start/request_to_stop).
+     * The multiplexer is restored automatically after reset.
+     *
+     * @warning
+     * Cellular context, gps and ftp client objects are recreated, so pointers that have been received before
+     * with @c get_context, @c get_gps and @c get_ftp_client become invalid.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t start_cmux();
+
+    /**
+     * Close multiplexer and switch modem interface into AT command mode.
+     *
+     * The method can be invoked only when module is stopped (see @c request_to_start/request_to_stop).
+     *
+     * @warning
+     * Cellular context, gps and ftp client objects are recreated, so pointers that have been received before
+     * with @c get_context, @c get_gps and @c get_ftp_client become invalid.
+     *
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t stop_cmux();
+
+    /**
+     * Check if multiplexer mode is used.
+     *
+     * @return
+     */
+    bool is_cmux_enabled() const;
+
     /**
      * Initialize device.
      *
@@ -177,15 +253,53 @@ public:
      */
     SIM5320FTPClient *get_ftp_client();
 
+    /**
+     * Get performance counters of the socket link.
+     *
+     * See SIM5320CellularStack::get_socket_stats for details.
+     *
+     * @param link_id link (socket) id
+     * @param stats
+     * @return 0 on success, non-zero on failure
+     */
+    nsapi_error_t get_socket_stats(int link_id, SIM5320CellularStack::socket_stats_t &stats);
+
+    /**
+     * Reset performance counters of the socket links.
+     */
+    void reset_socket_stats();
+
+    /**
+     * Get queueing delay counters of the AT command priority class.
+     *
+     * See SIM5320ATScheduler for details.
+     *
+     * @param priority priority class
+     * @param stats
+     */
+    void get_at_scheduler_stats(SIM5320ATScheduler::PriorityClass priority, SIM5320ATScheduler::stats_t &stats);
+
+    /**
+     * Reset queueing delay counters of the AT commands.
+     */
+    void reset_at_scheduler_stats();
+
 private:
     PinName _rts;
     PinName _cts;
     UARTSerial *_serial_ptr;
     bool _cleanup_uart;
+    FileHandle *_fh;
 
     PinName _rst;
     DigitalOut *_rst_out_ptr;
 
+    // current UART baudrate and the baudrate that should be restored after reset
+    int _uart_baudrate;
+    int _target_uart_baudrate;
+    // hardware flow control is enabled by baudrate negotiation
+    bool _uart_auto_flow_ctrl;
+
     SIM5320CellularDevice *_device;
     CellularInformation *_information;
     CellularNetwork *_network;
@@ -197,10 +311,24 @@ private:
     int _startup_request_count;
     ATHandler *_at;
 
+    // multiplexer or NULL if it isn't used
+    SIM5320CMUX *_cmux;
+
     static const int _STARTUP_TIMEOUT_MS = 32000;
     nsapi_error_t _reset_soft();
     nsapi_error_t _reset_hard();
     nsapi_error_t _skip_initialization_messages();
+
+    void _set_host_uart_baudrate(int baudrate);
+    nsapi_error_t _check_uart();
+    nsapi_error_t _probe_uart_baudrate();
+    nsapi_error_t _change_uart_baudrate(int baudrate);
+    void _reset_uart_settings();
+
+    void _open_subsystems(FileHandle *context_fh, FileHandle *aux_fh);
+    void _close_subsystems();
+    nsapi_error_t _open_cmux();
+    void _detach_cmux();
 };
 }
 
@@ -3,6 +3,7 @@
 #include "ATHandler.h"
 #include "CellularLog.h"
 #include "mbed.h"
+#include "sim5320_ATScheduler.h"
 #include "stdarg.h"
 namespace sim5320 {
 
@@ -71,12 +72,77 @@ int read_full_fuzzy_response(ATHandler &at, bool wait_response_after_ok, bool wa
  */
 int vread_full_fuzzy_response(ATHandler &at, bool wait_response_after_ok, bool wait_response_after_error, const char *prefix, const char *format_string, va_list arg);
 
+/**
+ * Simple byte ring buffer with a dynamically allocated storage.
+ */
+class ByteRingBuffer : private NonCopyable<ByteRingBuffer> {
+public:
+    ByteRingBuffer(size_t capacity);
+    ~ByteRingBuffer();
+
+    /**
+     * Put data into buffer.
+     *
+     * @param data
+     * @param len
+     * @return number of the bytes that has been put into buffer
+     */
+    size_t push(const uint8_t *data, size_t len);
+
+    /**
+     * Get data from buffer.
+     *
+     * @param data destination buffer or @c NULL to drop data
+     * @param len
+     * @return number of the bytes that has been taken from buffer
+     */
+    size_t pop(uint8_t *data, size_t len);
+
+    /**
+     * Get number of the bytes in the buffer.
+     *
+     * @return
+     */
+    size_t size() const;
+
+    /**
+     * Get number of the bytes that can be put into buffer.
+     *
+     * @return
+     */
+    size_t free_space() const;
+
+    /**
+     * Remove all data from the buffer.
+     */
+    void clear();
+
+private:
+    uint8_t *_buf;
+    size_t _capacity;
+    size_t _start;
+    size_t _size;
+};
+
 /**
  * Helper object to lock @c ATHandler object using RAII approach.
+ *
+ * Long operations (like file transfer) can share handler with other threads using @c yield and @c pause methods
+ * between data chunks.
  */
 class ATHandlerLocker {
 public:
     ATHandlerLocker(ATHandler &at, int timeout = -1);
+
+    /**
+     * Lock handler in the order of the driver @c SIM5320ATScheduler.
+     *
+     * @param at
+     * @param priority priority class of the operation
+     * @param timeout handler timeout or -1 to use current timeout
+     * @param deadline maximal queueing delay or -1 to use default deadline of the priority class
+     */
+    ATHandlerLocker(ATHandler &at, SIM5320ATScheduler::PriorityClass priority, int timeout = -1, int deadline = -1);
     ~ATHandlerLocker();
 
     /**
@@ -86,10 +152,106 @@ public:
      */
     void reset_timeout();
 
+    /**
+     * Release handler for other threads, if it has been held longer than @p slice_time, and acquire it again.
+     *
+     * If other threads wait handler, they get it before the current thread (if the locker uses scheduler,
+     * then only threads with higher or the same priority class do it). Handler timeout is reset in any case.
+     *
+     * @note the operation clear handler errors.
+     * @note if the current thread has locked handler several times, then handler isn't available for other threads.
+     *
+     * @param slice_time maximal time of the handler holding in milliseconds
+     * @return @c true if handler has been released
+     */
+    bool yield(int slice_time);
+
+    /**
+     * Release handler for @p time_ms milliseconds, so other threads can use it during waiting, and acquire it again.
+     *
+     * @note the operation clear handler errors.
+     *
+     * @param time_ms
+     */
+    void pause(int time_ms);
+
 private:
     ATHandler &_at;
     int _timeout;
-    int _lock_count;
+    // time when handler has been acquired
+    uint64_t _lock_time;
+    bool _scheduled;
+    SIM5320ATScheduler::PriorityClass _priority;
+    int _deadline;
+    // it's true if the scheduler has granted turn to the locker
+    bool _granted;
+
+    void _acquire();
+    void _release();
+};
+
+/**
+ * Builder of the AT command line with several commands ("AT+CMD1=1;+CMD2=2").
+ *
+ * Commands are joined with ';' and they are sent as one line, so they require one round trip instead of one per command.
+ * Modem executes commands of the line one by one until first error, but it returns one final result for the whole line,
+ * so commands of the failed line are repeated one per line to find the failed command.
+ *
+ * @note only idempotent commands without information response (like write commands) can be batched.
+ */
+class ATCommandBatch : private NonCopyable<ATCommandBatch> {
+public:
+    ATCommandBatch(ATHandler &at);
+
+    // maximal length of the command line
+    static const size_t MAX_LINE_LEN = 255;
+    // maximal number of the commands in the line
+    static const int MAX_COMMANDS = 16;
+
+    /**
+     * Add command to the batch.
+     *
+     * If the command doesn't fit into the line, the accumulated commands are sent at first.
+     * AT handler should be locked by the caller.
+     *
+     * @param cmd full command with "AT" prefix ("AT+CMD=1")
+     * @return 0 on success, @c NSAPI_ERROR_PARAMETER if the command has no "AT" prefix or it's too long,
+     *         otherwise error of the accumulated commands
+     */
+    nsapi_error_t add(const char *cmd);
+
+    /**
+     * Send accumulated commands.
+     *
+     * If the line with several commands is rejected by the modem, then the commands are repeated one per line
+     * till the first failed one to find it, so only idempotent commands (settings) should be batched.
+     *
+     * AT handler should be locked by the caller.
+     *
+     * @return 0 on success, otherwise error of the failed command
+     */
+    nsapi_error_t send();
+
+    /**
+     * Get index of the failed command.
+     *
+     * The index is counted from the first command added to the batch (including commands of the previous lines),
+     * and it's updated by each @c send invocation. The commands after the failed one aren't executed.
+     *
+     * @return command index or -1 if there is no failed command or it's unknown (for example, in case of timeout)
+     */
+    int get_failed_index() const;
+
+private:
+    ATHandler &_at;
+    char _line[MAX_LINE_LEN + 1];
+    size_t _line_len;
+    // offsets of the commands in the line (without "AT" prefix and ';' separator)
+    size_t _cmd_offsets[MAX_COMMANDS];
+    int _cmd_num;
+    // number of the commands that has been sent before current line
+    int _sent_cmd_num;
+    int _failed_index;
 };
 }
 #endif // SIM5320_UTILS_H
@@ -0,0 +1,261 @@
+#include "sim5320_ATScheduler.h"
+#include "platform/SingletonPtr.h"
+#include "string.h"
+
+using namespace sim5320;
+
+#ifdef MBED_CONF_SIM5320_DRIVER_AT_SCHEDULER_INTERACTIVE_DEADLINE
+#define AT_SCHEDULER_INTERACTIVE_DEADLINE MBED_CONF_SIM5320_DRIVER_AT_SCHEDULER_INTERACTIVE_DEADLINE
+#else
+#define AT_SCHEDULER_INTERACTIVE_DEADLINE 200
+#endif
+
+#ifdef MBED_CONF_SIM5320_DRIVER_AT_SCHEDULER_DATA_DEADLINE
+#define AT_SCHEDULER_DATA_DEADLINE MBED_CONF_SIM5320_DRIVER_AT_SCHEDULER_DATA_DEADLINE
+#else
+#define AT_SCHEDULER_DATA_DEADLINE 1000
+#endif
+
+#ifdef MBED_CONF_SIM5320_DRIVER_AT_SCHEDULER_BACKGROUND_DEADLINE
+#define AT_SCHEDULER_BACKGROUND_DEADLINE MBED_CONF_SIM5320_DRIVER_AT_SCHEDULER_BACKGROUND_DEADLINE
+#else
+#define AT_SCHEDULER_BACKGROUND_DEADLINE 30000
+#endif
+
+static SingletonPtr<SIM5320ATScheduler> driver_scheduler;
+
+SIM5320ATScheduler::SIM5320ATScheduler()
+    : _cond(_mutex)
+{
+    memset(_lanes, 0, sizeof(_lanes));
+    _default_deadlines[PRIORITY_INTERACTIVE] = AT_SCHEDULER_INTERACTIVE_DEADLINE;
+    _default_deadlines[PRIORITY_DATA] = AT_SCHEDULER_DATA_DEADLINE;
+    _default_deadlines[PRIORITY_BACKGROUND] = AT_SCHEDULER_BACKGROUND_DEADLINE;
+    reset_stats();
+}
+
+SIM5320ATScheduler::~SIM5320ATScheduler()
+{
+}
+
+SIM5320ATScheduler *SIM5320ATScheduler::get_instance()
+{
+    return driver_scheduler.get();
+}
+
+bool SIM5320ATScheduler::acquire(ATHandler &at, SIM5320ATScheduler::PriorityClass priority, int deadline)
+{
+    osThreadId_t thread_id = rtos::ThisThread::get_id();
+    _mutex.lock();
+    if (deadline < 0) {
+        deadline = _default_deadlines[priority];
+    }
+    lane_t *lane = _find_lane(&at, true);
+    if (!lane) {
+        _mutex.unlock();
+        return false;
+    }
+    if (lane->owner == thread_id) {
+        lane->depth++;
+        _mutex.unlock();
+        return true;
+    }
+    if (lane->direct_owner == thread_id) {
+        // the thread holds handler mutex, so other operations cannot use handler anyway
+        _mutex.unlock();
+        return false;
+    }
+
+    uint64_t start_time = rtos::Kernel::get_ms_count();
+    uint64_t now = start_time;
+    waiter_t waiter;
+    waiter.priority = priority;
+    waiter.deadline = start_time + deadline;
+    _add_waiter(lane, &waiter);
+
+    bool granted = true;
+    bool queued = false;
+    while (lane->owner || _select_waiter(lane) != &waiter) {
+        if (now >= waiter.deadline) {
+            // stop waiting and let handler mutex resolve access
+            granted = false;
+            break;
+        }
+        queued = true;
+        _cond.wait_for(waiter.deadline - now);
+        now = rtos::Kernel::get_ms_count();
+    }
+    _remove_waiter(lane, &waiter);
+    if (granted) {
+        lane->owner = thread_id;
+        lane->depth = 1;
+    } else {
+        // other waiters can be next now
+        _cond.notify_all();
+        _free_lane_if_idle(lane);
+    }
+
+    uint32_t delay = now - start_time;
+    stats_t &stats = _stats[priority];
+    stats.requests++;
+    if (queued) {
+        stats.queued++;
+    }
+    if (now >= waiter.deadline && deadline > 0) {
+        stats.deadline_misses++;
+    }
+    stats.total_delay += delay;
+    if (delay > stats.max_delay) {
+        stats.max_delay = delay;
+    }
+    _mutex.unlock();
+    return granted;
+}
+
+void SIM5320ATScheduler::release(ATHandler &at)
+{
+    osThreadId_t thread_id = rtos::ThisThread::get_id();
+    _mutex.lock();
+    lane_t *lane = _find_lane(&at, false);
+    if (lane && lane->owner == thread_id) {
+        lane->depth--;
+        if (lane->depth <= 0) {
+            lane->owner = NULL;
+            lane->depth = 0;
+            if (lane->waiters) {
+                _cond.notify_all();
+            } else {
+                _free_lane_if_idle(lane);
+            }
+        }
+    }
+    _mutex.unlock();
+}
+
+void SIM5320ATScheduler::direct_lock(ATHandler &at)
+{
+    osThreadId_t thread_id = rtos::ThisThread::get_id();
+    _mutex.lock();
+    lane_t *lane = _find_lane(&at, true);
+    if (lane) {
+        // note: handler mutex is held, so other thread cannot be direct owner
+        lane->direct_owner = thread_id;
+        lane->direct_depth++;
+    }
+    _mutex.unlock();
+}
+
+void SIM5320ATScheduler::direct_unlock(ATHandler &at)
+{
+    osThreadId_t thread_id = rtos::ThisThread::get_id();
+    _mutex.lock();
+    lane_t *lane = _find_lane(&at, false);
+    if (lane && lane->direct_owner == thread_id) {
+        lane->direct_depth--;
+        if (lane->direct_depth <= 0) {
+            lane->direct_owner = NULL;
+            lane->direct_depth = 0;
+            _free_lane_if_idle(lane);
+        }
+    }
+    _mutex.unlock();
+}
+
+void SIM5320ATScheduler::forget(ATHandler &at)
+{
+    _mutex.lock();
+    lane_t *lane = _find_lane(&at, false);
+    if (lane) {
+        _free_lane_if_idle(lane);
+    }
+    _mutex.unlock();
+}
+
+void SIM5320ATScheduler::set_default_deadline(SIM5320ATScheduler::PriorityClass priority, int deadline)
+{
+    _mutex.lock();
+    _default_deadlines[priority] = deadline > 0 ? deadline : 0;
+    _mutex.unlock();
+}
+
+int SIM5320ATScheduler::get_default_deadline(SIM5320ATScheduler::PriorityClass priority) const
+{
+    return _default_deadlines[priority];
+}
+
+void SIM5320ATScheduler::get_stats(SIM5320ATScheduler::PriorityClass priority, SIM5320ATScheduler::stats_t &stats)
+{
+    _mutex.lock();
+    stats = _stats[priority];
+    _mutex.unlock();
+}
+
+void SIM5320ATScheduler::reset_stats()
+{
+    _mutex.lock();
+    memset(_stats, 0, sizeof(_stats));
+    _mutex.unlock();
+}
+
+SIM5320ATScheduler::lane_t *SIM5320ATScheduler::_find_lane(ATHandler *at, bool create)
+{
+    lane_t *free_lane = NULL;
+    for (int i = 0; i < MAX_HANDLERS; i++) {
+        if (_lanes[i].at == at) {
+            return &_lanes[i];
+        }
+        if (!_lanes[i].at && !free_lane) {
+            free_lane = &_lanes[i];
+        }
+    }
+    if (!create || !free_lane) {
+        return NULL;
+    }
+    // lanes exist only while handler is used, so lanes of the deleted handlers aren't kept
+    free_lane->at = at;
+    free_lane->owner = NULL;
+    free_lane->depth = 0;
+    free_lane->direct_owner = NULL;
+    free_lane->direct_depth = 0;
+    free_lane->waiters = NULL;
+    return free_lane;
+}
+
+void SIM5320ATScheduler::_free_lane_if_idle(SIM5320ATScheduler::lane_t *lane)
+{
+    if (!lane->owner && !lane->direct_owner && !lane->waiters) {
+        lane->at = NULL;
+    }
+}
+
+void SIM5320ATScheduler::_add_waiter(SIM5320ATScheduler::lane_t *lane, SIM5320ATScheduler::waiter_t *waiter)
+{
+    waiter->next = NULL;
+    waiter_t **last_ptr = &lane->waiters;
+    while (*last_ptr) {
+        last_ptr = &(*last_ptr)->next;
+    }
+    *last_ptr = waiter;
+}
+
+void SIM5320ATScheduler::_remove_waiter(SIM5320ATScheduler::lane_t *lane, SIM5320ATScheduler::waiter_t *waiter)
+{
+    for (waiter_t **waiter_ptr = &lane->waiters; *waiter_ptr; waiter_ptr = &(*waiter_ptr)->next) {
+        if (*waiter_ptr == waiter) {
+            *waiter_ptr = waiter->next;
+            break;
+        }
+    }
+}
+
+SIM5320ATScheduler::waiter_t *SIM5320ATScheduler::_select_waiter(SIM5320ATScheduler::lane_t *lane)
+{
+    // the best priority class, then the earliest deadline, then the first submitted
+    waiter_t *best = lane->waiters;
+    for (waiter_t *waiter = best ? best->next : NULL; waiter; waiter = waiter->next) {
+        if (waiter->priority < best->priority || (waiter->priority == best->priority && waiter->deadline < best->deadline)) {
+            best = waiter;
+        }
+    }
+    return best;
+}
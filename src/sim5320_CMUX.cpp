@@ -0,0 +1,585 @@
+#include "sim5320_CMUX.h"
+#include "string.h"
+
+using namespace sim5320;
+
+#define CMUX_FLAG 0xF9
+// timeout of the SABM/DISC response
+#define CMUX_RESPONSE_TIMEOUT 1000
+// number of the SABM/DISC attempts
+#define CMUX_COMMAND_ATTEMPTS 3
+// maximal time of the waiting physical interface write availability
+#define CMUX_WRITE_TIMEOUT 1000
+// maximal time of the waiting channel data before the channel state check
+#define CMUX_READ_WAIT_TIMEOUT 1000
+
+// control channel messages (type field with EA bit)
+#define CMUX_MSG_CR 0x02
+#define CMUX_MSG_MSC 0xE1
+#define CMUX_MSG_CLD 0xC1
+// V.24 signals of the MSC message: EA, RTC, RTR, DV
+#define CMUX_MSC_SIGNALS 0x8D
+
+// multiplexer events
+// physical interface has new data
+#define CMUX_EVENT_INPUT 0x01
+// physical interface has free space
+#define CMUX_EVENT_OUTPUT 0x02
+// UA or DM response has been received
+#define CMUX_EVENT_RESPONSE 0x04
+// virtual channel has new data
+#define CMUX_EVENT_CHANNEL(dlci) (0x04 << (dlci))
+// multiplexer has been closed or detached
+#define CMUX_EVENT_ABORT 0x100
+
+static uint8_t cmux_fcs(const uint8_t *data, size_t len)
+{
+    // reversed CRC-8 with polynomial x^8 + x^2 + x + 1
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x01) ? (crc >> 1) ^ 0xE0 : crc >> 1;
+        }
+    }
+    return 0xFF - crc;
+}
+
+/**
+ * Frame encoding/decoding
+ */
+
+size_t SIM5320CMUX::encode_frame(uint8_t *buf, int dlci, bool cr, uint8_t control, const uint8_t *data, size_t len)
+{
+    size_t pos = 0;
+    buf[pos++] = CMUX_FLAG;
+    buf[pos++] = (dlci << 2) | (cr ? 0x02 : 0x00) | 0x01;
+    buf[pos++] = control;
+    if (len <= 127) {
+        buf[pos++] = (len << 1) | 0x01;
+    } else {
+        buf[pos++] = (len & 0x7F) << 1;
+        buf[pos++] = len >> 7;
+    }
+    // note: check sequence of the UIH frame doesn't cover information field
+    uint8_t fcs = cmux_fcs(buf + 1, pos - 1);
+    if (len > 0) {
+        memcpy(buf + pos, data, len);
+        pos += len;
+    }
+    buf[pos++] = fcs;
+    buf[pos++] = CMUX_FLAG;
+    return pos;
+}
+
+SIM5320CMUX::FrameParser::FrameParser()
+    : dlci(0)
+    , cr(false)
+    , control(0)
+    , len(0)
+    , fcs_errors(0)
+{
+    reset();
+}
+
+void SIM5320CMUX::FrameParser::reset()
+{
+    _state = STATE_FLAG;
+    _header_len = 0;
+    _data_pos = 0;
+    _fcs = 0;
+}
+
+bool SIM5320CMUX::FrameParser::push(uint8_t sym)
+{
+    switch (_state) {
+    case STATE_FLAG:
+        if (sym == CMUX_FLAG) {
+            _state = STATE_ADDRESS;
+        }
+        break;
+    case STATE_ADDRESS:
+        if (sym == CMUX_FLAG) {
+            // several flags between frames
+            break;
+        }
+        if (!(sym & 0x01)) {
+            // extended address isn't supported
+            _state = STATE_FLAG;
+            break;
+        }
+        _header[0] = sym;
+        _header_len = 1;
+        _state = STATE_CONTROL;
+        break;
+    case STATE_CONTROL:
+        _header[_header_len++] = sym;
+        _state = STATE_LENGTH;
+        break;
+    case STATE_LENGTH:
+    case STATE_LENGTH_2:
+        _header[_header_len++] = sym;
+        if (_state == STATE_LENGTH) {
+            len = sym >> 1;
+            if (!(sym & 0x01)) {
+                _state = STATE_LENGTH_2;
+                break;
+            }
+        } else {
+            len |= (size_t)sym << 7;
+        }
+        if (len > MAX_FRAME_DATA_SIZE) {
+            // frame is too long
+            _state = STATE_FLAG;
+            break;
+        }
+        _data_pos = 0;
+        _state = len > 0 ? STATE_DATA : STATE_FCS;
+        break;
+    case STATE_DATA:
+        data[_data_pos++] = sym;
+        if (_data_pos >= len) {
+            _state = STATE_FCS;
+        }
+        break;
+    case STATE_FCS:
+        _fcs = sym;
+        _state = STATE_END_FLAG;
+        break;
+    case STATE_END_FLAG:
+        if (sym != CMUX_FLAG) {
+            _state = STATE_FLAG;
+            break;
+        }
+        // closing flag can be opening flag of the next frame
+        _state = STATE_ADDRESS;
+        if (cmux_fcs(_header, _header_len) != _fcs) {
+            fcs_errors++;
+            break;
+        }
+        dlci = _header[0] >> 2;
+        cr = (_header[0] & 0x02) != 0;
+        control = _header[1];
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Virtual channel
+ */
+
+SIM5320CMUX::Channel::Channel()
+    : _mux(NULL)
+    , _dlci(0)
+    , _opened(false)
+    , _blocking(true)
+    , _rx_buf(CHANNEL_BUFFER_SIZE)
+{
+}
+
+SIM5320CMUX::Channel::~Channel()
+{
+}
+
+ssize_t SIM5320CMUX::Channel::read(void *buffer, size_t size)
+{
+    while (true) {
+        _mux->_process_input();
+        _mux->_mutex.lock();
+        size_t len = _rx_buf.pop((uint8_t *)buffer, size);
+        _mux->_mutex.unlock();
+
+        if (len > 0) {
+            return len;
+        } else if (!_blocking) {
+            return -EAGAIN;
+        } else if (!_opened || _mux->_aborted) {
+            return -EIO;
+        }
+        // wait data of the channel or new physical input, as it isn't processed, if event queue thread is blocked
+        // note: the wait is limited, so the channel closing by the modem is detected too
+        _mux->_wait_events(CMUX_EVENT_CHANNEL(_dlci) | CMUX_EVENT_INPUT, CMUX_READ_WAIT_TIMEOUT);
+    }
+}
+
+ssize_t SIM5320CMUX::Channel::write(const void *buffer, size_t size)
+{
+    return _mux->_write_channel(_dlci, buffer, size);
+}
+
+off_t SIM5320CMUX::Channel::seek(off_t offset, int whence)
+{
+    return -ESPIPE;
+}
+
+int SIM5320CMUX::Channel::close()
+{
+    return 0;
+}
+
+int SIM5320CMUX::Channel::set_blocking(bool blocking)
+{
+    _blocking = blocking;
+    return 0;
+}
+
+bool SIM5320CMUX::Channel::is_blocking() const
+{
+    return _blocking;
+}
+
+short SIM5320CMUX::Channel::poll(short events) const
+{
+    short revents = POLLOUT;
+    _mux->_process_input();
+    _mux->_mutex.lock();
+    if (_rx_buf.size() > 0) {
+        revents |= POLLIN;
+    }
+    _mux->_mutex.unlock();
+    return revents & events;
+}
+
+void SIM5320CMUX::Channel::sigio(Callback<void()> func)
+{
+    _mux->_mutex.lock();
+    _sigio_cb = func;
+    bool has_data = _rx_buf.size() > 0;
+    _mux->_mutex.unlock();
+    // notify about pending data
+    if (func && has_data) {
+        func();
+    }
+}
+
+/**
+ * Multiplexer
+ */
+
+SIM5320CMUX::SIM5320CMUX(FileHandle *fh, events::EventQueue *queue)
+    : _fh(fh)
+    , _queue(queue)
+    , _input_event_pending(false)
+    , _aborted(false)
+    , _opened(false)
+    , _channel_num(0)
+{
+    for (int i = 0; i < MAX_CHANNELS; i++) {
+        _channels[i]._mux = this;
+        _channels[i]._dlci = i + 1;
+    }
+    memset(_responses, 0, sizeof(_responses));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+SIM5320CMUX::~SIM5320CMUX()
+{
+    detach();
+}
+
+nsapi_error_t SIM5320CMUX::open(int channel_num)
+{
+    nsapi_error_t err;
+    if (channel_num < 1 || channel_num > MAX_CHANNELS) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    if (_opened) {
+        return NSAPI_ERROR_OK;
+    }
+
+    _mutex.lock();
+    _parser.reset();
+    _aborted = false;
+    _events.clear(CMUX_EVENT_ABORT);
+    _channel_num = channel_num;
+    for (int i = 0; i < MAX_CHANNELS; i++) {
+        _channels[i]._opened = false;
+        _channels[i]._rx_buf.clear();
+    }
+    _mutex.unlock();
+    _fh->set_blocking(false);
+    _fh->sigio(callback(this, &SIM5320CMUX::_sigio_handler));
+
+    // open control channel
+    if ((err = _send_command(0, FRAME_SABM))) {
+        tr_debug("CMUX control channel opening error: %d", err);
+        detach();
+        return err;
+    }
+    // open virtual channels
+    for (int dlci = 1; dlci <= channel_num; dlci++) {
+        if ((err = _send_command(dlci, FRAME_SABM))) {
+            tr_debug("CMUX channel %d opening error: %d", dlci, err);
+            close();
+            return err;
+        }
+        _channels[dlci - 1]._opened = true;
+        // notify modem that terminal is ready for data
+        uint8_t msc[] = { CMUX_MSG_MSC | CMUX_MSG_CR, (2 << 1) | 0x01, (uint8_t)((dlci << 2) | 0x03), CMUX_MSC_SIGNALS };
+        _write_frame(0, true, FRAME_UIH, msc, sizeof(msc));
+    }
+    _opened = true;
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t SIM5320CMUX::close()
+{
+    // close virtual channels
+    for (int dlci = _channel_num; dlci >= 1; dlci--) {
+        if (_channels[dlci - 1]._opened) {
+            _send_command(dlci, FRAME_DISC);
+            _channels[dlci - 1]._opened = false;
+        }
+    }
+    // close multiplexer
+    nsapi_error_t err = _send_command(0, FRAME_DISC);
+    detach();
+    return err;
+}
+
+void SIM5320CMUX::detach()
+{
+    _fh->sigio(NULL);
+    _mutex.lock();
+    _opened = false;
+    // interrupt blocking operations
+    _aborted = true;
+    _events.set(CMUX_EVENT_ABORT);
+    for (int i = 0; i < MAX_CHANNELS; i++) {
+        _channels[i]._opened = false;
+        _channels[i]._rx_buf.clear();
+    }
+    _mutex.unlock();
+}
+
+bool SIM5320CMUX::is_opened() const
+{
+    return _opened;
+}
+
+FileHandle *SIM5320CMUX::get_channel(int dlci)
+{
+    if (dlci < 1 || dlci > MAX_CHANNELS) {
+        return NULL;
+    }
+    return &_channels[dlci - 1];
+}
+
+void SIM5320CMUX::get_stats(SIM5320CMUX::stats_t &stats)
+{
+    _mutex.lock();
+    _write_mutex.lock();
+    stats = _stats;
+    stats.fcs_errors = _parser.fcs_errors;
+    _write_mutex.unlock();
+    _mutex.unlock();
+}
+
+void SIM5320CMUX::_sigio_handler()
+{
+    // note: it can be invoked from interrupt context, so input is processed by event queue
+    // note: notification doesn't show if data has been received or output space has been freed
+    _events.set(CMUX_EVENT_INPUT | CMUX_EVENT_OUTPUT);
+    if (!_input_event_pending) {
+        _input_event_pending = true;
+        _queue->call(callback(this, &SIM5320CMUX::_input_event_handler));
+    }
+}
+
+void SIM5320CMUX::_wait_events(uint32_t flags, uint32_t timeout)
+{
+    _events.wait_any(flags | CMUX_EVENT_ABORT, timeout);
+    if (_aborted) {
+        // abort event can be cleared by the wait, so restore it for other threads
+        _events.set(CMUX_EVENT_ABORT);
+    }
+}
+
+void SIM5320CMUX::_input_event_handler()
+{
+    _input_event_pending = false;
+    _process_input();
+}
+
+void SIM5320CMUX::_process_input()
+{
+    uint8_t buf[64];
+    ssize_t len;
+    uint32_t notify_mask = 0;
+
+    _mutex.lock();
+    while ((len = _fh->read(buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < len; i++) {
+            if (!_parser.push(buf[i])) {
+                continue;
+            }
+            _stats.rx_frames++;
+            int dlci = _parser.dlci;
+            if (dlci > 0 && dlci <= _channel_num && (_parser.control & ~FRAME_PF) == FRAME_UIH) {
+                Channel *channel = &_channels[dlci - 1];
+                size_t pushed = channel->_rx_buf.push(_parser.data, _parser.len);
+                _stats.overrun_bytes += _parser.len - pushed;
+                notify_mask |= 1 << dlci;
+            } else {
+                _process_frame();
+            }
+        }
+    }
+    _mutex.unlock();
+
+    // notify channels outside of the lock, as handlers can read data
+    for (int dlci = 1; dlci <= MAX_CHANNELS; dlci++) {
+        if (notify_mask & (1 << dlci)) {
+            _events.set(CMUX_EVENT_CHANNEL(dlci));
+            Callback<void()> cb = _channels[dlci - 1]._sigio_cb;
+            if (cb) {
+                cb();
+            }
+        }
+    }
+}
+
+void SIM5320CMUX::_process_frame()
+{
+    int dlci = _parser.dlci;
+    uint8_t frame_type = _parser.control & ~FRAME_PF;
+    switch (frame_type) {
+    case FRAME_UA:
+    case FRAME_DM:
+        if (dlci <= MAX_CHANNELS) {
+            _responses[dlci] = frame_type;
+            _events.set(CMUX_EVENT_RESPONSE);
+        }
+        break;
+    case FRAME_UIH:
+        if (dlci == 0) {
+            _process_control_message();
+        }
+        break;
+    case FRAME_DISC:
+        // modem closes channel
+        _write_frame(dlci, false, FRAME_UA | FRAME_PF, NULL, 0);
+        if (dlci == 0) {
+            _opened = false;
+        } else if (dlci <= MAX_CHANNELS) {
+            _channels[dlci - 1]._opened = false;
+        }
+        break;
+    case FRAME_SABM:
+        // modem can't open channels
+        _write_frame(dlci, false, FRAME_DM | FRAME_PF, NULL, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+void SIM5320CMUX::_process_control_message()
+{
+    if (_parser.len < 2) {
+        return;
+    }
+    uint8_t msg_type = _parser.data[0];
+    if (!(msg_type & CMUX_MSG_CR)) {
+        // response to our message
+        return;
+    }
+    if ((msg_type & ~CMUX_MSG_CR) == CMUX_MSG_CLD) {
+        _opened = false;
+    }
+    // confirm modem command with the same message (MSC, CLD, etc.)
+    _parser.data[0] = msg_type & ~CMUX_MSG_CR;
+    _write_frame(0, false, FRAME_UIH, _parser.data, _parser.len);
+}
+
+int SIM5320CMUX::_write_frame(int dlci, bool cr, uint8_t control, const uint8_t *data, size_t len)
+{
+    uint8_t frame[FRAME_DATA_SIZE + 8];
+    if (len > FRAME_DATA_SIZE) {
+        return -EINVAL;
+    }
+    size_t frame_len = encode_frame(frame, dlci, cr, control, data, len);
+
+    int res = 0;
+    size_t pos = 0;
+    _write_mutex.lock();
+    uint64_t deadline = rtos::Kernel::get_ms_count() + CMUX_WRITE_TIMEOUT;
+    while (pos < frame_len) {
+        ssize_t written = _fh->write(frame + pos, frame_len - pos);
+        if (written == -EAGAIN) {
+            // note: the started frame is abandoned only if the interface is stuck, so the modem can lose
+            //       the next frame too, till the parser synchronization by flags
+            uint64_t now = rtos::Kernel::get_ms_count();
+            if (_aborted) {
+                res = -EIO;
+                break;
+            } else if (now >= deadline) {
+                res = -ETIMEDOUT;
+                break;
+            }
+            _wait_events(CMUX_EVENT_OUTPUT, deadline - now);
+            continue;
+        } else if (written < 0) {
+            res = written;
+            break;
+        }
+        pos += written;
+        // the started frame should be finished, so the timeout is counted from the last progress
+        deadline = rtos::Kernel::get_ms_count() + CMUX_WRITE_TIMEOUT;
+    }
+    if (!res) {
+        _stats.tx_frames++;
+    }
+    _write_mutex.unlock();
+    return res;
+}
+
+nsapi_error_t SIM5320CMUX::_send_command(int dlci, uint8_t control)
+{
+    for (int attempt = 0; attempt < CMUX_COMMAND_ATTEMPTS; attempt++) {
+        _mutex.lock();
+        _responses[dlci] = 0;
+        _events.clear(CMUX_EVENT_RESPONSE);
+        _mutex.unlock();
+        if (_write_frame(dlci, true, control | FRAME_PF, NULL, 0)) {
+            return NSAPI_ERROR_DEVICE_ERROR;
+        }
+        uint64_t deadline = rtos::Kernel::get_ms_count() + CMUX_RESPONSE_TIMEOUT;
+        while (true) {
+            _process_input();
+            _mutex.lock();
+            uint8_t response = _responses[dlci];
+            _mutex.unlock();
+            if (response == FRAME_UA) {
+                return NSAPI_ERROR_OK;
+            } else if (response == FRAME_DM) {
+                return NSAPI_ERROR_DEVICE_ERROR;
+            }
+            uint64_t now = rtos::Kernel::get_ms_count();
+            if (now >= deadline) {
+                break;
+            }
+            _wait_events(CMUX_EVENT_RESPONSE | CMUX_EVENT_INPUT, deadline - now);
+        }
+    }
+    return NSAPI_ERROR_TIMEOUT;
+}
+
+ssize_t SIM5320CMUX::_write_channel(int dlci, const void *buffer, size_t size)
+{
+    const uint8_t *data = (const uint8_t *)buffer;
+    if (!_channels[dlci - 1]._opened) {
+        return -EIO;
+    }
+    size_t pos = 0;
+    while (pos < size) {
+        size_t len = size - pos < FRAME_DATA_SIZE ? size - pos : FRAME_DATA_SIZE;
+        int res = _write_frame(dlci, true, FRAME_UIH, data + pos, len);
+        if (res) {
+            return res;
+        }
+        pos += len;
+    }
+    return size;
+}
@@ -1,12 +1,34 @@
 #include "sim5320_CellularContext.h"
 #include "sim5320_CellularStack.h"
 #include "sim5320_utils.h"
+#include "nsapi_ppp.h"
 using namespace sim5320;
 
 SIM5320CellularContext::SIM5320CellularContext(ATHandler &at, SIM5320CellularDevice *device, const char *apn, bool cp_req, bool nonip_req)
     : AT_CellularContext(at, device, apn, cp_req, nonip_req)
     , _is_net_opened(false)
+    , _net_open_failed(false)
+    , _net_state_sem(0, 1)
+    , _disconnect_latency(0)
     , _sim5320_device(device)
+#ifdef MBED_CONF_SIM5320_DRIVER_SOCKET_RX_PUSH_MODE
+    , _rx_push_mode(MBED_CONF_SIM5320_DRIVER_SOCKET_RX_PUSH_MODE)
+#else
+    , _rx_push_mode(false)
+#endif
+#ifdef MBED_CONF_SIM5320_DRIVER_SOCKET_TRANSPARENT_MODE
+    , _transparent_mode(MBED_CONF_SIM5320_DRIVER_SOCKET_TRANSPARENT_MODE)
+#else
+    , _transparent_mode(false)
+#endif
+#ifdef MBED_CONF_SIM5320_DRIVER_PPP_MODE
+    , _ppp_mode(MBED_CONF_SIM5320_DRIVER_PPP_MODE)
+#else
+    , _ppp_mode(false)
+#endif
+    , _is_ppp_connected(false)
+    , _reopen_deadline(0)
+    , _reopen_event_id(0)
 {
     _at.set_urc_handler("+NETOPEN:", callback(this, &SIM5320CellularContext::_urc_netopen));
     _at.set_urc_handler("+NETCLOSE:", callback(this, &SIM5320CellularContext::_urc_netclose));
@@ -14,6 +36,9 @@ SIM5320CellularContext::SIM5320CellularContext(ATHandler &at, SIM5320CellularDev
 
 SIM5320CellularContext::~SIM5320CellularContext()
 {
+    if (_reopen_event_id) {
+        _device->get_queue()->cancel(_reopen_event_id);
+    }
     if (_stack) {
         delete _stack;
     }
@@ -25,33 +50,41 @@ SIM5320CellularContext::~SIM5320CellularContext()
 static const int PDP_CONTEXT_ID = 1;
 static const int PDP_CONTEXT_ACTIVATION_TIMEOUT = 32000;
 static const int PDP_CONTEXT_DEACTIVATION_TIMEOUT = 16000;
-static const int PDP_STATUS_CHECK_DELAY = 1000;
+// maximal length of the configuration command (APN length is limited by 100 characters)
+static const int SETTING_CMD_MAX_LEN = 160;
+// period of the network reopening attempts after network loss, if network isn't opened
+static const int NETWORK_REOPEN_RETRY_PERIOD = 10000;
+// timeout of the AT command mode check after PPP connection closing
+static const int PPP_COMMAND_MODE_CHECK_TIMEOUT = 1000;
+// silence time before and after "+++" escape sequence
+static const int PPP_ESCAPE_GUARD_TIME = 1000;
 
 void SIM5320CellularContext::do_connect()
 {
     int err;
-    Timer timer;
+    // note: settings that are the same as during previous connection aren't sent to modem
+    SIM5320SettingsCache *settings_cache = _sim5320_device->get_settings_cache();
+    char cgdcont_cmd[SETTING_CMD_MAX_LEN];
+    char csocksetpn_cmd[24];
 
     call_network_cb(NSAPI_STATUS_CONNECTING);
     if (!_is_context_active) {
         {
             // configure context
-            ATHandlerLocker locker(_at);
+            ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
             // set PDP context parameters
-            _at.cmd_start("AT+CGDCONT=");
-            _at.write_int(PDP_CONTEXT_ID);
-            _at.write_string("IP");
-            _at.write_string(_apn);
-            _at.cmd_stop_read_resp();
+            snprintf(cgdcont_cmd, sizeof(cgdcont_cmd), "AT+CGDCONT=%d,\"IP\",\"%s\"", PDP_CONTEXT_ID, _apn ? _apn : "");
             // set PDP context for sockets
-            _at.cmd_start("AT+CSOCKSETPN=");
-            _at.write_int(PDP_CONTEXT_ID);
-            _at.cmd_stop_read_resp();
+            snprintf(csocksetpn_cmd, sizeof(csocksetpn_cmd), "AT+CSOCKSETPN=%d", PDP_CONTEXT_ID);
+            const char *context_cmds[] = { cgdcont_cmd, csocksetpn_cmd };
+            err = settings_cache->write(_at, context_cmds, sizeof(context_cmds) / sizeof(context_cmds[0]));
             _cid = PDP_CONTEXT_ID;
             // set user/password
-            do_user_authentication();
+            if (!err) {
+                do_user_authentication();
+            }
             // check errors
-            _cb_data.error = _at.get_last_error();
+            _cb_data.error = any_error(err, _at.get_last_error());
         }
         if (_cb_data.error) {
             call_network_cb(NSAPI_STATUS_DISCONNECTED);
@@ -63,31 +96,43 @@ void SIM5320CellularContext::do_connect()
         call_connection_status_cb(CellularActivatePDPContext);
     }
 
+    if (_ppp_mode) {
+        // note: modem TCP/IP stack isn't used in the PPP mode
+        err = _ppp_connect();
+        _is_context_activated = err == NSAPI_ERROR_OK;
+        _cb_data.error = err;
+        call_network_cb(err ? NSAPI_STATUS_DISCONNECTED : NSAPI_STATUS_GLOBAL_UP);
+        return;
+    }
+
     // activate network
     {
         // TCP/IP module to use command mode
-        ATHandlerLocker locker(_at);
-        // set automatic network type selection
-        _at.cmd_start("AT+CNMP=");
-        _at.write_int(2);
-        _at.cmd_stop_read_resp();
-        // don't show prompt with remove IP when new data is received
-        _at.cmd_start("AT+CIPSRIP=0");
-        _at.cmd_stop_read_resp();
-        // set command mode (non-transparent mode)
-        _at.cmd_start("AT+CIPMODE=0");
-        _at.cmd_stop_read_resp();
-        // set manual data receive mode
-        _at.cmd_start("AT+CIPRXGET=1");
-        _at.cmd_stop_read_resp();
-        // configure receive urc: "+RECEIVE"
-        _at.cmd_start("AT+CIPCCFG=,,,,1");
-        _at.cmd_stop_read_resp();
-        // activate PDP context
-        _at.cmd_start("AT+NETOPEN");
-        _at.cmd_stop_read_resp();
-        err = _at.get_last_error();
+        ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+        const char *network_cmds[] = {
+            // set automatic network type selection
+            "AT+CNMP=2",
+            // don't show prompt with remove IP when new data is received
+            "AT+CIPSRIP=0",
+            // set socket mode: 0 - command mode, 1 - transparent mode
+            _transparent_mode ? "AT+CIPMODE=1" : "AT+CIPMODE=0",
+            // set data receive mode: 0 - data is pushed with "+RECEIVE" URC, 1 - data is read manually
+            _rx_push_mode ? "AT+CIPRXGET=0" : "AT+CIPRXGET=1",
+            // configure receive urc: "+RECEIVE"
+            "AT+CIPCCFG=,,,,1"
+        };
+        // note: the commands are sent with one command line
+        err = settings_cache->write(_at, network_cmds, sizeof(network_cmds) / sizeof(network_cmds[0]));
+        if (!err) {
+            // activate PDP context
+            _net_open_failed = false;
+            _at.cmd_start("AT+NETOPEN");
+            _at.cmd_stop_read_resp();
+            err = _at.get_last_error();
+        }
     }
+    get_sim5320_stack()->set_transparent_mode(_transparent_mode);
+    get_sim5320_stack()->set_rx_push_mode(_rx_push_mode);
     // check errors
     if (err) {
         call_network_cb(NSAPI_STATUS_DISCONNECTED);
@@ -95,22 +140,65 @@ void SIM5320CellularContext::do_connect()
     };
 
     // wait network
-    timer.start();
-    while (!_is_net_opened && timer.read_ms() < PDP_CONTEXT_ACTIVATION_TIMEOUT) {
-        wait_ms(PDP_STATUS_CHECK_DELAY);
-        _check_netstate();
-    }
-    if (_is_net_opened) {
+    err = _wait_net_state(true, PDP_CONTEXT_ACTIVATION_TIMEOUT);
+    if (!err) {
         _is_context_activated = true;
         _cb_data.error = NSAPI_ERROR_OK;
         call_network_cb(NSAPI_STATUS_GLOBAL_UP);
     } else {
         _is_context_activated = false;
-        _cb_data.error = NSAPI_ERROR_CONNECTION_TIMEOUT;
+        _cb_data.error = err;
         call_network_cb(NSAPI_STATUS_DISCONNECTED);
     }
 }
 
+nsapi_error_t SIM5320CellularContext::_wait_net_state(bool opened, int timeout)
+{
+    if (opened && !_is_blocking) {
+        // non-blocking do_connect is invoked from the AT handler event queue, so URC isn't processed by it
+        _wait_net_state_urc(opened, timeout);
+    } else {
+        uint64_t deadline = rtos::Kernel::get_ms_count() + timeout;
+        while (_is_net_opened != opened && !(opened && _net_open_failed)) {
+            uint64_t now = rtos::Kernel::get_ms_count();
+            if (now >= deadline) {
+                break;
+            }
+            // the semaphore is released by "+NETOPEN"/"+NETCLOSE" URC handlers
+            _net_state_sem.try_acquire_for(deadline - now);
+        }
+    }
+    if (_is_net_opened != opened && !(opened && _net_open_failed)) {
+        // check state once, if URC is lost
+        _check_netstate();
+        if (_is_net_opened != opened) {
+            return NSAPI_ERROR_CONNECTION_TIMEOUT;
+        }
+    }
+    return _is_net_opened == opened ? NSAPI_ERROR_OK : NSAPI_ERROR_NO_CONNECTION;
+}
+
+void SIM5320CellularContext::_wait_net_state_urc(bool opened, int timeout)
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _at.set_at_timeout(timeout);
+    while (_is_net_opened != opened && !(opened && _net_open_failed) && !_at.get_last_error()) {
+        _at.resp_start(opened ? "+NETOPEN:" : "+NETCLOSE:");
+        if (!_at.info_resp()) {
+            // skip final result of other command
+            continue;
+        }
+        if (opened) {
+            _urc_netopen();
+        } else {
+            _urc_netclose();
+        }
+        _at.consume_to_stop_tag();
+    }
+    _at.restore_at_timeout();
+    _at.clear_error();
+}
+
 #define SIM5320_NETWORK_TIMEOUT 3 * 60 * 1000
 #define SIM5320_DEVICE_TIMEOUT 1 * 60 * 1000
 
@@ -128,33 +216,56 @@ uint32_t SIM5320CellularContext::get_timeout_for_operation(CellularContext::Cont
 
 nsapi_error_t SIM5320CellularContext::disconnect()
 {
+    if (_is_ppp_connected) {
+        nsapi_error_t err = _ppp_disconnect();
+        _is_context_activated = false;
+        call_network_cb(NSAPI_STATUS_DISCONNECTED);
+        return err;
+    }
+    {
+        // stop network recovery
+        ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+        if (_reopen_event_id) {
+            _device->get_queue()->cancel(_reopen_event_id);
+            _reopen_event_id = 0;
+        }
+    }
     if (!_is_net_opened) {
         return NSAPI_ERROR_OK;
     }
 
+    Timer timer;
+    timer.start();
     int close_err_count = 0;
     while (close_err_count < CLOSE_NETWORK_MAX_ATTEMPTS) {
+        nsapi_error_t err;
         {
             // try to close network
-            ATHandlerLocker locker(_at);
+            ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
             _at.cmd_start("AT+NETCLOSE");
             _at.cmd_stop_read_resp();
+            err = _at.get_last_error();
             _at.clear_error();
-
-            // check result
-            _check_netstate();
         }
-        if (_is_net_opened) {
-            close_err_count++;
-            wait_ms(CLOSE_NETWORK_ERR_TIMEOUT);
-        } else {
+        if (!err) {
+            // closing has been started, so wait "+NETCLOSE" URC
+            _wait_net_state(false, PDP_CONTEXT_DEACTIVATION_TIMEOUT);
+            break;
+        }
+        // command can be rejected during network state changing
+        _check_netstate();
+        if (!_is_net_opened) {
             break;
         }
+        close_err_count++;
+        wait_ms(CLOSE_NETWORK_ERR_TIMEOUT);
     }
     if (_is_net_opened) {
         return NSAPI_ERROR_TIMEOUT;
     }
+    _disconnect_latency = timer.read_ms();
 
+    _clear_dns_cache();
     _is_context_activated = false;
     call_network_cb(NSAPI_STATUS_DISCONNECTED);
 
@@ -163,7 +274,7 @@ nsapi_error_t SIM5320CellularContext::disconnect()
 
 bool SIM5320CellularContext::is_connected()
 {
-    return _is_net_opened;
+    return _is_net_opened || _is_ppp_connected;
 }
 
 void SIM5320CellularContext::call_connection_status_cb(cellular_connection_status_t status)
@@ -175,7 +286,7 @@ void SIM5320CellularContext::call_connection_status_cb(cellular_connection_statu
 
 nsapi_error_t SIM5320CellularContext::_check_netstate()
 {
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
     _at.cmd_start("AT+NETOPEN?");
     _at.cmd_stop();
     _at.resp_start("+NETOPEN:");
@@ -191,10 +302,24 @@ nsapi_error_t SIM5320CellularContext::_check_netstate()
 void SIM5320CellularContext::_urc_netopen()
 {
     int net_state = _at.read_int();
-    if (!_at.get_last_error() && net_state == 0) {
+    if (_at.get_last_error()) {
+        return;
+    }
+    if (net_state == 0) {
         _is_net_opened = true;
+        if (_reopen_event_id) {
+            _device->get_queue()->cancel(_reopen_event_id);
+            _reopen_event_id = 0;
+        }
+        _clear_dns_cache();
+        if (_stack) {
+            get_sim5320_stack()->network_reopened();
+        }
         call_network_cb(NSAPI_STATUS_GLOBAL_UP);
+    } else {
+        _net_open_failed = true;
     }
+    _net_state_sem.release();
 }
 
 void SIM5320CellularContext::_urc_netclose()
@@ -202,15 +327,202 @@ void SIM5320CellularContext::_urc_netclose()
     int net_state = _at.read_int();
     if (!_at.get_last_error() && net_state == 0) {
         _is_net_opened = false;
+        _clear_dns_cache();
         call_network_cb(NSAPI_STATUS_DISCONNECTED);
+        _net_state_sem.release();
     }
 }
 
-NetworkStack *SIM5320CellularContext::get_stack()
+void SIM5320CellularContext::_network_lost(int recovery_timeout)
+{
+    _is_net_opened = false;
+    _clear_dns_cache();
+    if (recovery_timeout <= 0) {
+        _is_context_activated = false;
+        call_network_cb(NSAPI_STATUS_DISCONNECTED);
+        return;
+    }
+    tr_debug("network: network has been lost, reopen it");
+    _reopen_deadline = rtos::Kernel::get_ms_count() + recovery_timeout;
+    if (!_reopen_event_id) {
+        _reopen_event_id = _device->get_queue()->call(callback(this, &SIM5320CellularContext::_reopen_network));
+    }
+    call_network_cb(NSAPI_STATUS_CONNECTING);
+}
+
+void SIM5320CellularContext::_reopen_network()
+{
+    bool reopening_timeout = false;
+    {
+        ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+        _reopen_event_id = 0;
+        if (_is_net_opened) {
+            return;
+        }
+        uint64_t now = rtos::Kernel::get_ms_count();
+        if (now >= _reopen_deadline) {
+            reopening_timeout = true;
+        } else {
+            // activate PDP context, the result is reported by "+NETOPEN" URC
+            _at.cmd_start("AT+NETOPEN");
+            _at.cmd_stop_read_resp();
+            _at.clear_error();
+            // repeat attempt if URC isn't received or network opening has failed
+            uint64_t delay = _reopen_deadline - now;
+            if (delay > NETWORK_REOPEN_RETRY_PERIOD) {
+                delay = NETWORK_REOPEN_RETRY_PERIOD;
+            }
+            _reopen_event_id = _device->get_queue()->call_in(delay, callback(this, &SIM5320CellularContext::_reopen_network));
+        }
+    }
+    if (reopening_timeout) {
+        tr_debug("network: network reopening timeout");
+        _is_context_activated = false;
+        call_network_cb(NSAPI_STATUS_DISCONNECTED);
+    }
+}
+
+void SIM5320CellularContext::set_transparent_mode(bool enabled)
+{
+    _transparent_mode = enabled;
+}
+
+bool SIM5320CellularContext::is_transparent_mode() const
+{
+    return _transparent_mode;
+}
+
+void SIM5320CellularContext::set_rx_push_mode(bool enabled)
+{
+    _rx_push_mode = enabled;
+}
+
+bool SIM5320CellularContext::is_rx_push_mode() const
 {
+    return _rx_push_mode;
+}
+
+void SIM5320CellularContext::set_ppp_mode(bool enabled)
+{
+    _ppp_mode = enabled;
+}
+
+bool SIM5320CellularContext::is_ppp_mode() const
+{
+    return _ppp_mode;
+}
+
+nsapi_error_t SIM5320CellularContext::_ppp_connect()
+{
+#if NSAPI_PPP_AVAILABLE
+    nsapi_error_t err;
+    char dial_cmd[16];
+    {
+        ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+        snprintf(dial_cmd, sizeof(dial_cmd), "ATD*99***%d#", PDP_CONTEXT_ID);
+        _at.cmd_start(dial_cmd);
+        _at.cmd_stop();
+        _at.resp_start("CONNECT", true);
+        if ((err = _at.get_last_error())) {
+            tr_debug("PPP dial error: %d", err);
+            return err;
+        }
+        // serial interface belongs to PPP stack until disconnection
+        _at.set_is_filehandle_usable(false);
+    }
 
+    _is_ppp_connected = true;
+    err = nsapi_ppp_connect(_at.get_file_handle(), callback(this, &SIM5320CellularContext::_ppp_status_cb), _uname, _pwd, IPV4_STACK);
+    if (err) {
+        tr_debug("PPP connection error: %d", err);
+        _ppp_disconnect();
+    }
+    return err;
+#else
+    return NSAPI_ERROR_UNSUPPORTED;
+#endif
+}
+
+nsapi_error_t SIM5320CellularContext::_ppp_disconnect()
+{
+#if NSAPI_PPP_AVAILABLE
+    _is_ppp_connected = false;
+    nsapi_error_t err = nsapi_ppp_disconnect(_at.get_file_handle());
+
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _at.set_is_filehandle_usable(true);
+    _at.set_filehandle_sigio();
+    // modem returns to command mode with "NO CARRIER" message after PPP termination
+    _at.flush();
+    _at.clear_error();
+    if (!_at.sync(PPP_COMMAND_MODE_CHECK_TIMEOUT)) {
+        // modem is still in data mode, so hang up explicitly
+        wait_ms(PPP_ESCAPE_GUARD_TIME);
+        _at.write_bytes((const uint8_t *)"+++", 3);
+        wait_ms(PPP_ESCAPE_GUARD_TIME);
+        _at.flush();
+        _at.clear_error();
+        _at.cmd_start("ATH");
+        _at.cmd_stop_read_resp();
+        if (!err) {
+            err = _at.get_last_error();
+        }
+    }
+    return err;
+#else
+    return NSAPI_ERROR_UNSUPPORTED;
+#endif
+}
+
+void SIM5320CellularContext::_ppp_status_cb(nsapi_event_t ev, intptr_t ptr)
+{
+    if (ev == NSAPI_EVENT_CONNECTION_STATUS_CHANGE && ptr == NSAPI_STATUS_DISCONNECTED && _is_ppp_connected) {
+        // connection has been closed by network, so return serial interface to AT handler
+        _is_ppp_connected = false;
+        _at.set_is_filehandle_usable(true);
+        _at.set_filehandle_sigio();
+    }
+    if (ev == NSAPI_EVENT_CONNECTION_STATUS_CHANGE) {
+        call_network_cb((nsapi_connection_status_t)ptr);
+    } else if (_status_cb) {
+        _status_cb(ev, ptr);
+    }
+}
+
+nsapi_error_t SIM5320CellularContext::suspend_transparent_mode()
+{
+    return get_sim5320_stack()->suspend_transparent_mode();
+}
+
+int SIM5320CellularContext::get_disconnect_latency() const
+{
+    return _disconnect_latency;
+}
+
+SIM5320CellularStack *SIM5320CellularContext::get_sim5320_stack()
+{
     if (!_stack) {
-        _stack = new SIM5320CellularStack(_at, _cid, (nsapi_ip_stack_t)_pdp_type);
+        SIM5320CellularStack *stack = new SIM5320CellularStack(_at, _cid, (nsapi_ip_stack_t)_pdp_type, _device->get_queue(), _rx_push_mode);
+        stack->set_network_lost_callback(callback(this, &SIM5320CellularContext::_network_lost));
+        _stack = stack;
+    }
+    return static_cast<SIM5320CellularStack *>(_stack);
+}
+
+void SIM5320CellularContext::_clear_dns_cache()
+{
+    // resolved addresses can depend on network (for example, private APN DNS servers)
+    if (_stack) {
+        get_sim5320_stack()->get_dns_cache()->clear();
+    }
+}
+
+NetworkStack *SIM5320CellularContext::get_stack()
+{
+#if NSAPI_PPP_AVAILABLE
+    if (_ppp_mode) {
+        return nsapi_ppp_get_stack();
     }
-    return _stack;
+#endif
+    return get_sim5320_stack();
 }
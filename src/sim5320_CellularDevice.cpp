@@ -19,7 +19,8 @@ static const intptr_t cellular_properties[AT_CellularBase::PROPERTY_MAX] = {
     0, // 0 = not supported, 1 = supported. Does modem support Non-IP?
 };
 // notes:
-// 1. TODO: check PPP support
+// 1. PPP is supported by SIM5320CellularContext itself ("ATD*99***<cid>#" dialing), as it doesn't use
+//    AT_CellularContext connection implementation.
 // 2. Enable IPv6, when AT_CellularContext::set_new_context is fixed. (current implementation use dual IPV4V6 stack if IPV4 and IPV6 is supported,
 //    instead of IPv4 and IPv6 separately)
 // 3. We can choose only one: C_EREG, C_GREG or C_REG otherwise, AT_CellularDevice and CellularStateMachine can cause "reset" action
@@ -34,17 +35,19 @@ SIM5320CellularDevice::SIM5320CellularDevice(FileHandle *fh)
 {
     set_timeout(SIM5320_DEFAULT_TIMEOUT);
     AT_CellularBase::set_cellular_properties(cellular_properties);
+    _at->set_urc_handler("START", callback(this, &SIM5320CellularDevice::_urc_start));
 }
 
 SIM5320CellularDevice::~SIM5320CellularDevice()
 {
+    _at->set_urc_handler("START", NULL);
 }
 
 nsapi_error_t SIM5320CellularDevice::init_at_interface()
 {
     nsapi_error_t err;
     // disable echo
-    ATHandlerLocker locker(*_at);
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
     _at->flush();
     _at->cmd_start("ATE0"); // echo off
     _at->cmd_stop_read_resp();
@@ -68,7 +71,7 @@ nsapi_error_t SIM5320CellularDevice::set_power_level(int func_level)
     if (func_level < 0 || func_level > 1) {
         return NSAPI_ERROR_PARAMETER;
     }
-    ATHandlerLocker locker(*_at);
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
     _at->cmd_start("AT+CFUN=");
     _at->write_int(func_level);
     _at->cmd_stop_read_resp();
@@ -78,7 +81,7 @@ nsapi_error_t SIM5320CellularDevice::set_power_level(int func_level)
 nsapi_error_t SIM5320CellularDevice::get_power_level(int &func_level)
 {
     int result;
-    ATHandlerLocker locker(*_at);
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
     _at->cmd_start("AT+CFUN?");
     _at->cmd_stop();
     _at->resp_start("+CFUN:");
@@ -104,22 +107,46 @@ nsapi_error_t SIM5320CellularDevice::init()
     if ((err = AT_CellularDevice::init())) {
         return err;
     }
+    // modem could be restarted, so forget its settings
+    _settings_cache.clear();
+    // note: the commands are sent with one command line
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
+    ATCommandBatch batch(*_at);
     // disable STK function
-    ATHandlerLocker locker(*_at);
-    _at->cmd_start("AT+STK=0");
-    _at->cmd_stop_read_resp();
+    if ((err = batch.add("AT+STK=0"))) {
+        return err;
+    }
 
     //    // switch CMEE codes to string format
-    //    _at->cmd_start("AT+CMEE=2"); // verbose responses
-    //    _at->cmd_stop_read_resp();
+    //    batch.add("AT+CMEE=2"); // verbose responses
 
     // disable registration URC codes is they are enabled
     // note: if CellularMachine is used, it will enable them
-    _at->cmd_start("AT+CREG=0");
-    _at->cmd_stop_read_resp();
-    _at->cmd_start("AT+CGREG=0");
-    _at->cmd_stop_read_resp();
-    return _at->get_last_error();
+    SIM5320CellularNetwork *network = static_cast<SIM5320CellularNetwork *>(_network);
+    bool registration_cache = network && network->is_registration_cache_enabled();
+    if ((err = batch.add("AT+CREG=0"))) {
+        return err;
+    }
+    if (!registration_cache && (err = batch.add("AT+CGREG=0"))) {
+        return err;
+    }
+    if ((err = batch.send())) {
+        return err;
+    }
+    if (registration_cache) {
+        // enable registration URCs and read current state
+        err = network->set_registration_cache(true);
+    }
+    return err;
+}
+
+nsapi_error_t SIM5320CellularDevice::release_at_handler(ATHandler *at_handler)
+{
+    // handler can be deleted, so drop its scheduler state
+    if (at_handler) {
+        SIM5320ATScheduler::get_instance()->forget(*at_handler);
+    }
+    return AT_CellularDevice::release_at_handler(at_handler);
 }
 
 SIM5320GPSDevice *SIM5320CellularDevice::open_gps(FileHandle *fh)
@@ -173,7 +200,7 @@ nsapi_error_t SIM5320CellularDevice::get_subscriber_number(char *number)
     bool find_number = false;
     int number_type;
 
-    ATHandlerLocker locker(*_at);
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
     // active MSISDN memory
     _at->cmd_start("AT+CPBS=");
     _at->write_string("ON");
@@ -212,7 +239,7 @@ nsapi_error_t SIM5320CellularDevice::set_subscriber_number(const char *number)
         return NSAPI_ERROR_PARAMETER;
     }
 
-    ATHandlerLocker locker(*_at);
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
 
     // active MSISDN memory
     _at->cmd_start("AT+CPBS=");
@@ -228,6 +255,16 @@ nsapi_error_t SIM5320CellularDevice::set_subscriber_number(const char *number)
     return _at->get_last_error();
 }
 
+SIM5320SettingsCache *SIM5320CellularDevice::get_settings_cache()
+{
+    return &_settings_cache;
+}
+
+void SIM5320CellularDevice::_urc_start()
+{
+    _settings_cache.clear();
+}
+
 AT_CellularInformation *SIM5320CellularDevice::open_information_impl(ATHandler &at)
 {
     return new SIM5320CellularInformation(at);
@@ -250,7 +287,7 @@ AT_CellularSMS *SIM5320CellularDevice::open_sms_impl(ATHandler &at)
 
 SIM5320GPSDevice *SIM5320CellularDevice::open_gps_impl(ATHandler &at)
 {
-    return new SIM5320GPSDevice(at);
+    return new SIM5320GPSDevice(at, _settings_cache);
 }
 
 SIM5320FTPClient *SIM5320CellularDevice::open_ftp_client_impl(ATHandler &at)
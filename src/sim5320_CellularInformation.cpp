@@ -55,7 +55,7 @@ nsapi_error_t SIM5320CellularInformation::_get_simcom_info(const char *cmd, cons
     if (buf == NULL || buf_size == 0) {
         return NSAPI_ERROR_PARAMETER;
     }
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
     _at.cmd_start(cmd);
     _at.cmd_stop();
     _at.set_delimiter('\r');
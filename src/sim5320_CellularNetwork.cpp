@@ -1,15 +1,48 @@
 #include "sim5320_CellularNetwork.h"
+#include "CellularCommon.h"
 #include "sim5320_CellularStack.h"
 #include "sim5320_utils.h"
 using namespace sim5320;
 
 SIM5320CellularNetwork::SIM5320CellularNetwork(ATHandler &at_handler)
     : AT_CellularNetwork(at_handler)
+#ifdef MBED_CONF_SIM5320_DRIVER_REGISTRATION_CACHE
+    , _registration_cache_enabled(MBED_CONF_SIM5320_DRIVER_REGISTRATION_CACHE)
+#else
+    , _registration_cache_enabled(false)
+#endif
+    , _cgreg_handler_replaced(false)
 {
+    _registration_snapshot.status = CellularNetwork::StatusNotAvailable;
+    _registration_snapshot.act = CellularNetwork::RAT_UNKNOWN;
+    _registration_snapshot.lac = -1;
+    _registration_snapshot.cell_id = -1;
+    _registration_snapshot.change_time = 0;
+
+    if (_registration_cache_enabled) {
+        _replace_cgreg_handler();
+    }
+    _at.set_urc_handler("+CNSMOD:", callback(this, &SIM5320CellularNetwork::_urc_cnsmod));
 }
 
 SIM5320CellularNetwork::~SIM5320CellularNetwork()
 {
+    if (_cgreg_handler_replaced) {
+        _at.set_urc_handler("+CGREG:", NULL);
+    }
+    _at.set_urc_handler("+CNSMOD:", NULL);
+}
+
+void SIM5320CellularNetwork::_replace_cgreg_handler()
+{
+    if (_cgreg_handler_replaced) {
+        return;
+    }
+    // replace default +CGREG handler, as it should update registration cache
+    // note: default handler is private, so it cannot be restored, but replacement notifies about changes in the same way
+    _at.set_urc_handler("+CGREG:", NULL);
+    _at.set_urc_handler("+CGREG:", callback(this, &SIM5320CellularNetwork::_urc_cgreg));
+    _cgreg_handler_replaced = true;
 }
 
 nsapi_error_t SIM5320CellularNetwork::set_ciot_optimization_config(CellularNetwork::CIoT_Supported_Opt supported_opt, CellularNetwork::CIoT_Preferred_UE_Opt preferred_opt, Callback<void(CellularNetwork::CIoT_Supported_Opt)> network_support_cb)
@@ -32,13 +65,13 @@ nsapi_error_t SIM5320CellularNetwork::get_ciot_network_optimization_config(Cellu
 nsapi_error_t SIM5320CellularNetwork::detach()
 {
     // note: add extra timeout for this operation
-    ATHandlerLocker locker(_at, SIM5320_DETACH_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, SIM5320_DETACH_TIMEOUT);
     return AT_CellularNetwork::detach();
 }
 
 nsapi_error_t SIM5320CellularNetwork::scan_plmn(CellularNetwork::operList_t &operators, int &ops_count)
 {
-    ATHandlerLocker locker(_at, _OPERATORS_SCAN_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, _OPERATORS_SCAN_TIMEOUT);
     return AT_CellularNetwork::scan_plmn(operators, ops_count);
 }
 
@@ -47,6 +80,21 @@ nsapi_error_t SIM5320CellularNetwork::get_registration_params(CellularNetwork::R
     if (type == CellularNetwork::C_EREG) {
         return NSAPI_ERROR_UNSUPPORTED;
     }
+    if (type == CellularNetwork::C_GREG) {
+        _registration_mutex.lock();
+        if (_registration_cache_enabled) {
+            reg_params._type = type;
+            reg_params._status = _registration_snapshot.status;
+            reg_params._act = _registration_snapshot.act;
+            reg_params._cell_id = _registration_snapshot.cell_id;
+            reg_params._lac = _registration_snapshot.lac;
+            reg_params._active_time = -1;
+            reg_params._periodic_tau = -1;
+            _registration_mutex.unlock();
+            return NSAPI_ERROR_OK;
+        }
+        _registration_mutex.unlock();
+    }
     nsapi_error_t err = AT_CellularNetwork::get_registration_params(type, reg_params);
     if (err) {
         return err;
@@ -64,6 +112,15 @@ nsapi_error_t SIM5320CellularNetwork::get_registration_params(CellularNetwork::R
     return NSAPI_ERROR_OK;
 }
 
+nsapi_error_t SIM5320CellularNetwork::set_registration_urc(CellularNetwork::RegistrationType type, bool on)
+{
+    if (type == CellularNetwork::C_GREG && !on && is_registration_cache_enabled()) {
+        // +CGREG URCs are required by registration cache
+        return NSAPI_ERROR_OK;
+    }
+    return AT_CellularNetwork::set_registration_urc(type, on);
+}
+
 static CellularNetwork::RadioAccessTechnology rat_codes[] = {
     CellularNetwork::RAT_UNKNOWN,
     CellularNetwork::RAT_GSM,
@@ -75,11 +132,31 @@ static CellularNetwork::RadioAccessTechnology rat_codes[] = {
     CellularNetwork::RAT_HSDPA_HSUPA
 };
 
+static CellularNetwork::RadioAccessTechnology rat_code_to_access_technology(int rat_code)
+{
+    if (rat_code < 0 || rat_code >= 8) {
+        return CellularNetwork::RAT_UNKNOWN;
+    }
+    return rat_codes[rat_code];
+}
+
 nsapi_error_t SIM5320CellularNetwork::get_active_access_technology(CellularNetwork::RadioAccessTechnology &op_rat)
+{
+    _registration_mutex.lock();
+    if (_registration_cache_enabled) {
+        op_rat = _registration_snapshot.act;
+        _registration_mutex.unlock();
+        return NSAPI_ERROR_OK;
+    }
+    _registration_mutex.unlock();
+    return _read_active_access_technology(op_rat);
+}
+
+nsapi_error_t SIM5320CellularNetwork::_read_active_access_technology(CellularNetwork::RadioAccessTechnology &op_rat)
 {
     int rat_code;
     nsapi_error_t err;
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
 
     _at.cmd_start("AT+CNSMOD?");
     _at.cmd_stop();
@@ -92,18 +169,13 @@ nsapi_error_t SIM5320CellularNetwork::get_active_access_technology(CellularNetwo
         return err;
     }
 
-    if (rat_code < 0 || rat_code >= 8) {
-        op_rat = CellularNetwork::RAT_UNKNOWN;
-    } else {
-        op_rat = rat_codes[rat_code];
-    }
-
+    op_rat = rat_code_to_access_technology(rat_code);
     return NSAPI_ERROR_OK;
 }
 
 nsapi_error_t SIM5320CellularNetwork::set_preffered_radio_access_technology_mode(SIM5320CellularNetwork::SIM5320PreferredRadioAccessTechnologyMode aop)
 {
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
     _at.cmd_start("AT+CNMP=");
     _at.write_int(aop);
     _at.cmd_stop_read_resp();
@@ -132,3 +204,190 @@ nsapi_error_t SIM5320CellularNetwork::set_access_technology_impl(CellularNetwork
     }
     return err;
 }
+
+nsapi_error_t SIM5320CellularNetwork::set_registration_cache(bool enabled)
+{
+    nsapi_error_t err;
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
+    ATCommandBatch batch(_at);
+    if (enabled) {
+        _replace_cgreg_handler();
+        // enable +CGREG URC with location information and +CNSMOD URC
+        if ((err = batch.add("AT+CGREG=2")) || (err = batch.add("AT+CNSMOD=1")) || (err = batch.send())) {
+            return err;
+        }
+        if ((err = _read_registration_snapshot())) {
+            return err;
+        }
+    } else {
+        if ((err = batch.add("AT+CNSMOD=0")) || (err = batch.send())) {
+            return err;
+        }
+    }
+    _registration_mutex.lock();
+    _registration_cache_enabled = enabled;
+    _registration_mutex.unlock();
+    return NSAPI_ERROR_OK;
+}
+
+bool SIM5320CellularNetwork::is_registration_cache_enabled() const
+{
+    _registration_mutex.lock();
+    bool enabled = _registration_cache_enabled;
+    _registration_mutex.unlock();
+    return enabled;
+}
+
+nsapi_error_t SIM5320CellularNetwork::get_registration_snapshot(SIM5320CellularNetwork::registration_snapshot_t &snapshot)
+{
+    _registration_mutex.lock();
+    if (!_registration_cache_enabled) {
+        _registration_mutex.unlock();
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    snapshot = _registration_snapshot;
+    _registration_mutex.unlock();
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t SIM5320CellularNetwork::_read_registration_snapshot()
+{
+    nsapi_error_t err;
+    int status;
+    int lac;
+    int cell_id;
+    CellularNetwork::RadioAccessTechnology act;
+
+    // read current state, as URCs are sent on changes only
+    _at.cmd_start("AT+CGREG?");
+    _at.cmd_stop();
+    _at.resp_start("+CGREG:");
+    _at.skip_param();
+    status = _at.read_int();
+    _read_registration_location(lac, cell_id);
+    _at.resp_stop();
+    if ((err = _at.get_last_error())) {
+        return err;
+    }
+    if ((err = _read_active_access_technology(act))) {
+        return err;
+    }
+
+    _update_registration((CellularNetwork::RegistrationStatus)status, lac, cell_id);
+    _update_access_technology(act);
+    return NSAPI_ERROR_OK;
+}
+
+void SIM5320CellularNetwork::_read_registration_location(int &lac, int &cell_id)
+{
+    char buf[12];
+    lac = -1;
+    cell_id = -1;
+    if (_at.read_string(buf, sizeof(buf)) > 0) {
+        lac = strtol(buf, NULL, 16);
+    }
+    if (_at.read_string(buf, sizeof(buf)) > 0) {
+        cell_id = strtol(buf, NULL, 16);
+    }
+}
+
+void SIM5320CellularNetwork::_update_registration(CellularNetwork::RegistrationStatus status, int lac, int cell_id)
+{
+    bool status_changed;
+    bool cell_changed;
+    bool cell_cleared;
+    CellularNetwork::RegistrationStatus previous_status;
+
+    _registration_mutex.lock();
+    previous_status = _registration_snapshot.status;
+    status_changed = status != previous_status;
+    cell_changed = cell_id != -1 && cell_id != _registration_snapshot.cell_id;
+    // +CGREG messages of the unregistered states don't contain location, so the previous cell shouldn't be kept
+    cell_cleared = status != CellularNetwork::RegisteredHomeNetwork && status != CellularNetwork::RegisteredRoaming && _registration_snapshot.cell_id != -1;
+    _registration_snapshot.status = status;
+    if (cell_changed) {
+        _registration_snapshot.cell_id = cell_id;
+        _registration_snapshot.lac = lac;
+    } else if (cell_cleared) {
+        _registration_snapshot.cell_id = -1;
+        _registration_snapshot.lac = -1;
+    }
+    if (status_changed || cell_changed || cell_cleared) {
+        _registration_snapshot.change_time = rtos::Kernel::get_ms_count();
+    }
+    _registration_mutex.unlock();
+
+    // notify about changes like AT_CellularNetwork does
+    _reg_params._type = CellularNetwork::C_GREG;
+    cell_callback_data_t data;
+    data.error = NSAPI_ERROR_OK;
+    data.final_try = false;
+    if (status_changed) {
+        _reg_params._status = status;
+        if (_connection_status_cb) {
+            data.status_data = status;
+            _connection_status_cb((nsapi_event_t)CellularRegistrationStatusChanged, (intptr_t)&data);
+            if (status == CellularNetwork::NotRegistered && (previous_status == CellularNetwork::RegisteredHomeNetwork || previous_status == CellularNetwork::RegisteredRoaming)) {
+                _connection_status_cb(NSAPI_EVENT_CONNECTION_STATUS_CHANGE, NSAPI_STATUS_DISCONNECTED);
+            }
+        }
+    }
+    if (cell_changed) {
+        _reg_params._cell_id = cell_id;
+        _reg_params._lac = lac;
+        if (_connection_status_cb) {
+            data.status_data = cell_id;
+            _connection_status_cb((nsapi_event_t)CellularCellIDChanged, (intptr_t)&data);
+        }
+    } else if (cell_cleared) {
+        _reg_params._cell_id = -1;
+        _reg_params._lac = -1;
+    }
+}
+
+void SIM5320CellularNetwork::_update_access_technology(CellularNetwork::RadioAccessTechnology act)
+{
+    bool act_changed;
+
+    _registration_mutex.lock();
+    act_changed = act != _registration_snapshot.act;
+    if (act_changed) {
+        _registration_snapshot.act = act;
+        _registration_snapshot.change_time = rtos::Kernel::get_ms_count();
+    }
+    _registration_mutex.unlock();
+
+    if (act_changed) {
+        _reg_params._act = act;
+        if (_connection_status_cb) {
+            cell_callback_data_t data;
+            data.error = NSAPI_ERROR_OK;
+            data.status_data = act;
+            data.final_try = false;
+            _connection_status_cb((nsapi_event_t)CellularRadioAccessTechnologyChanged, (intptr_t)&data);
+        }
+    }
+}
+
+void SIM5320CellularNetwork::_urc_cgreg()
+{
+    // URC format: +CGREG: <stat>[,<lac>,<ci>]
+    int lac;
+    int cell_id;
+    int status = _at.read_int();
+    _read_registration_location(lac, cell_id);
+    if (_at.get_last_error() || status < 0) {
+        return;
+    }
+    _update_registration((CellularNetwork::RegistrationStatus)status, lac, cell_id);
+}
+
+void SIM5320CellularNetwork::_urc_cnsmod()
+{
+    // URC format: +CNSMOD: <stat>
+    int rat_code = _at.read_int();
+    if (_at.get_last_error() || rat_code < 0) {
+        return;
+    }
+    _update_access_technology(rat_code_to_access_technology(rat_code));
+}
@@ -35,7 +35,7 @@ nsapi_size_or_error_t SIM5320CellularSMS::send_sms(const char *phone_number, con
         return NSAPI_ERROR_PARAMETER;
     }
 
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
 
     _at.cmd_start("AT+CMGS=");
     _at.write_string(phone_number);
@@ -99,7 +99,7 @@ nsapi_size_or_error_t SIM5320CellularSMS::get_sms(char *buf, uint16_t buf_len, c
     strcpy(time_stamp, "");
     strcpy(message_status, "");
     strcpy(phone_num_tmp, "");
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
     _at.cmd_start("AT+CMGL=\"ALL\"");
     _at.cmd_stop();
     _at.resp_start("+CMGL:");
@@ -167,7 +167,7 @@ nsapi_size_or_error_t SIM5320CellularSMS::get_sms(char *buf, uint16_t buf_len, c
 nsapi_error_t SIM5320CellularSMS::get_sms_message_mode(CellularSMS::CellularSMSMmode &mode)
 {
     int mode_code = 0;
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
     _at.cmd_start("AT+CMGF?");
     _at.cmd_stop();
     _at.resp_start("+CMGF:");
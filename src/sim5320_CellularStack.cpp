@@ -1,4 +1,5 @@
 ﻿#include "sim5320_CellularStack.h"
+#include "limits.h"
 #include "mbed-trace/mbed_trace.h"
 #include "sim5320_utils.h"
 
@@ -9,14 +10,101 @@
 
 using namespace sim5320;
 
-SIM5320CellularStack::SIM5320CellularStack(ATHandler &at, int cid, nsapi_ip_stack_t stack_type)
+#ifdef MBED_CONF_SIM5320_DRIVER_DNS_CACHE_SIZE
+#define DNS_CACHE_SIZE MBED_CONF_SIM5320_DRIVER_DNS_CACHE_SIZE
+#else
+#define DNS_CACHE_SIZE 4
+#endif
+#ifdef MBED_CONF_SIM5320_DRIVER_DNS_CACHE_TTL
+#define DNS_CACHE_TTL MBED_CONF_SIM5320_DRIVER_DNS_CACHE_TTL
+#else
+#define DNS_CACHE_TTL 300000
+#endif
+#ifdef MBED_CONF_SIM5320_DRIVER_SOCKET_EVENT_THREAD_STACK_SIZE
+#define SOCKET_EVENT_THREAD_STACK_SIZE MBED_CONF_SIM5320_DRIVER_SOCKET_EVENT_THREAD_STACK_SIZE
+#else
+#define SOCKET_EVENT_THREAD_STACK_SIZE 2048
+#endif
+// socket notifications are merged, so only one event is queued at the same time
+#define SOCKET_EVENT_QUEUE_SIZE (4 * EVENTS_EVENT_SIZE)
+#ifdef MBED_CONF_SIM5320_DRIVER_DNS_THREAD_STACK_SIZE
+#define DNS_THREAD_STACK_SIZE MBED_CONF_SIM5320_DRIVER_DNS_THREAD_STACK_SIZE
+#else
+#define DNS_THREAD_STACK_SIZE 2048
+#endif
+// all pending queries are processed by one event
+#define DNS_QUEUE_SIZE (2 * EVENTS_EVENT_SIZE)
+#ifdef MBED_CONF_SIM5320_DRIVER_SOCKET_RX_RECONCILE_PERIOD
+#define SOCKET_RX_RECONCILE_PERIOD MBED_CONF_SIM5320_DRIVER_SOCKET_RX_RECONCILE_PERIOD
+#else
+#define SOCKET_RX_RECONCILE_PERIOD 0
+#endif
+
+#ifdef MBED_CONF_SIM5320_DRIVER_NETWORK_RECOVERY_TIMEOUT
+#define NETWORK_RECOVERY_TIMEOUT MBED_CONF_SIM5320_DRIVER_NETWORK_RECOVERY_TIMEOUT
+#else
+#define NETWORK_RECOVERY_TIMEOUT 0
+#endif
+
+#ifdef MBED_CONF_SIM5320_DRIVER_DNS_CACHE_NEGATIVE_TTL
+#define DNS_CACHE_NEGATIVE_TTL MBED_CONF_SIM5320_DRIVER_DNS_CACHE_NEGATIVE_TTL
+#else
+#define DNS_CACHE_NEGATIVE_TTL 30000
+#endif
+
+SIM5320CellularStack::SIM5320CellularStack(ATHandler &at, int cid, nsapi_ip_stack_t stack_type, events::EventQueue *queue, bool rx_push_mode)
     : AT_CellularStack(at, cid, stack_type)
-    , _active_sockets(0)
+    , _open_timeout_event_id(0)
+    , _recovery_timeout(NETWORK_RECOVERY_TIMEOUT)
+    , _recovery_event_id(0)
+    , _tx_flush_event_id(0)
+    , _dns_cache(DNS_CACHE_SIZE, DNS_CACHE_TTL, DNS_CACHE_NEGATIVE_TTL)
+    , _queue(queue)
+    , _dns_query_id_counter(0)
+    , _dns_process_event_id(0)
+    , _dns_queue(DNS_QUEUE_SIZE)
+    , _dns_thread(osPriorityNormal, DNS_THREAD_STACK_SIZE, NULL, "sim5320_dns")
+    , _rx_push_mode(rx_push_mode)
+    , _rx_reconcile_event_id(0)
+    , _transparent_mode(false)
+    , _transparent_socket(NULL)
+    , _transparent_data_mode(false)
+    , _transparent_last_write_time(0)
+    , _transparent_notify_pending(false)
+    , _socket_event_links(0)
+    , _socket_events_event_id(0)
+    , _socket_event_queue(SOCKET_EVENT_QUEUE_SIZE)
+    , _socket_event_thread(osPriorityNormal, SOCKET_EVENT_THREAD_STACK_SIZE, NULL, "sim5320_sockets")
+    , _socket_event_cond(_socket_event_mutex)
+    , _socket_callback_link(-1)
+    , _socket_closing_links(0)
 {
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        _link_states[i] = LINK_CLOSED;
+    }
+    memset(_link_stats, 0, sizeof(_link_stats));
+    memset(_tx_coalescing, 0, sizeof(_tx_coalescing));
+    memset(_link_recovering, 0, sizeof(_link_recovering));
+    memset(_send_pending_chunks, 0, sizeof(_send_pending_chunks));
+    memset(_send_confirmed_chunks, 0, sizeof(_send_confirmed_chunks));
+    memset(_rx_buffers, 0, sizeof(_rx_buffers));
+    memset(_rx_counted_ahead, 0, sizeof(_rx_counted_ahead));
+    for (int i = 0; i < _DNS_QUERY_COUNT; i++) {
+        _dns_queries[i].state = DNS_QUERY_FREE;
+    }
     _at.set_urc_handler("+CIPEVENT:", callback(this, &SIM5320CellularStack::_urc_cipevent));
     _at.set_urc_handler("+IPCLOSE:", callback(this, &SIM5320CellularStack::_urc_ipclose));
     _at.set_urc_handler("+RECEIVE,", callback(this, &SIM5320CellularStack::_urc_receive));
     _at.set_urc_handler("+IP ERROR: No data", callback(this, &SIM5320CellularStack::_urc_ciprxget_no_data));
+    _at.set_urc_handler("+CIPSEND:", callback(this, &SIM5320CellularStack::_urc_cipsend));
+    _at.set_urc_handler("+CIPOPEN:", callback(this, &SIM5320CellularStack::_urc_cipopen));
+    _at.set_urc_handler("+CIPCLOSE:", callback(this, &SIM5320CellularStack::_urc_cipclose));
+    _socket_event_thread.start(callback(&_socket_event_queue, &events::EventQueue::dispatch_forever));
+    _dns_thread.start(callback(&_dns_queue, &events::EventQueue::dispatch_forever));
+    // note: synchronization is skipped in push receive mode
+    if (SOCKET_RX_RECONCILE_PERIOD > 0) {
+        _rx_reconcile_event_id = _queue->call_every(SOCKET_RX_RECONCILE_PERIOD, callback(this, &SIM5320CellularStack::_rx_reconcile_timeout));
+    }
 }
 
 SIM5320CellularStack::~SIM5320CellularStack()
@@ -25,6 +113,35 @@ SIM5320CellularStack::~SIM5320CellularStack()
     _at.set_urc_handler("+IPCLOSE:", NULL);
     _at.set_urc_handler("+RECEIVE,", NULL);
     _at.set_urc_handler("+IP ERROR: No data", NULL);
+    _at.set_urc_handler("+CIPSEND:", NULL);
+    _at.set_urc_handler("+CIPOPEN:", NULL);
+    _at.set_urc_handler("+CIPCLOSE:", NULL);
+    if (_transparent_data_mode) {
+        // give serial port back to AT handler
+        _at.set_is_filehandle_usable(true);
+        _at.set_filehandle_sigio();
+    }
+    if (_open_timeout_event_id) {
+        _queue->cancel(_open_timeout_event_id);
+    }
+    if (_tx_flush_event_id) {
+        _queue->cancel(_tx_flush_event_id);
+    }
+    if (_rx_reconcile_event_id) {
+        _queue->cancel(_rx_reconcile_event_id);
+    }
+    _socket_event_queue.break_dispatch();
+    _socket_event_thread.join();
+    if (_recovery_event_id) {
+        _queue->cancel(_recovery_event_id);
+    }
+    _dns_queue.break_dispatch();
+    _dns_thread.join();
+
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        delete _rx_buffers[i];
+        delete[] _tx_coalescing[i].buf;
+    }
 }
 
 #define DNS_QUERY_TIMEOUT 32000
@@ -37,38 +154,213 @@ nsapi_error_t SIM5320CellularStack::gethostbyname(const char *host, SocketAddres
     if (address->set_ip_address(host)) {
         // the host is ip address, so skip
         err = NSAPI_ERROR_OK;
+    } else if (_dns_cache.find(host, address, err)) {
+        tr_debug("dns: use cached result for host %s (err %d)", host, err);
     } else {
-        ATHandlerLocker locker(_at);
-        _at.cmd_start("AT+CDNSGIP=");
-        _at.write_string(host);
-        _at.cmd_stop();
+        bool cacheable;
+        err = _resolve_host(host, ip_address, cacheable);
+        if (!err && !address->set_ip_address(ip_address)) {
+            err = NSAPI_ERROR_NO_CONNECTION;
+            cacheable = false;
+        }
+        if (cacheable) {
+            _dns_cache.add(host, address, err);
+        }
+    }
 
-        _at.set_at_timeout(DNS_QUERY_TIMEOUT);
-        _at.resp_start("+CDNSGIP:");
-        int ret_code = _at.read_int();
-        if (ret_code == 1) {
-            // skip PDP context id
-            _at.skip_param();
-            // read address
-            _at.read_string(ip_address, NSAPI_IP_SIZE);
-            if (address->set_ip_address(ip_address)) {
-                err = NSAPI_ERROR_OK;
-            }
+    return err;
+}
+
+nsapi_value_or_error_t SIM5320CellularStack::gethostbyname_async(const char *host, hostbyname_cb_t callback, nsapi_version_t version, const char *interface_name)
+{
+    SocketAddress address;
+    nsapi_error_t err;
+
+    if (address.set_ip_address(host)) {
+        // the host is ip address, so skip
+        callback(NSAPI_ERROR_OK, &address);
+        return NSAPI_ERROR_OK;
+    }
+    if (_dns_cache.find(host, &address, err)) {
+        tr_debug("dns: use cached result for host %s (err %d)", host, err);
+        if (!err) {
+            callback(NSAPI_ERROR_OK, &address);
+        }
+        return err;
+    }
+    if (strlen(host) > SIM5320DNSCache::MAX_HOST_LEN) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    _dns_mutex.lock();
+    dns_query_t *query = NULL;
+    for (int i = 0; i < _DNS_QUERY_COUNT; i++) {
+        if (_dns_queries[i].state == DNS_QUERY_FREE) {
+            query = &_dns_queries[i];
+            break;
+        }
+    }
+    if (!query) {
+        _dns_mutex.unlock();
+        tr_debug("dns: too many asynchronous queries");
+        return NSAPI_ERROR_NO_MEMORY;
+    }
+    if (!_dns_process_event_id) {
+        // AT+CDNSGIP can block AT interface up to DNS_QUERY_TIMEOUT, so it isn't executed from the driver event queue
+        _dns_process_event_id = _dns_queue.call(mbed::callback(this, &SIM5320CellularStack::_process_dns_queries));
+        if (!_dns_process_event_id) {
+            _dns_mutex.unlock();
+            return NSAPI_ERROR_NO_MEMORY;
+        }
+    }
+
+    _dns_query_id_counter = _dns_query_id_counter < INT_MAX ? _dns_query_id_counter + 1 : 1;
+    query->id = _dns_query_id_counter;
+    query->state = DNS_QUERY_PENDING;
+    query->cancelled = false;
+    strcpy(query->host, host);
+    query->callback = callback;
+    int query_id = query->id;
+    _dns_mutex.unlock();
+    tr_debug("dns: query %d for host %s is created", query_id, host);
+
+    return query_id;
+}
+
+nsapi_error_t SIM5320CellularStack::gethostbyname_async_cancel(int id)
+{
+    nsapi_error_t err = NSAPI_ERROR_PARAMETER;
+    _dns_mutex.lock();
+    for (int i = 0; i < _DNS_QUERY_COUNT; i++) {
+        dns_query_t *query = &_dns_queries[i];
+        if (query->state == DNS_QUERY_FREE || query->id != id || query->cancelled) {
+            continue;
+        }
+        if (query->state == DNS_QUERY_SENT) {
+            // the modem response is still expected, so keep query until it's received
+            query->cancelled = true;
         } else {
-            err = NSAPI_ERROR_DNS_FAILURE;
+            query->state = DNS_QUERY_FREE;
         }
-        _at.resp_stop();
-        _at.restore_at_timeout();
+        tr_debug("dns: query %d is cancelled", id);
+        err = NSAPI_ERROR_OK;
+        break;
+    }
+    _dns_mutex.unlock();
+    return err;
+}
+
+// "DNS GENERAL ERROR" code of the +CDNSGIP response. Modem returns it in case of network problems too
+#define CDNSGIP_GENERAL_ERROR 10
 
-        err = any_error(err, _at.get_last_error());
+nsapi_error_t SIM5320CellularStack::_read_dns_result(char *ip_address, bool &cacheable)
+{
+    nsapi_error_t err;
+    int ret_code = _at.read_int();
+    cacheable = false;
+    if (ret_code == 1) {
+        _at.skip_param();
+        _at.read_string(ip_address, NSAPI_IP_SIZE);
+        err = NSAPI_ERROR_OK;
+        cacheable = true;
+    } else {
+        // only explicit resolution failures are cached, as general error can be caused by temporary network problems
+        int error_code = _at.read_int();
+        cacheable = error_code >= 0 && error_code != CDNSGIP_GENERAL_ERROR;
+        err = NSAPI_ERROR_DNS_FAILURE;
     }
+    err = any_error(_at.get_last_error(), err);
+    if (err != NSAPI_ERROR_OK && err != NSAPI_ERROR_DNS_FAILURE) {
+        cacheable = false;
+    }
+    return err;
+}
+
+nsapi_error_t SIM5320CellularStack::_resolve_host(const char *host, char *ip_address, bool &cacheable)
+{
+    // modem sends final result of the AT+CDNSGIP after "+CDNSGIP:" message and doesn't accept other commands
+    // till it, so AT interface is held during whole query
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _transparent_suspend();
+    _at.clear_error();
+    _at.set_at_timeout(DNS_QUERY_TIMEOUT);
+    _at.cmd_start("AT+CDNSGIP=");
+    _at.write_string(host);
+    _at.cmd_stop();
 
+    _at.resp_start("+CDNSGIP:");
+    nsapi_error_t err = _read_dns_result(ip_address, cacheable);
+    _at.resp_stop();
+    _at.restore_at_timeout();
+
+    err = any_error(err, _at.get_last_error());
+    if (err != NSAPI_ERROR_OK && err != NSAPI_ERROR_DNS_FAILURE) {
+        cacheable = false;
+    }
     return err;
 }
 
+void SIM5320CellularStack::_process_dns_queries()
+{
+    while (true) {
+        char host[SIM5320DNSCache::MAX_HOST_LEN + 1];
+        char ip_address[NSAPI_IP_SIZE];
+        SocketAddress address;
+        bool cacheable;
+
+        // find oldest pending query
+        _dns_mutex.lock();
+        dns_query_t *query = NULL;
+        for (int i = 0; i < _DNS_QUERY_COUNT; i++) {
+            dns_query_t *current_query = &_dns_queries[i];
+            if (current_query->state != DNS_QUERY_PENDING) {
+                continue;
+            }
+            if (!query || current_query->id - query->id < 0) {
+                query = current_query;
+            }
+        }
+        if (!query) {
+            _dns_process_event_id = 0;
+            _dns_mutex.unlock();
+            break;
+        }
+        query->state = DNS_QUERY_SENT;
+        strcpy(host, query->host);
+        tr_debug("dns: query %d is sent", query->id);
+        _dns_mutex.unlock();
+
+        nsapi_error_t result = _resolve_host(host, ip_address, cacheable);
+        if (!result && !address.set_ip_address(ip_address)) {
+            result = NSAPI_ERROR_NO_CONNECTION;
+            cacheable = false;
+        }
+        if (cacheable) {
+            _dns_cache.add(host, &address, result);
+        }
+
+        _dns_mutex.lock();
+        hostbyname_cb_t query_callback = query->callback;
+        bool cancelled = query->cancelled;
+        tr_debug("dns: query %d is completed (err %d)", query->id, result);
+        query->state = DNS_QUERY_FREE;
+        _dns_mutex.unlock();
+
+        // invoke callback without locks
+        if (!cancelled) {
+            query_callback(result, result ? NULL : &address);
+        }
+    }
+}
+
+SIM5320DNSCache *SIM5320CellularStack::get_dns_cache()
+{
+    return &_dns_cache;
+}
+
 int SIM5320CellularStack::get_max_socket_count()
 {
-    return 10;
+    return _SOCKET_COUNT;
 }
 
 bool SIM5320CellularStack::is_protocol_supported(nsapi_protocol_t protocol)
@@ -85,196 +377,1077 @@ bool SIM5320CellularStack::is_protocol_supported(nsapi_protocol_t protocol)
 
 #define TCP_OPEN_TIMEOUT 30000
 
+#ifdef MBED_CONF_SIM5320_DRIVER_SOCKET_NONBLOCKING_CONNECT
+#define SOCKET_NONBLOCKING_CONNECT MBED_CONF_SIM5320_DRIVER_SOCKET_NONBLOCKING_CONNECT
+#else
+#define SOCKET_NONBLOCKING_CONNECT false
+#endif
+
+#ifdef MBED_CONF_SIM5320_DRIVER_SOCKET_RX_BUFFER_SIZE
+#define SOCKET_RX_BUFFER_SIZE MBED_CONF_SIM5320_DRIVER_SOCKET_RX_BUFFER_SIZE
+#else
+#define SOCKET_RX_BUFFER_SIZE 4096
+#endif
+
 nsapi_error_t SIM5320CellularStack::create_socket_impl(AT_CellularStack::CellularSocket *socket)
 {
-    int open_code = -1;
-    int link_num;
-
     // use socket index as socket id
-    int sock_id = -1;
-    for (int i = 0; i < get_max_socket_count(); i++) {
-        if (_socket[i] == socket) {
-            sock_id = i;
-            break;
-        }
-    }
+    int sock_id = _find_socket_id(socket);
     if (sock_id < 0) {
         tr_debug("socket.create: cannot resolve socket id");
         return NSAPI_ERROR_NO_SOCKET;
     }
 
     socket->id = sock_id;
-    ATHandlerLocker locker(_at);
-    tr_debug("socket.create, sock_id %d: create ...", sock_id);
+    if (_transparent_mode) {
+        return _transparent_open(socket);
+    }
     if (socket->proto == NSAPI_TCP) {
-        // ignore socket creation, if remote address isn't set
-        if (!socket->remoteAddress) {
-            tr_debug("socket.create, sock_id %d: remote address isn't set", sock_id);
-            return NSAPI_ERROR_NO_SOCKET;
-        }
+        // TCP sockets are opened by socket_connect
+        tr_debug("socket.create, sock_id %d: TCP socket isn't connected", sock_id);
+        return NSAPI_ERROR_NO_CONNECTION;
+    } else if (socket->proto != NSAPI_UDP) {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    tr_debug("socket.create, sock_id %d: create ...", sock_id);
+    _wait_link_closed(sock_id);
+    return _open_udp_link(socket);
+}
 
-        _at.cmd_start("AT+CIPOPEN=");
-        _at.write_int(sock_id);
-        _at.write_string("TCP");
+nsapi_error_t SIM5320CellularStack::_open_udp_link(AT_CellularStack::CellularSocket *socket)
+{
+    int sock_id = socket->id;
+    _link_stats[sock_id].at_round_trips++;
+    _at.cmd_start("AT+CIPOPEN=");
+    _at.write_int(sock_id);
+    _at.write_string("UDP");
+    if (socket->remoteAddress) {
         _at.write_string(socket->remoteAddress.get_ip_address());
         _at.write_int(socket->remoteAddress.get_port());
-        _at.write_int(socket->localAddress.get_port());
-        _at.cmd_stop();
-        _at.resp_start();
-        _at.resp_stop();
-        // wait connection confirmation
-        _at.set_at_timeout(TCP_OPEN_TIMEOUT);
-        _at.resp_start("+CIPOPEN:");
-        _at.restore_at_timeout();
-        link_num = _at.read_int();
-        open_code = _at.read_int();
-        _at.consume_to_stop_tag();
-    } else if (socket->proto == NSAPI_UDP) {
-        _at.cmd_start("AT+CIPOPEN=");
-        _at.write_int(sock_id);
-        _at.write_string("UDP");
-        if (socket->remoteAddress) {
-            _at.write_string(socket->remoteAddress.get_ip_address());
-            _at.write_int(socket->remoteAddress.get_port());
-        } else {
-            _at.write_string("", false);
-            _at.write_string("", false);
-        }
-        _at.write_int(socket->localAddress.get_port());
-        _at.cmd_stop();
-        // check open result
-        _at.resp_start("+CIPOPEN:");
-        link_num = _at.read_int();
-        open_code = _at.read_int();
-        _at.consume_to_stop_tag();
     } else {
-        return NSAPI_ERROR_UNSUPPORTED;
+        _at.write_string("", false);
+        _at.write_string("", false);
     }
+    _at.write_int(socket->localAddress.get_port());
+    _at.cmd_stop();
+    // check open result
+    _at.resp_start("+CIPOPEN:");
+    _at.read_int();
+    int open_code = _at.read_int();
+    _at.consume_to_stop_tag();
     nsapi_error_t err = _at.get_last_error();
 
     if (err || open_code != 0) {
         tr_debug("socket.create, sock_id %d: fail to create, err = %d, open_code = %d", sock_id, err, open_code);
+        _link_states[sock_id] = LINK_CLOSED;
         return NSAPI_ERROR_NO_SOCKET;
     }
     tr_debug("socket.create, sock_id %d: created", sock_id);
-
-    socket->started = true;
-    socket->pending_bytes = 0;
-    _active_sockets |= 0x0001 << sock_id;
+    _init_opened_socket(socket);
     return NSAPI_ERROR_OK;
 }
 
-nsapi_error_t SIM5320CellularStack::socket_close_impl(int sock_id)
+nsapi_error_t SIM5320CellularStack::socket_connect(nsapi_socket_t handle, const SocketAddress &address)
 {
-    ATHandlerLocker locker(_at);
-    _at.cmd_start("AT+CIPCLOSE=");
-    _at.write_int(sock_id);
-    _at.cmd_stop();
-    // get OK or ERROR (note: a URC code can appear before OK or ERROR)
-    // FIXME: without delay it can cause freezing if a UDP socket is used
-    wait_ms(10);
-    _at.resp_start("OK");
-    _at.resp_stop();
+    CellularSocket *socket = (CellularSocket *)handle;
+    if (!socket) {
+        return NSAPI_ERROR_DEVICE_ERROR;
+    }
+    if (socket->proto != NSAPI_TCP) {
+        return AT_CellularStack::socket_connect(handle, address);
+    }
 
-    if (!(_active_sockets & (0x0001 << sock_id))) {
-        // ignore error if we tried to close the closed socket
-        _at.clear_error();
+    int sock_id = _find_socket_id(socket);
+    if (sock_id < 0) {
+        tr_debug("socket.connect: cannot resolve socket id");
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    if (_transparent_mode) {
+        if (socket == _transparent_socket) {
+            return NSAPI_ERROR_IS_CONNECTED;
+        }
+        // the transparent connection is blocking, as the serial port is occupied by data after it
+        socket->remoteAddress = address;
+        socket->id = sock_id;
+        nsapi_error_t err = _transparent_open(socket);
+        if (err) {
+            socket->id = -1;
+            return err;
+        }
+        socket->connected = true;
+        return NSAPI_ERROR_OK;
+    }
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    if (socket->id >= 0) {
+        switch (_link_states[sock_id]) {
+        case LINK_OPENING:
+        case LINK_RECOVERING:
+            return NSAPI_ERROR_ALREADY;
+        case LINK_OPEN:
+            return NSAPI_ERROR_IS_CONNECTED;
+        case LINK_OPEN_FAILED:
+            // report error once and allow new connection attempt
+            _link_states[sock_id] = LINK_CLOSED;
+            socket->id = -1;
+            socket->created = false;
+            return NSAPI_ERROR_NO_CONNECTION;
+        default:
+            break;
+        }
     }
-    // mark socket as closed
-    _active_sockets &= ~(0x0001 << sock_id);
-    tr_debug("socket.close, sock_id %d: closed (err %d)", sock_id, _at.get_last_error());
 
-    return _at.get_last_error();
+    // start connection
+    _wait_link_closed(sock_id);
+    socket->remoteAddress = address;
+    socket->id = sock_id;
+    nsapi_error_t err = _start_tcp_open(socket);
+    if (err) {
+        socket->id = -1;
+        return err;
+    }
+    socket->created = true;
+    if (!SOCKET_NONBLOCKING_CONNECT) {
+        return _wait_tcp_open(socket);
+    }
+    _open_deadlines[sock_id] = rtos::Kernel::get_ms_count() + TCP_OPEN_TIMEOUT;
+    _schedule_tcp_open_timeout();
+    tr_debug("socket.connect, sock_id %d: connection is in progress", sock_id);
+    return NSAPI_ERROR_IN_PROGRESS;
 }
 
-#define MAX_WRITE_BLOCK_SIZE 1500
-
-nsapi_size_or_error_t SIM5320CellularStack::socket_sendto_impl(AT_CellularStack::CellularSocket *socket, const SocketAddress &address, const void *data, nsapi_size_t size)
+nsapi_error_t SIM5320CellularStack::_wait_tcp_open(AT_CellularStack::CellularSocket *socket)
 {
     int sock_id = socket->id;
-    tr_debug("socket.send, sock_id %d: send data ...", sock_id);
-    if (size == 0) {
-        tr_debug("socket.send, sock_id %d: no data to send", sock_id);
-        return 0;
+    _at.set_at_timeout(TCP_OPEN_TIMEOUT);
+    while (_link_states[sock_id] == LINK_OPENING) {
+        _at.resp_start("+CIPOPEN:");
+        int link_num = _at.read_int();
+        int open_code = _at.read_int();
+        _at.consume_to_stop_tag();
+        if (_at.get_last_error()) {
+            break;
+        }
+        // results of the non-blocking connections can be received too
+        _process_tcp_open_result(link_num, open_code);
     }
-    // if socket is closed, then return error
-    if (!(_active_sockets & 0x0001 << sock_id)) {
-        tr_debug("socket.send, sock_id %d: socket has been closed", sock_id);
-        return NSAPI_ERROR_CONNECTION_LOST;
+    _at.restore_at_timeout();
+
+    if (_link_states[sock_id] == LINK_OPENING) {
+        tr_debug("socket.connect, sock_id %d: connection timeout", sock_id);
+        _at.clear_error();
+        _at.cmd_start("AT+CIPCLOSE=");
+        _at.write_int(sock_id);
+        _at.cmd_stop_read_resp();
+        _at.clear_error();
+        _process_tcp_open_result(sock_id, -1);
     }
+    _schedule_tcp_open_timeout();
 
-    switch (socket->proto) {
-    case NSAPI_TCP:
-        if (size > MAX_WRITE_BLOCK_SIZE) {
-            size = MAX_WRITE_BLOCK_SIZE;
-        }
-        break;
-    case NSAPI_UDP:
-        if (size > MAX_WRITE_BLOCK_SIZE) {
-            return NSAPI_ERROR_PARAMETER;
+    if (_link_states[sock_id] != LINK_OPEN) {
+        _link_states[sock_id] = LINK_CLOSED;
+        socket->id = -1;
+        socket->created = false;
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+    return NSAPI_ERROR_OK;
+}
+
+int SIM5320CellularStack::_find_socket_id(AT_CellularStack::CellularSocket *socket)
+{
+    for (int i = 0; i < get_max_socket_count(); i++) {
+        if (_socket[i] == socket) {
+            return i;
         }
-        break;
-    default:
-        return NSAPI_ERROR_UNSUPPORTED;
     }
+    return -1;
+}
 
-    ATHandlerLocker locker(_at);
-    // write send command
-    switch (socket->proto) {
-    case NSAPI_TCP:
-        _at.cmd_start("AT+CIPSEND=");
-        _at.write_int(socket->id);
-        _at.write_int(size);
-        _at.cmd_stop();
-        break;
-    case NSAPI_UDP:
-        _at.cmd_start("AT+CIPSEND=");
-        _at.write_int(socket->id);
-        _at.write_int(size);
-        _at.write_string(address.get_ip_address());
-        _at.write_int(address.get_port());
-        _at.cmd_stop();
-        break;
-    default:
-        return NSAPI_ERROR_UNSUPPORTED;
+nsapi_error_t SIM5320CellularStack::_start_tcp_open(AT_CellularStack::CellularSocket *socket)
+{
+    int sock_id = socket->id;
+    // ignore socket creation, if remote address isn't set
+    if (!socket->remoteAddress) {
+        tr_debug("socket.create, sock_id %d: remote address isn't set", sock_id);
+        return NSAPI_ERROR_NO_SOCKET;
     }
-    // write data
-    _at.resp_start(">", true);
-    _at.write_bytes((const uint8_t *)data, size);
 
-    // read actual amount of the data that has been send
+    _link_stats[sock_id].at_round_trips++;
+    _at.cmd_start("AT+CIPOPEN=");
+    _at.write_int(sock_id);
+    _at.write_string("TCP");
+    _at.write_string(socket->remoteAddress.get_ip_address());
+    _at.write_int(socket->remoteAddress.get_port());
+    _at.write_int(socket->localAddress.get_port());
+    _at.cmd_stop();
     _at.resp_start();
     _at.resp_stop();
-    _at.resp_start("+CIPSEND:");
-    int link_num = _at.read_int();
-    int req_send_length = _at.read_int();
-    int cnf_send_length = _at.read_int();
-    _at.consume_to_stop_tag();
     nsapi_error_t err = _at.get_last_error();
-
     if (err) {
-        tr_debug("socket.send, sock_id %d: fail to parse response", sock_id);
-        return err;
+        tr_debug("socket.create, sock_id %d: AT+CIPOPEN error %d", sock_id, err);
+        return NSAPI_ERROR_NO_SOCKET;
     }
-    if (cnf_send_length < 0 || req_send_length != cnf_send_length) {
-        // error, close socket
-        _active_sockets &= ~(0x0001 << sock_id);
-        tr_debug("socket.send, sock_id %d: error, close socket", sock_id);
-        return NSAPI_ERROR_CONNECTION_LOST;
+    _link_states[sock_id] = LINK_OPENING;
+    return NSAPI_ERROR_OK;
+}
+
+void SIM5320CellularStack::_process_tcp_open_result(int link_id, int open_code)
+{
+    CellularSocket *socket = _get_socket(link_id);
+    if (!socket || _link_states[link_id] != LINK_OPENING) {
+        tr_debug("socket.connect, sock_id %d: unexpected +CIPOPEN result", link_id);
+        return;
+    }
+    if (open_code == 0) {
+        tr_debug("socket.connect, sock_id %d: connected", link_id);
+        _init_opened_socket(socket);
+        socket->connected = true;
+        _complete_link_open(link_id, NSAPI_ERROR_OK);
+    } else {
+        tr_debug("socket.connect, sock_id %d: fail to connect, open_code = %d", link_id, open_code);
+        _complete_link_open(link_id, NSAPI_ERROR_NO_CONNECTION);
+    }
+}
+
+void SIM5320CellularStack::_complete_link_open(int link_id, nsapi_error_t result)
+{
+    bool recovering = _link_recovering[link_id];
+    _link_recovering[link_id] = false;
+    if (result) {
+        // reopening error means that connection is lost
+        _link_states[link_id] = recovering ? LINK_PEER_CLOSED : LINK_OPEN_FAILED;
+    }
+    _notify_socket(link_id);
+    if (recovering && _link_recovered_cb) {
+        _queue->call(_link_recovered_cb, link_id, result);
+    }
+}
+
+void SIM5320CellularStack::_init_opened_socket(AT_CellularStack::CellularSocket *socket)
+{
+    int sock_id = socket->id;
+    if (_rx_push_mode) {
+        if (!_rx_buffers[sock_id]) {
+            _rx_buffers[sock_id] = new ByteRingBuffer(SOCKET_RX_BUFFER_SIZE);
+        }
+        _rx_buffers[sock_id]->clear();
+    }
+
+    socket->started = true;
+    socket->created = true;
+    socket->pending_bytes = 0;
+    _rx_counted_ahead[sock_id] = 0;
+    _link_states[sock_id] = LINK_OPEN;
+    _send_pending_chunks[sock_id] = 0;
+}
+
+void SIM5320CellularStack::_schedule_tcp_open_timeout()
+{
+    uint64_t deadline = 0;
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        if (_link_states[i] == LINK_OPENING && (deadline == 0 || _open_deadlines[i] < deadline)) {
+            deadline = _open_deadlines[i];
+        }
+    }
+    if (_open_timeout_event_id) {
+        _queue->cancel(_open_timeout_event_id);
+        _open_timeout_event_id = 0;
+    }
+    if (deadline) {
+        uint64_t now = rtos::Kernel::get_ms_count();
+        int delay = deadline > now ? deadline - now : 0;
+        _open_timeout_event_id = _queue->call_in(delay, callback(this, &SIM5320CellularStack::_tcp_open_timeout));
+    }
+}
+
+void SIM5320CellularStack::_tcp_open_timeout()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _open_timeout_event_id = 0;
+    uint64_t now = rtos::Kernel::get_ms_count();
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        if (_link_states[i] != LINK_OPENING || _open_deadlines[i] > now) {
+            continue;
+        }
+        tr_debug("socket.connect, sock_id %d: connection timeout", i);
+        // abort connection
+        _at.cmd_start("AT+CIPCLOSE=");
+        _at.write_int(i);
+        _at.cmd_stop_read_resp();
+        _at.clear_error();
+        _process_tcp_open_result(i, -1);
+    }
+    _schedule_tcp_open_timeout();
+}
+
+nsapi_error_t SIM5320CellularStack::socket_close_impl(int sock_id)
+{
+    if (_transparent_socket && _transparent_socket->id == sock_id) {
+        return _transparent_close();
+    }
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    // send buffered data before closing
+    if (_tx_coalescing[sock_id].len > 0 && _link_states[sock_id] == LINK_OPEN) {
+        _flush_tx_buffer(sock_id);
+        _at.clear_error();
+    }
+    _tx_coalescing[sock_id].len = 0;
+    LinkState state = _link_states[sock_id];
+    // confirmations of the unconfirmed chunks won't be received
+    _send_pending_chunks[sock_id] = 0;
+    // drop unread data
+    if (_rx_buffers[sock_id]) {
+        _rx_buffers[sock_id]->clear();
+    }
+
+    if (state == LINK_CLOSING) {
+        tr_debug("socket.close, sock_id %d: link is already closing", sock_id);
+        return NSAPI_ERROR_OK;
+    }
+    _link_recovering[sock_id] = false;
+    if (state == LINK_CLOSED || state == LINK_OPEN_FAILED || state == LINK_PEER_CLOSED || state == LINK_RECOVERING) {
+        // link has been closed by modem, so there is nothing to close
+        _link_states[sock_id] = LINK_CLOSED;
+        tr_debug("socket.close, sock_id %d: closed", sock_id);
+        return NSAPI_ERROR_OK;
+    }
+
+    _link_states[sock_id] = LINK_CLOSING;
+    _link_stats[sock_id].at_round_trips++;
+    _at.cmd_start("AT+CIPCLOSE=");
+    _at.write_int(sock_id);
+    _at.cmd_stop();
+    // get OK or ERROR, the close result is reported with "+CIPCLOSE:" URC
+    _at.resp_start();
+    _at.resp_stop();
+    nsapi_error_t err = _at.get_last_error();
+    if (err) {
+        // note: if link is already closed, then "+CIPCLOSE: <link_id>,4" message is received before ERROR
+        _at.clear_error();
+        if (_link_states[sock_id] == LINK_CLOSING) {
+            _complete_link_close(sock_id, err);
+        }
+    }
+    tr_debug("socket.close, sock_id %d: closing is started (err %d)", sock_id, err);
+    return err == NSAPI_ERROR_DEVICE_ERROR ? NSAPI_ERROR_OK : err;
+}
+
+#define LINK_CLOSE_TIMEOUT 15000
+
+void SIM5320CellularStack::_wait_link_closed(int sock_id)
+{
+    if (_link_states[sock_id] != LINK_CLOSING) {
+        return;
+    }
+    tr_debug("socket, sock_id %d: wait link closing", sock_id);
+    _at.set_at_timeout(LINK_CLOSE_TIMEOUT);
+    while (_link_states[sock_id] == LINK_CLOSING) {
+        // note: results of other links can be received
+        _at.resp_start("+CIPCLOSE:");
+        int link_id = _at.read_int();
+        int close_code = _at.read_int();
+        _at.consume_to_stop_tag();
+        if (_at.get_last_error()) {
+            break;
+        }
+        _complete_link_close(link_id, close_code == 0 ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR);
+    }
+    _at.restore_at_timeout();
+    if (_link_states[sock_id] == LINK_CLOSING) {
+        tr_debug("socket, sock_id %d: link closing timeout", sock_id);
+        _complete_link_close(sock_id, any_error(_at.get_last_error(), NSAPI_ERROR_TIMEOUT));
+        _at.clear_error();
+    }
+}
+
+void SIM5320CellularStack::_complete_link_close(int link_id, nsapi_error_t result)
+{
+    if (link_id < 0 || link_id >= _SOCKET_COUNT || _link_states[link_id] != LINK_CLOSING) {
+        tr_debug("socket.close, sock_id %d: unexpected +CIPCLOSE result", link_id);
+        return;
+    }
+    _link_states[link_id] = LINK_CLOSED;
+    tr_debug("socket.close, sock_id %d: closed (err %d)", link_id, result);
+    if (_link_closed_cb) {
+        _queue->call(_link_closed_cb, link_id, result);
+    }
+}
+
+void SIM5320CellularStack::set_link_closed_callback(Callback<void(int, nsapi_error_t)> callback)
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _link_closed_cb = callback;
+}
+
+void SIM5320CellularStack::set_network_recovery_timeout(int timeout)
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _recovery_timeout = timeout > 0 ? timeout : 0;
+}
+
+void SIM5320CellularStack::set_link_recovered_callback(Callback<void(int, nsapi_error_t)> callback)
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _link_recovered_cb = callback;
+}
+
+void SIM5320CellularStack::set_network_lost_callback(Callback<void(int)> callback)
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _network_lost_cb = callback;
+}
+
+void SIM5320CellularStack::_start_network_recovery()
+{
+    bool recovery_required = false;
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        CellularSocket *socket = _get_socket(i);
+        LinkState state = _link_states[i];
+        if (!socket || socket == _transparent_socket || (state != LINK_OPEN && state != LINK_OPENING)) {
+            _disconnect_socket_by_peer(i);
+            continue;
+        }
+        tr_debug("socket, sock_id %d: link will be recovered", i);
+        // connection attempt is just repeated, but connected socket should be notified
+        _link_recovering[i] = state == LINK_OPEN;
+        _link_states[i] = LINK_RECOVERING;
+        // unconfirmed, unread and buffered data is lost
+        _send_pending_chunks[i] = 0;
+        _tx_coalescing[i].len = 0;
+        socket->pending_bytes = 0;
+        if (_rx_buffers[i]) {
+            _rx_buffers[i]->clear();
+        }
+        recovery_required = true;
+    }
+    if (!recovery_required || _recovery_event_id) {
+        return;
+    }
+    // network is reopened by context, and links are reopened when it notifies stack with network_reopened
+    tr_debug("network: recovery is started");
+    _recovery_event_id = _queue->call_in(_recovery_timeout, callback(this, &SIM5320CellularStack::_network_recovery_timeout));
+}
+
+void SIM5320CellularStack::network_reopened()
+{
+    if (!_recovery_event_id) {
+        return;
+    }
+    _queue->cancel(_recovery_event_id);
+    _recovery_event_id = _queue->call(callback(this, &SIM5320CellularStack::_reopen_recovering_links));
+}
+
+void SIM5320CellularStack::_network_recovery_timeout()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _recovery_event_id = 0;
+    tr_debug("network: recovery timeout");
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        if (_link_states[i] == LINK_RECOVERING) {
+            _complete_link_open(i, NSAPI_ERROR_CONNECTION_TIMEOUT);
+        }
+    }
+}
+
+void SIM5320CellularStack::_reopen_recovering_links()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _recovery_event_id = 0;
+
+    // reopen links with cached remote endpoints
+    tr_debug("network: network has been reopened");
+    uint64_t now = rtos::Kernel::get_ms_count();
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        CellularSocket *socket = _get_socket(i);
+        if (_link_states[i] != LINK_RECOVERING || !socket) {
+            continue;
+        }
+        if (socket->proto == NSAPI_TCP) {
+            if (_start_tcp_open(socket)) {
+                _complete_link_open(i, NSAPI_ERROR_NO_CONNECTION);
+            } else {
+                _open_deadlines[i] = now + TCP_OPEN_TIMEOUT;
+            }
+        } else {
+            _complete_link_open(i, _open_udp_link(socket) ? NSAPI_ERROR_NO_CONNECTION : NSAPI_ERROR_OK);
+        }
+        _at.clear_error();
+    }
+    _schedule_tcp_open_timeout();
+}
+
+bool SIM5320CellularStack::_is_link_recovering(int sock_id)
+{
+    return _link_states[sock_id] == LINK_RECOVERING || (_link_states[sock_id] == LINK_OPENING && _link_recovering[sock_id]);
+}
+
+#define MAX_WRITE_BLOCK_SIZE 1500
+
+#ifdef MBED_CONF_SIM5320_DRIVER_TCP_SEND_WINDOW
+#define TCP_SEND_WINDOW MBED_CONF_SIM5320_DRIVER_TCP_SEND_WINDOW
+#else
+#define TCP_SEND_WINDOW 1
+#endif
+
+#ifdef MBED_CONF_SIM5320_DRIVER_UDP_BATCH_WINDOW
+#define UDP_BATCH_WINDOW MBED_CONF_SIM5320_DRIVER_UDP_BATCH_WINDOW
+#else
+#define UDP_BATCH_WINDOW 4
+#endif
+
+nsapi_size_or_error_t SIM5320CellularStack::socket_sendto_impl(AT_CellularStack::CellularSocket *socket, const SocketAddress &address, const void *data, nsapi_size_t size)
+{
+    iovec_t iov = { data, size };
+    return _socket_sendmsg(socket, &address, &iov, 1);
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::socket_sendmsg(nsapi_socket_t handle, const SocketAddress *address, const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    CellularSocket *socket = (CellularSocket *)handle;
+    if (!socket || iov_count < 0 || (iov_count > 0 && !iov)) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    if (socket->proto == NSAPI_UDP && !address) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    if (socket->id == -1) {
+        // UDP socket is created on the first send, but TCP socket should be connected
+        if (socket->proto != NSAPI_UDP) {
+            return NSAPI_ERROR_NO_CONNECTION;
+        }
+        nsapi_error_t err = create_socket_impl(socket);
+        if (err) {
+            return err;
+        }
+    }
+    return _socket_sendmsg(socket, address, iov, iov_count);
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_socket_sendmsg(AT_CellularStack::CellularSocket *socket, const SocketAddress *address, const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    nsapi_size_or_error_t result = _socket_send_iov(socket, address, iov, iov_count);
+    if (result > 0) {
+        _link_stats[socket->id].tx_bytes += result;
+    } else if (result == NSAPI_ERROR_WOULD_BLOCK) {
+        _link_stats[socket->id].would_block++;
+    }
+    return result;
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_socket_send_iov(AT_CellularStack::CellularSocket *socket, const SocketAddress *address, const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    int sock_id = socket->id;
+    nsapi_size_t size = _get_iov_size(iov, iov_count);
+    tr_debug("socket.send, sock_id %d: send data ...", sock_id);
+    if (size == 0) {
+        tr_debug("socket.send, sock_id %d: no data to send", sock_id);
+        return 0;
+    }
+    if (socket == _transparent_socket) {
+        nsapi_size_t sent = 0;
+        for (int i = 0; i < iov_count; i++) {
+            if (iov[i].size == 0) {
+                continue;
+            }
+            nsapi_size_or_error_t res = _transparent_send((const uint8_t *)iov[i].data, iov[i].size);
+            if (res < 0) {
+                return sent > 0 ? (nsapi_size_or_error_t)sent : res;
+            }
+            sent += res;
+            if ((nsapi_size_t)res < iov[i].size) {
+                break;
+            }
+        }
+        return sent;
+    }
+    if (_link_states[sock_id] == LINK_OPENING || _link_states[sock_id] == LINK_RECOVERING) {
+        tr_debug("socket.send, sock_id %d: connection is in progress", sock_id);
+        return NSAPI_ERROR_WOULD_BLOCK;
+    }
+    // if socket is closed, then return error
+    if (_link_states[sock_id] != LINK_OPEN) {
+        tr_debug("socket.send, sock_id %d: socket has been closed", sock_id);
+        return NSAPI_ERROR_CONNECTION_LOST;
+    }
+
+    switch (socket->proto) {
+    case NSAPI_TCP:
+        if (_tx_coalescing[sock_id].buf) {
+            if (iov_count == 1) {
+                return _socket_send_coalesced(socket, (const uint8_t *)iov[0].data, size);
+            }
+            // keep data order
+            nsapi_error_t err = _flush_tx_buffer(sock_id);
+            if (err) {
+                return err;
+            }
+        }
+        return _socket_send_tcp(socket, iov, iov_count);
+    case NSAPI_UDP:
+        if (size > MAX_WRITE_BLOCK_SIZE) {
+            return NSAPI_ERROR_PARAMETER;
+        }
+        return _socket_send_udp(socket, *address, iov, iov_count);
+    default:
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_socket_send_tcp(AT_CellularStack::CellularSocket *socket, const uint8_t *data, nsapi_size_t size)
+{
+    iovec_t iov = { data, size };
+    return _socket_send_tcp(socket, &iov, 1);
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_socket_send_tcp(AT_CellularStack::CellularSocket *socket, const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    nsapi_error_t err;
+    int sock_id = socket->id;
+    const int window = TCP_SEND_WINDOW > 0 ? TCP_SEND_WINDOW : 1;
+    nsapi_size_t size = _get_iov_size(iov, iov_count);
+    nsapi_size_t sent = 0;
+
+    // don't hold AT interface too long
+    if (size > window * MAX_WRITE_BLOCK_SIZE) {
+        size = window * MAX_WRITE_BLOCK_SIZE;
+    }
+
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    while (sent < size) {
+        // wait free slot in the send window
+        if ((err = _wait_send_confirmations(sock_id, window - 1))) {
+            break;
+        }
+        if (_link_states[sock_id] != LINK_OPEN) {
+            break;
+        }
+
+        nsapi_size_t chunk_size = size - sent;
+        if (chunk_size > MAX_WRITE_BLOCK_SIZE) {
+            chunk_size = MAX_WRITE_BLOCK_SIZE;
+        }
+        uint64_t start_time = rtos::Kernel::get_ms_count();
+        _at.cmd_start("AT+CIPSEND=");
+        _at.write_int(sock_id);
+        _at.write_int(chunk_size);
+        _at.cmd_stop();
+        // write data
+        _at.resp_start(">", true);
+        _write_iov(iov, iov_count, sent, chunk_size);
+        // wait OK, the +CIPSEND confirmation will be processed later
+        _at.resp_start();
+        _at.resp_stop();
+        _stats_add_latency(_link_stats[sock_id].cipsend_latency, start_time);
+        _link_stats[sock_id].at_round_trips++;
+        if ((err = _at.get_last_error())) {
+            tr_debug("socket.send, sock_id %d: fail to send data chunk", sock_id);
+            break;
+        }
+        _send_pending_chunks[sock_id]++;
+        sent += chunk_size;
+    }
+    if (window == 1 && sent > 0) {
+        // without window all data should be confirmed immediately and send errors are reported by this invocation
+        if ((err = _wait_send_confirmations(sock_id, 0))) {
+            return err;
+        }
+        if (_link_states[sock_id] != LINK_OPEN) {
+            tr_debug("socket.send, sock_id %d: chunk isn't confirmed", sock_id);
+            return NSAPI_ERROR_CONNECTION_LOST;
+        }
+    }
+
+    if (sent == 0) {
+        if (_link_states[sock_id] != LINK_OPEN) {
+            tr_debug("socket.send, sock_id %d: error, close socket", sock_id);
+            return NSAPI_ERROR_CONNECTION_LOST;
+        }
+        tr_debug("socket.send, sock_id %d: fail to send data", sock_id);
+        return any_error(_at.get_last_error(), NSAPI_ERROR_DEVICE_ERROR);
+    }
+    tr_debug("socket.send, sock_id %d: %i bytes have been sent (%d unconfirmed chunks)", sock_id, sent, _send_pending_chunks[sock_id]);
+    return sent;
+}
+
+nsapi_error_t SIM5320CellularStack::socket_open(nsapi_socket_t *handle, nsapi_protocol_t proto)
+{
+    nsapi_error_t err = AT_CellularStack::socket_open(handle, proto);
+    if (!err) {
+        // reset options of the previous socket
+        ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+        int sock_id = _find_socket_id((CellularSocket *)*handle);
+        if (sock_id >= 0) {
+            _set_tx_coalescing(sock_id, NULL);
+        }
+    }
+    return err;
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::socket_sendto(nsapi_socket_t handle, const SocketAddress &address, const void *data, nsapi_size_t size)
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    return AT_CellularStack::socket_sendto(handle, address, data, size);
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::socket_recvfrom(nsapi_socket_t handle, SocketAddress *address, void *buffer, nsapi_size_t size)
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    return AT_CellularStack::socket_recvfrom(handle, address, buffer, size);
+}
+
+nsapi_error_t SIM5320CellularStack::setsockopt(nsapi_socket_t handle, int level, int optname, const void *optval, unsigned optlen)
+{
+    CellularSocket *socket = (CellularSocket *)handle;
+    if (level != SOCKET_OPT_LEVEL) {
+        return AT_CellularStack::setsockopt(handle, level, optname, optval, optlen);
+    }
+    int sock_id = _find_socket_id(socket);
+    if (sock_id < 0) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    if (socket->proto != NSAPI_TCP) {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    switch (optname) {
+    case SOCKET_OPT_TCP_COALESCING:
+        if (!optval || optlen != sizeof(tcp_coalescing_t)) {
+            return NSAPI_ERROR_PARAMETER;
+        }
+        return _set_tx_coalescing(sock_id, (const tcp_coalescing_t *)optval);
+    case SOCKET_OPT_TCP_FLUSH:
+        if (_tx_coalescing[sock_id].len == 0) {
+            return NSAPI_ERROR_OK;
+        }
+        if (_link_states[sock_id] != LINK_OPEN) {
+            _tx_coalescing[sock_id].len = 0;
+            return NSAPI_ERROR_CONNECTION_LOST;
+        }
+        return _flush_tx_buffer(sock_id);
+    default:
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+}
+
+nsapi_error_t SIM5320CellularStack::_set_tx_coalescing(int sock_id, const SIM5320CellularStack::tcp_coalescing_t *options)
+{
+    tx_coalescing_t *tx = &_tx_coalescing[sock_id];
+    nsapi_size_t size = options ? options->buffer_size : 0;
+    if (size > MAX_WRITE_BLOCK_SIZE) {
+        size = MAX_WRITE_BLOCK_SIZE;
+    }
+
+    // send accumulated data before buffer changing
+    if (tx->len > 0 && _link_states[sock_id] == LINK_OPEN) {
+        _flush_tx_buffer(sock_id);
+        _at.clear_error();
+    }
+    tx->len = 0;
+    if (tx->size != size) {
+        delete[] tx->buf;
+        tx->buf = size > 0 ? new uint8_t[size] : NULL;
+        tx->size = size;
+    }
+    tx->flush_delay = options && options->flush_delay > 0 ? options->flush_delay : 0;
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_socket_send_coalesced(AT_CellularStack::CellularSocket *socket, const uint8_t *data, nsapi_size_t size)
+{
+    int sock_id = socket->id;
+    tx_coalescing_t *tx = &_tx_coalescing[sock_id];
+    nsapi_error_t err;
+
+    if (tx->len + size > tx->size) {
+        // no space for new data
+        if ((err = _flush_tx_buffer(sock_id))) {
+            return err;
+        }
+    }
+    if (size >= tx->size) {
+        // big data doesn't require coalescing
+        return _socket_send_tcp(socket, data, size);
+    }
+
+    memcpy(tx->buf + tx->len, data, size);
+    if (tx->len == 0) {
+        tx->flush_deadline = tx->flush_delay ? rtos::Kernel::get_ms_count() + tx->flush_delay : 0;
+    }
+    tx->len += size;
+    tr_debug("socket.send, sock_id %d: %d bytes are buffered", sock_id, tx->len);
+    if (tx->len == tx->size) {
+        // the data has been accepted, so error will be reported by the next operation
+        _flush_tx_buffer(sock_id);
+    }
+    _schedule_tx_flush();
+    return size;
+}
+
+nsapi_error_t SIM5320CellularStack::_flush_tx_buffer(int sock_id)
+{
+    tx_coalescing_t *tx = &_tx_coalescing[sock_id];
+    CellularSocket *socket = _get_socket(sock_id);
+    nsapi_size_t sent = 0;
+    nsapi_error_t err = socket ? NSAPI_ERROR_OK : NSAPI_ERROR_NO_SOCKET;
+
+    while (!err && sent < tx->len) {
+        nsapi_size_or_error_t res = _socket_send_tcp(socket, tx->buf + sent, tx->len - sent);
+        if (res < 0) {
+            err = res;
+        } else {
+            sent += res;
+        }
+    }
+    tx->len = 0;
+    if (err && _link_states[sock_id] == LINK_OPEN) {
+        // buffered data is lost, so the connection can't be used anymore
+        tr_debug("socket.send, sock_id %d: fail to send buffered data (err %d)", sock_id, err);
+        _link_states[sock_id] = LINK_BROKEN;
+        _notify_socket(sock_id);
+    }
+    return err;
+}
+
+void SIM5320CellularStack::_schedule_tx_flush()
+{
+    uint64_t deadline = 0;
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        tx_coalescing_t *tx = &_tx_coalescing[i];
+        if (tx->len > 0 && tx->flush_deadline && (!deadline || tx->flush_deadline < deadline)) {
+            deadline = tx->flush_deadline;
+        }
+    }
+    if (_tx_flush_event_id) {
+        _queue->cancel(_tx_flush_event_id);
+        _tx_flush_event_id = 0;
+    }
+    if (deadline) {
+        uint64_t now = rtos::Kernel::get_ms_count();
+        int delay = deadline > now ? deadline - now : 0;
+        _tx_flush_event_id = _queue->call_in(delay, callback(this, &SIM5320CellularStack::_tx_flush_timeout));
+    }
+}
+
+void SIM5320CellularStack::_tx_flush_timeout()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _tx_flush_event_id = 0;
+    uint64_t now = rtos::Kernel::get_ms_count();
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        tx_coalescing_t *tx = &_tx_coalescing[i];
+        if (tx->len == 0 || !tx->flush_deadline || tx->flush_deadline > now) {
+            continue;
+        }
+        if (_link_states[i] == LINK_OPEN) {
+            _flush_tx_buffer(i);
+            _at.clear_error();
+        } else {
+            tx->len = 0;
+        }
+    }
+    _schedule_tx_flush();
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_socket_send_udp(AT_CellularStack::CellularSocket *socket, const SocketAddress &address, const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    int sock_id = socket->id;
+    nsapi_size_t size = _get_iov_size(iov, iov_count);
+
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    nsapi_error_t err = _write_udp_datagram(socket, address, iov, iov_count);
+    if (err) {
+        tr_debug("socket.send, sock_id %d: AT+CIPSEND error %d", sock_id, err);
+        return err;
+    }
+
+    // read actual amount of the data that has been send
+    err = _wait_send_confirmations(sock_id, 0);
+    if (err) {
+        tr_debug("socket.send, sock_id %d: fail to parse response", sock_id);
+        return err;
+    }
+    if (_link_states[sock_id] != LINK_OPEN) {
+        tr_debug("socket.send, sock_id %d: error, close socket", sock_id);
+        return NSAPI_ERROR_CONNECTION_LOST;
+    }
+
+    tr_debug("socket.send, sock_id %d: %i bytes have been sent", sock_id, size);
+    return size;
+}
+
+nsapi_error_t SIM5320CellularStack::_write_udp_datagram(AT_CellularStack::CellularSocket *socket, const SocketAddress &address, const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    int sock_id = socket->id;
+    nsapi_size_t size = _get_iov_size(iov, iov_count);
+    uint64_t start_time = rtos::Kernel::get_ms_count();
+    // write send command
+    _at.cmd_start("AT+CIPSEND=");
+    _at.write_int(sock_id);
+    _at.write_int(size);
+    _at.write_string(address.get_ip_address());
+    _at.write_int(address.get_port());
+    _at.cmd_stop();
+    // write data
+    _at.resp_start(">", true);
+    _write_iov(iov, iov_count, 0, size);
+    _at.resp_start();
+    _at.resp_stop();
+    _stats_add_latency(_link_stats[sock_id].cipsend_latency, start_time);
+    _link_stats[sock_id].at_round_trips++;
+    nsapi_error_t err = _at.get_last_error();
+    if (err == NSAPI_ERROR_OK) {
+        _send_pending_chunks[sock_id]++;
+    }
+    return err;
+}
+
+void SIM5320CellularStack::_write_iov(const SIM5320CellularStack::iovec_t *iov, int iov_count, nsapi_size_t offset, nsapi_size_t size)
+{
+    for (int i = 0; i < iov_count && size > 0; i++) {
+        if (offset >= iov[i].size) {
+            offset -= iov[i].size;
+            continue;
+        }
+        nsapi_size_t len = iov[i].size - offset;
+        if (len > size) {
+            len = size;
+        }
+        _at.write_bytes((const uint8_t *)iov[i].data + offset, len);
+        size -= len;
+        offset = 0;
+    }
+}
+
+nsapi_size_t SIM5320CellularStack::_get_iov_size(const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    nsapi_size_t size = 0;
+    for (int i = 0; i < iov_count; i++) {
+        size += iov[i].size;
+    }
+    return size;
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::socket_sendto_batch(nsapi_socket_t handle, SIM5320CellularStack::udp_datagram_t *datagrams, int count)
+{
+    CellularSocket *socket = (CellularSocket *)handle;
+    if (!socket || socket->proto != NSAPI_UDP || count < 0) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    if (socket->id == -1) {
+        nsapi_error_t err = create_socket_impl(socket);
+        if (err) {
+            return err;
+        }
+    }
+    int sock_id = socket->id;
+    if (_link_states[sock_id] != LINK_OPEN) {
+        tr_debug("socket.send, sock_id %d: socket has been closed", sock_id);
+        return NSAPI_ERROR_CONNECTION_LOST;
+    }
+
+    const int window = UDP_BATCH_WINDOW > 0 ? UDP_BATCH_WINDOW : 1;
+    // note: previous datagrams are always confirmed
+    uint32_t confirmed_base = _send_confirmed_chunks[sock_id];
+    // number of the written datagrams, they are datagrams before the first failed one
+    int written_num = 0;
+    for (int i = 0; i < count; i++) {
+        datagrams[i].result = 0;
+    }
+    for (; written_num < count; written_num++) {
+        udp_datagram_t *datagram = &datagrams[written_num];
+        if (datagram->size == 0 || datagram->size > MAX_WRITE_BLOCK_SIZE) {
+            datagram->result = NSAPI_ERROR_PARAMETER;
+            break;
+        }
+        if (_wait_send_confirmations(sock_id, window - 1) || _link_states[sock_id] != LINK_OPEN) {
+            datagram->result = any_error(_at.get_last_error(), NSAPI_ERROR_CONNECTION_LOST);
+            break;
+        }
+        iovec_t iov = { datagram->data, datagram->size };
+        nsapi_error_t err = _write_udp_datagram(socket, datagram->address, &iov, 1);
+        if (err) {
+            datagram->result = err;
+            break;
+        }
+        // mark datagram as sent, it's checked after confirmations
+        datagram->result = datagram->size;
+        _link_stats[sock_id].tx_bytes += datagram->size;
+    }
+    nsapi_error_t confirmation_err = _wait_send_confirmations(sock_id, 0);
+    _at.clear_error();
+
+    // modem confirms datagrams of the link in the order of the AT+CIPSEND commands,
+    // and the link is broken after the first unconfirmed datagram
+    int confirmed_num = _send_confirmed_chunks[sock_id] - confirmed_base;
+    int failed_index = confirmed_num < written_num ? confirmed_num : written_num;
+    for (int i = failed_index; i < written_num; i++) {
+        udp_datagram_t *datagram = &datagrams[i];
+        _link_stats[sock_id].tx_bytes -= datagram->size;
+        datagram->result = any_error(confirmation_err, NSAPI_ERROR_CONNECTION_LOST);
+    }
+    tr_debug("socket.send, sock_id %d: %d/%d datagrams have been sent", sock_id, failed_index, count);
+    return failed_index;
+}
+
+nsapi_error_t SIM5320CellularStack::_wait_send_confirmations(int sock_id, int max_pending_chunks)
+{
+    while (_send_pending_chunks[sock_id] > max_pending_chunks && !_at.get_last_error()) {
+        // note: confirmations of other sockets can be received
+        _at.resp_start("+CIPSEND:");
+        int link_num = _at.read_int();
+        int req_send_length = _at.read_int();
+        int cnf_send_length = _at.read_int();
+        _at.consume_to_stop_tag();
+        if (!_at.get_last_error()) {
+            _process_send_confirmation(link_num, req_send_length, cnf_send_length);
+        }
     }
+    return _at.get_last_error();
+}
 
-    if (req_send_length == 0) {
-        tr_debug("socket.send, sock_id %d: socket is blocked", sock_id);
-        return NSAPI_ERROR_WOULD_BLOCK;
+void SIM5320CellularStack::_process_send_confirmation(int link_id, int req_send_length, int cnf_send_length)
+{
+    CellularSocket *socket = _get_socket(link_id);
+    if (!socket || _send_pending_chunks[link_id] <= 0) {
+        tr_debug("socket.send, sock_id %d: unexpected send confirmation", link_id);
+        return;
+    }
+    _send_pending_chunks[link_id]--;
+    if (cnf_send_length >= 0 && req_send_length == cnf_send_length) {
+        _send_confirmed_chunks[link_id]++;
     } else {
-        tr_debug("socket.send, sock_id %d: %i bytes have been sent", sock_id, req_send_length);
-        return req_send_length;
+        // error, mark socket as failed and close it
+        tr_debug("socket.send, sock_id %d: chunk isn't confirmed (%d/%d bytes)", link_id, cnf_send_length, req_send_length);
+        _send_pending_chunks[link_id] = 0;
+        if (_link_states[link_id] == LINK_OPEN) {
+            _link_states[link_id] = LINK_BROKEN;
+        }
+        _notify_socket(socket);
     }
 }
 
 #define MAX_READ_BLOCK_SIZE 230
 
 nsapi_size_or_error_t SIM5320CellularStack::socket_recvfrom_impl(AT_CellularStack::CellularSocket *socket, SocketAddress *address, void *buffer, nsapi_size_t size)
+{
+    nsapi_size_or_error_t result = _socket_recvfrom(socket, address, buffer, size);
+    if (result > 0) {
+        _link_stats[socket->id].rx_bytes += result;
+    } else if (result == NSAPI_ERROR_WOULD_BLOCK) {
+        _link_stats[socket->id].would_block++;
+    }
+    return result;
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_socket_recvfrom(AT_CellularStack::CellularSocket *socket, SocketAddress *address, void *buffer, nsapi_size_t size)
 {
     nsapi_error_t err;
     nsapi_size_or_error_t result;
@@ -291,6 +1464,14 @@ nsapi_size_or_error_t SIM5320CellularStack::socket_recvfrom_impl(AT_CellularStac
         return 0;
     }
 
+    if (socket == _transparent_socket) {
+        return _transparent_recv(buffer, size);
+    }
+
+    if (_rx_push_mode) {
+        return _socket_recv_pushed_data(socket, buffer, size);
+    }
+
     // limit size (it's probably should be limited by serial buffer size)
     if (size > MAX_READ_BLOCK_SIZE) {
         size = MAX_READ_BLOCK_SIZE;
@@ -298,7 +1479,7 @@ nsapi_size_or_error_t SIM5320CellularStack::socket_recvfrom_impl(AT_CellularStac
     _at.process_oob();
 
     if (socket->pending_bytes == 0) {
-        if (!(_active_sockets & 0x0001 << sock_id)) {
+        if (_link_states[sock_id] != LINK_OPEN && !_is_link_recovering(sock_id)) {
             // socket is closed and there are nothing to read
             tr_debug("socket.recv, sock_id %d: socket has been closed", sock_id);
             return 0;
@@ -311,7 +1492,8 @@ nsapi_size_or_error_t SIM5320CellularStack::socket_recvfrom_impl(AT_CellularStac
     switch (socket->proto) {
     case NSAPI_TCP:
     case NSAPI_UDP: {
-        ATHandlerLocker locker(_at);
+        ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+        uint64_t start_time = rtos::Kernel::get_ms_count();
         // read data to free input buffer for data
         _at.cmd_start("AT+CIPRXGET=");
         _at.write_int(2); // read mode
@@ -342,12 +1524,19 @@ nsapi_size_or_error_t SIM5320CellularStack::socket_recvfrom_impl(AT_CellularStac
 
         _at.read_bytes((uint8_t *)buffer, read_len);
         _at.resp_stop();
+        _stats_add_latency(_link_stats[sock_id].ciprxget_latency, start_time);
+        _link_stats[sock_id].at_round_trips++;
         if (_ciprxget_no_data) {
+            _link_stats[sock_id].no_data_errors++;
             _at.clear_error();
+            read_len = 0;
+            rest_len = 0;
         }
         err = _at.get_last_error();
         if (!err) {
+            // modem reports rest of the data, so the counter is corrected without additional commands
             socket->pending_bytes -= read_len;
+            _set_rx_pending_bytes(socket, rest_len);
         }
 
         if (err) {
@@ -371,6 +1560,420 @@ nsapi_size_or_error_t SIM5320CellularStack::socket_recvfrom_impl(AT_CellularStac
     return result;
 }
 
+nsapi_size_or_error_t SIM5320CellularStack::_socket_recv_pushed_data(AT_CellularStack::CellularSocket *socket, void *buffer, nsapi_size_t size)
+{
+    int sock_id = socket->id;
+    nsapi_size_or_error_t result;
+
+    // note: process URCs with data that can be in the serial buffer
+    _at.process_oob();
+
+    // lock AT handler to prevent buffer modification by URC handler
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    ByteRingBuffer *rx_buffer = _rx_buffers[sock_id];
+    if (!rx_buffer || rx_buffer->size() == 0) {
+        if (_link_states[sock_id] == LINK_BROKEN) {
+            tr_debug("socket.recv, sock_id %d: socket is broken", sock_id);
+            return NSAPI_ERROR_CONNECTION_LOST;
+        } else if (_link_states[sock_id] != LINK_OPEN && !_is_link_recovering(sock_id)) {
+            tr_debug("socket.recv, sock_id %d: socket has been closed", sock_id);
+            return 0;
+        } else {
+            tr_debug("socket.recv, sock_id %d: no data to read", sock_id);
+            return NSAPI_ERROR_WOULD_BLOCK;
+        }
+    }
+
+    if (socket->proto == NSAPI_UDP) {
+        // UDP datagram is stored with 2 byte length header
+        uint8_t header[2];
+        rx_buffer->pop(header, 2);
+        nsapi_size_t datagram_size = header[0] << 8 | header[1];
+        result = rx_buffer->pop((uint8_t *)buffer, datagram_size < size ? datagram_size : size);
+        // drop rest of the datagram
+        if (datagram_size > size) {
+            rx_buffer->pop(NULL, datagram_size - size);
+        }
+    } else {
+        result = rx_buffer->pop((uint8_t *)buffer, size);
+    }
+    socket->pending_bytes = rx_buffer->size();
+
+    tr_debug("socket.recv, sock_id %d: %d bytes has been read", sock_id, result);
+    return result;
+}
+
+#define PUSHED_DATA_BLOCK_SIZE 64
+
+void SIM5320CellularStack::_receive_pushed_data(AT_CellularStack::CellularSocket *socket, int link_id, int num_bytes)
+{
+    uint8_t block[PUSHED_DATA_BLOCK_SIZE];
+    ByteRingBuffer *rx_buffer = socket ? _rx_buffers[link_id] : NULL;
+    size_t required_space = socket && socket->proto == NSAPI_UDP ? num_bytes + 2 : num_bytes;
+
+    if (socket && socket->proto == NSAPI_TCP && _link_states[link_id] == LINK_BROKEN) {
+        // stream has a gap already, so next data is useless
+        _link_stats[link_id].rx_dropped_bytes += num_bytes;
+        rx_buffer = NULL;
+    } else if (!rx_buffer || rx_buffer->free_space() < required_space) {
+        // there is no space for data, so drop it
+        tr_debug("socket.recv, sock_id %d: rx buffer overflow, drop %d bytes", link_id, num_bytes);
+        if (socket) {
+            _link_stats[link_id].rx_dropped_bytes += num_bytes;
+            if (socket->proto == NSAPI_TCP && _link_states[link_id] == LINK_OPEN) {
+                // TCP stream cannot be continued without lost data, so report error after buffered data reading
+                _link_states[link_id] = LINK_BROKEN;
+                _notify_socket(socket);
+            }
+        }
+        rx_buffer = NULL;
+    } else if (required_space != (size_t)num_bytes) {
+        uint8_t header[2] = { (uint8_t)(num_bytes >> 8), (uint8_t)(num_bytes & 0xFF) };
+        rx_buffer->push(header, 2);
+    }
+
+    while (num_bytes > 0) {
+        int block_size = num_bytes < PUSHED_DATA_BLOCK_SIZE ? num_bytes : PUSHED_DATA_BLOCK_SIZE;
+        if (_at.read_bytes(block, block_size) != block_size) {
+            break;
+        }
+        if (rx_buffer) {
+            rx_buffer->push(block, block_size);
+        }
+        num_bytes -= block_size;
+    }
+    if (socket && rx_buffer) {
+        socket->pending_bytes = rx_buffer->size();
+    }
+}
+
+nsapi_error_t SIM5320CellularStack::get_socket_stats(int link_id, SIM5320CellularStack::socket_stats_t &stats)
+{
+    if (link_id < 0 || link_id >= _SOCKET_COUNT) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    stats = _link_stats[link_id];
+    return NSAPI_ERROR_OK;
+}
+
+void SIM5320CellularStack::reset_socket_stats()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    memset(_link_stats, 0, sizeof(_link_stats));
+}
+
+nsapi_error_t SIM5320CellularStack::reconcile_rx_pending_bytes()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    return _reconcile_rx_pending_bytes();
+}
+
+nsapi_error_t SIM5320CellularStack::_reconcile_rx_pending_bytes()
+{
+    if (_rx_push_mode || _transparent_data_mode) {
+        return NSAPI_ERROR_OK;
+    }
+
+    nsapi_error_t err = NSAPI_ERROR_OK;
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        CellularSocket *socket = _get_socket(i);
+        if (!socket || socket == _transparent_socket || _link_states[i] != LINK_OPEN) {
+            continue;
+        }
+        _link_stats[i].at_round_trips++;
+        _at.cmd_start("AT+CIPRXGET=");
+        _at.write_int(4);
+        _at.write_int(i);
+        _at.cmd_stop();
+        // +CIPRXGET: 4,<link_id>,<rest_len>
+        int pending_bytes = -1;
+        while (true) {
+            _at.resp_start("+CIPRXGET:");
+            if (!_at.info_resp()) {
+                break;
+            }
+            if (_at.read_int() == 4) {
+                _at.read_int();
+                pending_bytes = _at.read_int();
+                break;
+            }
+            // +CIPRXGET: 1,<link_id> notifications should be ignored
+            _at.consume_to_stop_tag();
+        }
+        _at.resp_stop();
+        err = _at.get_last_error();
+        if (err) {
+            tr_debug("socket.recv, sock_id %d: fail to get pending data length", i);
+            break;
+        }
+        if (pending_bytes >= 0) {
+            _set_rx_pending_bytes(socket, pending_bytes);
+        }
+    }
+    return err;
+}
+
+void SIM5320CellularStack::_set_rx_pending_bytes(AT_CellularStack::CellularSocket *socket, int pending_bytes)
+{
+    if (socket->pending_bytes == pending_bytes) {
+        return;
+    }
+    tr_debug("socket.recv, sock_id %d: correct pending bytes %d -> %d", socket->id, socket->pending_bytes, pending_bytes);
+    // note: if the modem reports more data of the socket with known pending bytes, then "+RECEIVE" notification
+    // can be just delayed, so it isn't counted as a drift
+    if (pending_bytes < socket->pending_bytes || socket->pending_bytes == 0) {
+        _link_stats[socket->id].rx_drift_corrections++;
+    }
+    // "+RECEIVE" notification of the new data can follow the response, so it shouldn't be counted twice
+    _rx_counted_ahead[socket->id] = pending_bytes > socket->pending_bytes ? pending_bytes - socket->pending_bytes : 0;
+    bool notify = socket->pending_bytes == 0;
+    socket->pending_bytes = pending_bytes;
+    if (notify) {
+        // data has been lost without notification
+        _notify_socket(socket);
+    }
+}
+
+void SIM5320CellularStack::_rx_reconcile_timeout()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _reconcile_rx_pending_bytes();
+    _at.clear_error();
+}
+
+void SIM5320CellularStack::_stats_add_latency(SIM5320CellularStack::latency_stats_t &stats, uint64_t start_time)
+{
+    uint32_t latency = rtos::Kernel::get_ms_count() - start_time;
+    if (stats.count == 0 || latency < stats.min_ms) {
+        stats.min_ms = latency;
+    }
+    if (latency > stats.max_ms) {
+        stats.max_ms = latency;
+    }
+    stats.total_ms += latency;
+    stats.count++;
+    stats.avg_ms = stats.total_ms / stats.count;
+}
+
+void SIM5320CellularStack::set_transparent_mode(bool enabled)
+{
+    _transparent_mode = enabled;
+}
+
+bool SIM5320CellularStack::is_transparent_mode() const
+{
+    return _transparent_mode;
+}
+
+void SIM5320CellularStack::set_rx_push_mode(bool enabled)
+{
+    _rx_push_mode = enabled;
+}
+
+bool SIM5320CellularStack::is_rx_push_mode() const
+{
+    return _rx_push_mode;
+}
+
+nsapi_error_t SIM5320CellularStack::suspend_transparent_mode()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    return _transparent_suspend();
+}
+
+// transparent mode supports only one link
+#define TRANSPARENT_LINK_ID 0
+// silence time before and after "+++" escape sequence
+#define TRANSPARENT_ESCAPE_GUARD_TIME 1000
+
+nsapi_error_t SIM5320CellularStack::_transparent_open(AT_CellularStack::CellularSocket *socket)
+{
+    int sock_id = socket->id;
+    if (socket->proto != NSAPI_TCP) {
+        tr_debug("socket.create, sock_id %d: only TCP is supported in the transparent mode", sock_id);
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    if (_transparent_socket) {
+        tr_debug("socket.create, sock_id %d: transparent link is busy", sock_id);
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    if (!socket->remoteAddress) {
+        tr_debug("socket.create, sock_id %d: remote address isn't set", sock_id);
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    tr_debug("socket.create, sock_id %d: create transparent connection ...", sock_id);
+    _at.cmd_start("AT+CIPOPEN=");
+    _at.write_int(TRANSPARENT_LINK_ID);
+    _at.write_string("TCP");
+    _at.write_string(socket->remoteAddress.get_ip_address());
+    _at.write_int(socket->remoteAddress.get_port());
+    _at.write_int(socket->localAddress.get_port());
+    _at.cmd_stop();
+    // modem responds with "CONNECT <baudrate>" and switches serial port into data mode
+    _at.set_at_timeout(TCP_OPEN_TIMEOUT);
+    _at.resp_start("CONNECT");
+    _at.consume_to_stop_tag();
+    _at.restore_at_timeout();
+    nsapi_error_t err = _at.get_last_error();
+    if (err) {
+        tr_debug("socket.create, sock_id %d: fail to create transparent connection, err = %d", sock_id, err);
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    tr_debug("socket.create, sock_id %d: created", sock_id);
+
+    _init_opened_socket(socket);
+    _transparent_socket = socket;
+    _transparent_start_data_mode();
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t SIM5320CellularStack::_transparent_close()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    int sock_id = _transparent_socket->id;
+    _transparent_suspend();
+    _at.clear_error();
+    _at.cmd_start("AT+CIPCLOSE=");
+    _at.write_int(TRANSPARENT_LINK_ID);
+    _at.cmd_stop();
+    _at.resp_start();
+    _at.resp_stop();
+    // ignore error if connection has been closed by peer
+    _at.clear_error();
+
+    _transparent_socket = NULL;
+    _link_states[sock_id] = LINK_CLOSED;
+    tr_debug("socket.close, sock_id %d: closed", sock_id);
+    return NSAPI_ERROR_OK;
+}
+
+void SIM5320CellularStack::_transparent_start_data_mode()
+{
+    // disable AT handler processing and take notifications of the serial port
+    _at.set_is_filehandle_usable(false);
+    _transparent_data_mode = true;
+    _transparent_last_write_time = rtos::Kernel::get_ms_count();
+    _at.get_file_handle()->sigio(callback(this, &SIM5320CellularStack::_transparent_sigio));
+}
+
+nsapi_error_t SIM5320CellularStack::_transparent_suspend()
+{
+    if (!_transparent_data_mode) {
+        return NSAPI_ERROR_OK;
+    }
+    _transparent_data_mode = false;
+    _at.set_is_filehandle_usable(true);
+    _at.set_filehandle_sigio();
+
+    // wait guard time after last data
+    uint64_t guard_end = _transparent_last_write_time + TRANSPARENT_ESCAPE_GUARD_TIME;
+    uint64_t now = rtos::Kernel::get_ms_count();
+    if (guard_end > now) {
+        wait_ms(guard_end - now);
+    }
+    // drop unread data
+    _at.flush();
+    _at.write_bytes((const uint8_t *)"+++", 3);
+    // modem responds with OK after guard time
+    _at.set_at_timeout(TRANSPARENT_ESCAPE_GUARD_TIME * 2);
+    _at.resp_start();
+    _at.resp_stop();
+    _at.restore_at_timeout();
+    nsapi_error_t err = _at.get_last_error();
+    if (err) {
+        // modem is already in command mode (connection is closed), so finish line with "+++" characters
+        _at.clear_error();
+        _at.write_bytes((const uint8_t *)"\r", 1);
+        _at.resp_start();
+        _at.resp_stop();
+        _at.clear_error();
+    }
+    tr_debug("socket: transparent data mode is suspended (err %d)", err);
+    return err;
+}
+
+nsapi_error_t SIM5320CellularStack::_transparent_resume()
+{
+    if (_transparent_data_mode) {
+        return NSAPI_ERROR_OK;
+    }
+    _at.cmd_start("ATO");
+    _at.cmd_stop();
+    _at.resp_start("CONNECT");
+    _at.consume_to_stop_tag();
+    nsapi_error_t err = _at.get_last_error();
+    if (err) {
+        tr_debug("socket: fail to resume transparent data mode (err %d)", err);
+        // connection is probably closed
+        _link_states[_transparent_socket->id] = LINK_PEER_CLOSED;
+        return err;
+    }
+    _transparent_start_data_mode();
+    tr_debug("socket: transparent data mode is resumed");
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_transparent_send(const uint8_t *data, nsapi_size_t size)
+{
+    if (_transparent_resume()) {
+        return NSAPI_ERROR_CONNECTION_LOST;
+    }
+    // write data directly to serial port
+    FileHandle *fh = _at.get_file_handle();
+    nsapi_size_t sent = 0;
+    while (sent < size) {
+        ssize_t res = fh->write(data + sent, size - sent);
+        if (res == -EAGAIN) {
+            break;
+        } else if (res < 0) {
+            return sent > 0 ? (nsapi_size_or_error_t)sent : NSAPI_ERROR_DEVICE_ERROR;
+        }
+        sent += res;
+    }
+    if (sent == 0) {
+        return NSAPI_ERROR_WOULD_BLOCK;
+    }
+    _transparent_last_write_time = rtos::Kernel::get_ms_count();
+    return sent;
+}
+
+nsapi_size_or_error_t SIM5320CellularStack::_transparent_recv(void *buffer, nsapi_size_t size)
+{
+    if (_transparent_resume()) {
+        // socket is closed
+        return 0;
+    }
+    // read data directly from serial port
+    ssize_t res = _at.get_file_handle()->read(buffer, size);
+    if (res == -EAGAIN) {
+        return NSAPI_ERROR_WOULD_BLOCK;
+    } else if (res < 0) {
+        return NSAPI_ERROR_DEVICE_ERROR;
+    }
+    return res;
+}
+
+void SIM5320CellularStack::_transparent_sigio()
+{
+    // note: it's invoked from interrupt context, so notify socket from event queue
+    if (!_transparent_notify_pending) {
+        _transparent_notify_pending = true;
+        _queue->call(callback(this, &SIM5320CellularStack::_transparent_notify));
+    }
+}
+
+void SIM5320CellularStack::_transparent_notify()
+{
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_DATA);
+    _transparent_notify_pending = false;
+    if (_transparent_data_mode) {
+        _notify_socket(_transparent_socket);
+    }
+}
+
 AT_CellularStack::CellularSocket *SIM5320CellularStack::_get_socket(int link_id)
 {
     if (link_id >= 0 && link_id < get_max_socket_count()) {
@@ -382,42 +1985,129 @@ AT_CellularStack::CellularSocket *SIM5320CellularStack::_get_socket(int link_id)
 
 void SIM5320CellularStack::_notify_socket(int link_id)
 {
-    _notify_socket(_get_socket(link_id));
+    if (link_id < 0 || link_id >= _SOCKET_COUNT) {
+        return;
+    }
+    _socket_event_mutex.lock();
+    _socket_event_links |= 1 << link_id;
+    if (!_socket_events_event_id) {
+        _socket_events_event_id = _socket_event_queue.call(callback(this, &SIM5320CellularStack::_dispatch_socket_events));
+    }
+    _socket_event_mutex.unlock();
 }
 
 void SIM5320CellularStack::_notify_socket(AT_CellularStack::CellularSocket *socket)
 {
-    if (socket && socket->_cb) {
-        socket->_cb(socket->_data);
+    if (socket) {
+        _notify_socket(socket->id);
     }
 }
 
-void SIM5320CellularStack::_disconnect_socket_by_peer(int link_id)
+void SIM5320CellularStack::_dispatch_socket_events()
 {
-    _disconnect_socket_by_peer(_get_socket(link_id));
+    // note: callbacks are invoked without AT handler lock, as they can read/write socket data from other threads
+    _socket_event_mutex.lock();
+    uint32_t links = _socket_event_links;
+    _socket_event_links = 0;
+    _socket_events_event_id = 0;
+    for (int i = 0; i < _SOCKET_COUNT; i++) {
+        if (!(links & (1 << i)) || (_socket_closing_links & (1 << i))) {
+            continue;
+        }
+        CellularSocket *socket = _get_socket(i);
+        if (!socket || !socket->_cb) {
+            continue;
+        }
+        void (*socket_cb)(void *) = socket->_cb;
+        void *socket_data = socket->_data;
+        // socket closing waits till the end of the callback
+        _socket_callback_link = i;
+        _socket_event_mutex.unlock();
+        socket_cb(socket_data);
+        _socket_event_mutex.lock();
+        _socket_callback_link = -1;
+        _socket_event_cond.notify_all();
+    }
+    _socket_event_mutex.unlock();
 }
 
-void SIM5320CellularStack::_disconnect_socket_by_peer(AT_CellularStack::CellularSocket *socket)
+void SIM5320CellularStack::socket_attach(nsapi_socket_t handle, void (*callback)(void *), void *data)
 {
+    CellularSocket *socket = (CellularSocket *)handle;
     if (!socket) {
         return;
     }
+    _socket_event_mutex.lock();
+    socket->_cb = callback;
+    socket->_data = data;
+    _socket_event_mutex.unlock();
+}
+
+nsapi_error_t SIM5320CellularStack::socket_close(nsapi_socket_t handle)
+{
+    int link_id = _find_socket_id((CellularSocket *)handle);
+    if (link_id < 0) {
+        return AT_CellularStack::socket_close(handle);
+    }
+    // skip callbacks of the socket and wait current one, unless socket is closed from its own callback
+    _socket_event_mutex.lock();
+    _socket_closing_links |= 1 << link_id;
+    while (_socket_callback_link == link_id && rtos::ThisThread::get_id() != _socket_event_thread.get_id()) {
+        _socket_event_cond.wait();
+    }
+    _socket_event_mutex.unlock();
 
-    // mark socket as closed
-    _active_sockets &= ~(0x0001 << socket->id);
+    nsapi_error_t err = AT_CellularStack::socket_close(handle);
+
+    _socket_event_mutex.lock();
+    _socket_closing_links &= ~(1 << link_id);
+    _socket_event_mutex.unlock();
+    return err;
+}
+
+void SIM5320CellularStack::_disconnect_socket_by_peer(int link_id)
+{
+    if (link_id < 0 || link_id >= _SOCKET_COUNT) {
+        return;
+    }
 
-    if (socket->_cb) {
-        socket->_cb(socket->_data);
+    // mark link as closed
+    switch (_link_states[link_id]) {
+    case LINK_OPENING:
+        _complete_link_open(link_id, NSAPI_ERROR_NO_CONNECTION);
+        break;
+    case LINK_RECOVERING:
+        // link will be reopened, so ignore notifications about closing of the lost links
+        return;
+    case LINK_OPEN:
+    case LINK_BROKEN:
+        _link_states[link_id] = LINK_PEER_CLOSED;
+        break;
+    case LINK_CLOSING:
+        // link has been closed before "+CIPCLOSE:" message
+        _complete_link_close(link_id, NSAPI_ERROR_OK);
+        break;
+    default:
+        break;
     }
+    _send_pending_chunks[link_id] = 0;
+
+    _notify_socket(link_id);
 }
 
 void SIM5320CellularStack::_urc_cipevent()
 {
     _at.consume_to_stop_tag();
-    // close all connection
-    // TODO: find what should be done
-    for (int i = 0; i < get_max_socket_count(); i++) {
-        _disconnect_socket_by_peer(i);
+    // network has been closed, so modem has closed all links
+    if (_recovery_timeout > 0) {
+        _start_network_recovery();
+    } else {
+        for (int i = 0; i < get_max_socket_count(); i++) {
+            _disconnect_socket_by_peer(i);
+        }
+    }
+    if (_network_lost_cb) {
+        _network_lost_cb(_recovery_timeout);
     }
 }
 
@@ -434,11 +2124,23 @@ void SIM5320CellularStack::_urc_receive()
     int num_bytes = _at.read_int();
 
     CellularSocket *socket = _get_socket(link_id);
+    if (_rx_push_mode) {
+        // data follows the message
+        _receive_pushed_data(socket, link_id, num_bytes);
+    }
     if (!socket) {
         return;
     }
-    // count pending bytes
-    socket->pending_bytes += num_bytes;
+    // count pending bytes, if they haven't been counted by AT+CIPRXGET response
+    if (!_rx_push_mode) {
+        if (socket->pending_bytes == 0) {
+            // the counted data has been read or its notification has been lost, so count new data to avoid reading stall
+            _rx_counted_ahead[link_id] = 0;
+        }
+        int counted_bytes = num_bytes < _rx_counted_ahead[link_id] ? num_bytes : _rx_counted_ahead[link_id];
+        _rx_counted_ahead[link_id] -= counted_bytes;
+        socket->pending_bytes += num_bytes - counted_bytes;
+    }
     // notify socket
     _notify_socket(socket);
 }
@@ -447,3 +2149,32 @@ void SIM5320CellularStack::_urc_ciprxget_no_data()
 {
     _ciprxget_no_data = true;
 }
+
+void SIM5320CellularStack::_urc_cipopen()
+{
+    int link_id = _at.read_int();
+    int open_code = _at.read_int();
+    if (_at.get_last_error()) {
+        return;
+    }
+    _process_tcp_open_result(link_id, open_code);
+    _schedule_tcp_open_timeout();
+}
+
+void SIM5320CellularStack::_urc_cipclose()
+{
+    int link_id = _at.read_int();
+    int close_code = _at.read_int();
+    if (_at.get_last_error()) {
+        return;
+    }
+    _complete_link_close(link_id, close_code == 0 ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR);
+}
+
+void SIM5320CellularStack::_urc_cipsend()
+{
+    int link_id = _at.read_int();
+    int req_send_length = _at.read_int();
+    int cnf_send_length = _at.read_int();
+    _process_send_confirmation(link_id, req_send_length, cnf_send_length);
+}
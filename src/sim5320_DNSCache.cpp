@@ -0,0 +1,142 @@
+#include "sim5320_DNSCache.h"
+#include "string.h"
+
+using namespace sim5320;
+
+SIM5320DNSCache::SIM5320DNSCache(int capacity, int ttl, int negative_ttl)
+    : _entries(NULL)
+    , _capacity(capacity > 0 ? capacity : 0)
+    , _ttl(ttl)
+    , _negative_ttl(negative_ttl)
+    , _use_counter(0)
+{
+    if (_capacity > 0) {
+        _entries = new entry_t[_capacity];
+    }
+    clear();
+    reset_stats();
+}
+
+SIM5320DNSCache::~SIM5320DNSCache()
+{
+    delete[] _entries;
+}
+
+bool SIM5320DNSCache::find(const char *host, SocketAddress *address, nsapi_error_t &result)
+{
+    if (_capacity == 0) {
+        return false;
+    }
+
+    _mutex.lock();
+    entry_t *entry = _find_entry(host, rtos::Kernel::get_ms_count());
+    if (entry) {
+        _stats.hits++;
+        entry->last_use = ++_use_counter;
+        result = entry->result;
+        if (result == NSAPI_ERROR_OK) {
+            address->set_ip_address(entry->ip_address);
+        } else {
+            _stats.negative_hits++;
+        }
+    } else {
+        _stats.misses++;
+    }
+    _mutex.unlock();
+    return entry != NULL;
+}
+
+void SIM5320DNSCache::add(const char *host, const SocketAddress *address, nsapi_error_t result)
+{
+    if (_capacity == 0 || strlen(host) > MAX_HOST_LEN) {
+        return;
+    }
+    if (result != NSAPI_ERROR_OK && (result != NSAPI_ERROR_DNS_FAILURE || _negative_ttl <= 0)) {
+        return;
+    }
+    _mutex.lock();
+    uint64_t now = rtos::Kernel::get_ms_count();
+
+    // find existed entry or the least recently used one (expired entries are used at first)
+    entry_t *entry = NULL;
+    uint32_t entry_last_use = 0;
+    for (int i = 0; i < _capacity; i++) {
+        entry_t *current_entry = &_entries[i];
+        if (current_entry->host[0] != '\0' && strcmp(current_entry->host, host) == 0) {
+            entry = current_entry;
+            break;
+        }
+        uint32_t last_use = current_entry->expire_time > now ? current_entry->last_use : 0;
+        if (!entry || last_use < entry_last_use) {
+            entry = current_entry;
+            entry_last_use = last_use;
+        }
+    }
+    if (entry->host[0] != '\0' && strcmp(entry->host, host) != 0 && entry->expire_time > now) {
+        _stats.evictions++;
+    }
+
+    strcpy(entry->host, host);
+    entry->result = result;
+    if (result == NSAPI_ERROR_OK) {
+        strncpy(entry->ip_address, address->get_ip_address(), NSAPI_IP_SIZE - 1);
+        entry->ip_address[NSAPI_IP_SIZE - 1] = '\0';
+        entry->expire_time = now + _ttl;
+    } else {
+        entry->ip_address[0] = '\0';
+        entry->expire_time = now + _negative_ttl;
+    }
+    entry->last_use = ++_use_counter;
+    _mutex.unlock();
+}
+
+void SIM5320DNSCache::clear()
+{
+    _mutex.lock();
+    for (int i = 0; i < _capacity; i++) {
+        _entries[i].host[0] = '\0';
+        _entries[i].expire_time = 0;
+        _entries[i].last_use = 0;
+    }
+    _mutex.unlock();
+}
+
+void SIM5320DNSCache::set_ttl(int ttl, int negative_ttl)
+{
+    _mutex.lock();
+    _ttl = ttl;
+    _negative_ttl = negative_ttl;
+    _mutex.unlock();
+}
+
+void SIM5320DNSCache::get_stats(SIM5320DNSCache::stats_t &stats)
+{
+    _mutex.lock();
+    stats = _stats;
+    _mutex.unlock();
+}
+
+void SIM5320DNSCache::reset_stats()
+{
+    _mutex.lock();
+    memset(&_stats, 0, sizeof(_stats));
+    _mutex.unlock();
+}
+
+SIM5320DNSCache::entry_t *SIM5320DNSCache::_find_entry(const char *host, uint64_t now)
+{
+    for (int i = 0; i < _capacity; i++) {
+        entry_t *entry = &_entries[i];
+        if (entry->host[0] == '\0' || strcmp(entry->host, host) != 0) {
+            continue;
+        }
+        if (entry->expire_time <= now) {
+            // entry is expired, so remove it
+            entry->host[0] = '\0';
+            entry->last_use = 0;
+            return NULL;
+        }
+        return entry;
+    }
+    return NULL;
+}
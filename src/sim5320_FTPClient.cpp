@@ -12,10 +12,17 @@ using namespace sim5320;
 #define FTP_RESPONSE_TIMEOUT 24000
 #define FTP_DEVICE_TIMEOUT 20
 
+#ifdef MBED_CONF_SIM5320_DRIVER_FTP_LOCK_SLICE_TIME
+#define FTP_LOCK_SLICE_TIME MBED_CONF_SIM5320_DRIVER_FTP_LOCK_SLICE_TIME
+#else
+#define FTP_LOCK_SLICE_TIME 200
+#endif
+
 SIM5320FTPClient::SIM5320FTPClient(ATHandler &at)
     : AT_CellularBase(at)
     , _buffer(NULL)
     , _cleanup_buffer(false)
+    , _transfer_result(-1)
 {
 }
 
@@ -92,7 +99,7 @@ static int read_fuzzy_ftp_response(ATHandler &at, bool wait_response_after_ok, b
 nsapi_error_t SIM5320FTPClient::connect(const char *host, int port, SIM5320FTPClient::FTPProtocol protocol, const char *username, const char *password)
 {
     int err;
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
 
     // start ftp stack
     _at.cmd_start("AT+CFTPSSTART");
@@ -212,7 +219,7 @@ nsapi_error_t SIM5320FTPClient::connect(const char *address)
 nsapi_error_t SIM5320FTPClient::disconnect()
 {
     int err;
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
 
     // disconnect from server
     _at.cmd_start("AT+CFTPSLOGOUT");
@@ -230,7 +237,7 @@ nsapi_error_t SIM5320FTPClient::disconnect()
 
 nsapi_error_t SIM5320FTPClient::get_cwd(char *work_dir, size_t max_size)
 {
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
     _at.cmd_start("AT+CFTPSPWD");
     _at.cmd_stop();
     _at.resp_start("+CFTPSPWD:");
@@ -242,7 +249,7 @@ nsapi_error_t SIM5320FTPClient::get_cwd(char *work_dir, size_t max_size)
 nsapi_error_t SIM5320FTPClient::set_cwd(const char *work_dir)
 {
     int err;
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
 
     _at.cmd_start("AT+CFTPSCWD=");
     _at.write_string(work_dir);
@@ -258,7 +265,7 @@ nsapi_error_t SIM5320FTPClient::get_file_size(const char *path, long &size)
     int err, ftp_code;
     int cmd_fsize;
 
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
     _at.cmd_start("AT+CFTPSSIZE=");
     _at.write_string(path);
     _at.cmd_stop();
@@ -286,7 +293,7 @@ nsapi_error_t SIM5320FTPClient::isfile(const char *path, bool &result)
 
 nsapi_error_t SIM5320FTPClient::isdir(const char *path, bool &result)
 {
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
     int err;
     char *buf = _get_buffer();
 
@@ -331,7 +338,7 @@ nsapi_error_t SIM5320FTPClient::exists(const char *path, bool &result)
 nsapi_error_t SIM5320FTPClient::mkdir(const char *path)
 {
     int err;
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
 
     _at.cmd_start("AT+CFTPSMKD=");
     _at.write_string(path);
@@ -345,7 +352,7 @@ nsapi_error_t SIM5320FTPClient::mkdir(const char *path)
 nsapi_error_t SIM5320FTPClient::rmdir(const char *path)
 {
     int err;
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
 
     _at.cmd_start("AT+CFTPSRMD=");
     _at.write_string(path);
@@ -412,7 +419,7 @@ nsapi_error_t SIM5320FTPClient::rmtree(const char *path, bool remove_root)
 nsapi_error_t SIM5320FTPClient::rmfile(const char *path)
 {
     int err;
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
 
     _at.cmd_start("AT+CFTPSDELE=");
     _at.write_string(path);
@@ -519,7 +526,7 @@ nsapi_error_t SIM5320FTPClient::put(const char *path, Callback<ssize_t(uint8_t *
     }
 
     int err;
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
 
     char *buf = _get_buffer();
 
@@ -529,10 +536,8 @@ nsapi_error_t SIM5320FTPClient::put(const char *path, Callback<ssize_t(uint8_t *
     int pending_data_i = PUT_UNSEND_MAX + 1;
 
     while (true) {
-        // as the operation can be long we should reset ATHanlder timeout
-        // TODO: check if it's better to release lock and invoke ThisThread::yield to
-        // allow other thread to use this driver.
-        locker.reset_timeout();
+        // as the operation can be long, let other threads to use ATHandler between data chunks
+        locker.yield(FTP_LOCK_SLICE_TIME);
 
         // check if we have some amount of unsent data
         if (pending_data_i >= PUT_UNSEND_MAX) {
@@ -548,7 +553,7 @@ nsapi_error_t SIM5320FTPClient::put(const char *path, Callback<ssize_t(uint8_t *
                     break;
                 }
                 if (pending_data_i > PUT_UNSEND_MIN) {
-                    wait_ms(FTP_PUT_DATA_WAIT_TIMEOUT);
+                    locker.pause(FTP_PUT_DATA_WAIT_TIMEOUT);
                 } else {
                     break;
                 }
@@ -721,21 +726,24 @@ nsapi_error_t SIM5320FTPClient::upload(FILE *local_file, const char *remote_path
 nsapi_error_t SIM5320FTPClient::_get_data_impl(const char *path, Callback<ssize_t(uint8_t *, size_t)> data_reader, const char *command)
 {
     ssize_t callback_res = 0;
-    ATHandlerLocker locker(_at, FTP_RESPONSE_TIMEOUT);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, FTP_RESPONSE_TIMEOUT);
 
     uint8_t *cache_buf = (uint8_t *)_get_buffer();
 
     // prepare commands
     const char *cmd_request;
     const char *cmd_response;
+    const char *cmd_urc;
     bool add_rest_size;
     if (strcmp(command, "GET") == 0) {
         cmd_request = "AT+CFTPSGET=";
         cmd_response = "+CFTPSGET: ";
+        cmd_urc = "+CFTPSGET:";
         add_rest_size = true;
     } else if (strcmp(command, "LIST") == 0) {
         cmd_request = "AT+CFTPSLIST=";
         cmd_response = "+CFTPSLIST: ";
+        cmd_urc = "+CFTPSLIST:";
         add_rest_size = false;
     } else {
         return NSAPI_ERROR_PARAMETER;
@@ -804,29 +812,35 @@ nsapi_error_t SIM5320FTPClient::_get_data_impl(const char *path, Callback<ssize_
             }
         }
 
-        // as the operation can be long we should reset ATHanlder timeout
-        // TODO: check if it's better to release lock and invoke ThisThread::yield to
-        // allow other thread to use this driver.
-        locker.reset_timeout();
-
         if (cache_is_empty) {
-            if (cftpsget_code < 0) {
-                // wait data
-                wait_data_attempt_count++;
-                if (wait_data_attempt_count >= FTP_GET_DATA_MAX_WAIT_DATA_ATTEMPTS) {
-                    cftpsget_code = 2;
-                    break;
-                }
-                tr_debug("wait data ...");
-                wait_ms(FTP_GET_DATA_WAIT_TIMEOUT);
-            } else {
+            if (cftpsget_code >= 0) {
                 // end of transmission
                 tr_debug("Complete");
                 break;
             }
+            wait_data_attempt_count++;
+            if (wait_data_attempt_count >= FTP_GET_DATA_MAX_WAIT_DATA_ATTEMPTS) {
+                cftpsget_code = 2;
+                break;
+            }
         } else {
             wait_data_attempt_count = 0;
         }
+
+        // as the operation can be long, let other threads to use ATHandler between data chunks.
+        // The end of transmission code can be received by other thread at this time, so catch it with URC handler.
+        _transfer_result = -1;
+        _at.set_urc_handler(cmd_urc, callback(this, &SIM5320FTPClient::_urc_transfer_result));
+        if (cache_is_empty) {
+            tr_debug("wait data ...");
+            locker.pause(FTP_GET_DATA_WAIT_TIMEOUT);
+        } else {
+            locker.yield(FTP_LOCK_SLICE_TIME);
+        }
+        _at.set_urc_handler(cmd_urc, NULL);
+        if (_transfer_result >= 0) {
+            cftpsget_code = _transfer_result;
+        }
     }
 
     if (cftpsget_code > 0) {
@@ -839,3 +853,11 @@ nsapi_error_t SIM5320FTPClient::_get_data_impl(const char *path, Callback<ssize_
 
     return _at.get_last_error();
 }
+
+void SIM5320FTPClient::_urc_transfer_result()
+{
+    int code = _at.read_int();
+    if (!_at.get_last_error()) {
+        _transfer_result = code < 0 ? 2 : code;
+    }
+}
@@ -4,9 +4,11 @@ using namespace sim5320;
 
 #define GPS_START_STOP_CHECK_DELAY 2000
 #define GPS_START_STOP_CHECK_NUM 10
+#define GPS_SETTING_CMD_MAX_LEN 160
 
-SIM5320GPSDevice::SIM5320GPSDevice(ATHandler &at)
+SIM5320GPSDevice::SIM5320GPSDevice(ATHandler &at, SIM5320SettingsCache &settings_cache)
     : AT_CellularBase(at)
+    , _settings_cache(settings_cache)
 {
 }
 
@@ -16,26 +18,28 @@ SIM5320GPSDevice::~SIM5320GPSDevice()
 
 nsapi_error_t SIM5320GPSDevice::start(SIM5320GPSDevice::Mode gps_mode)
 {
-    ATHandlerLocker locker(_at, GPS_START_STOP_CHECK_NUM * GPS_START_STOP_CHECK_DELAY);
-
-    // default settings
-    // set AGPS url
-    _at.cmd_start("AT+CGPSURL=");
-    _at.write_string(get_assist_server_url());
-    _at.cmd_stop_read_resp();
-    // set AGPS ssl usage
-    _at.cmd_start("AT+CGPSSSL=");
-    _at.write_int(use_assist_server_ssl() ? 1 : 0);
-    _at.cmd_stop_read_resp();
-    // disable automatic (AT+CGPSAUTO) GPS start
-    _at.cmd_start("AT+CGPSAUTO=0");
-    _at.cmd_stop_read_resp();
-    // set position mode (AT+CGPSPMD) to 127
-    _at.cmd_start("AT+CGPSPMD=127");
-    _at.cmd_stop_read_resp();
-    // ensure switch to standalone mode automatically
-    _at.cmd_start("AT+CGPSMSB=1");
-    _at.cmd_stop_read_resp();
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE, GPS_START_STOP_CHECK_NUM * GPS_START_STOP_CHECK_DELAY);
+
+    // default settings (they are sent only if they differ from the previous ones)
+    char url_cmd[GPS_SETTING_CMD_MAX_LEN];
+    snprintf(url_cmd, sizeof(url_cmd), "AT+CGPSURL=\"%s\"", get_assist_server_url());
+    const char *settings_cmds[] = {
+        // set AGPS url
+        url_cmd,
+        // set AGPS ssl usage
+        use_assist_server_ssl() ? "AT+CGPSSSL=1" : "AT+CGPSSSL=0",
+        // disable automatic (AT+CGPSAUTO) GPS start
+        "AT+CGPSAUTO=0",
+        // set position mode (AT+CGPSPMD) to 127
+        "AT+CGPSPMD=127",
+        // ensure switch to standalone mode automatically
+        "AT+CGPSMSB=1"
+    };
+    // note: the commands are sent with one command line
+    nsapi_error_t settings_err = _settings_cache.write(_at, settings_cmds, sizeof(settings_cmds) / sizeof(settings_cmds[0]));
+    if (settings_err) {
+        return settings_err;
+    }
 
     int mode_code = gps_mode + 1;
     _at.cmd_start("AT+CGPS=");
@@ -67,7 +71,7 @@ nsapi_error_t SIM5320GPSDevice::start(SIM5320GPSDevice::Mode gps_mode)
 
 nsapi_error_t SIM5320GPSDevice::stop()
 {
-    ATHandlerLocker locker(_at, GPS_START_STOP_CHECK_NUM * GPS_START_STOP_CHECK_DELAY);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE, GPS_START_STOP_CHECK_NUM * GPS_START_STOP_CHECK_DELAY);
 
     _at.cmd_start("AT+CGPS=");
     _at.write_int(0);
@@ -97,7 +101,7 @@ nsapi_error_t SIM5320GPSDevice::stop()
 
 nsapi_error_t SIM5320GPSDevice::is_active(bool &active)
 {
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
 
     int on_flag;
     _at.cmd_start("AT+CGPS?");
@@ -119,7 +123,7 @@ const static SIM5320GPSDevice::Mode GPS_MODE_MAP[] = {
 
 nsapi_error_t SIM5320GPSDevice::get_mode(SIM5320GPSDevice::Mode &mode)
 {
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
 
     int mode_code;
     _at.cmd_start("AT+CGPS?");
@@ -138,7 +142,7 @@ nsapi_error_t SIM5320GPSDevice::get_mode(SIM5320GPSDevice::Mode &mode)
 
 nsapi_error_t SIM5320GPSDevice::set_desired_accuracy(int value)
 {
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
 
     _at.cmd_start("AT+CGPSHOR=");
     _at.write_int(value);
@@ -149,7 +153,7 @@ nsapi_error_t SIM5320GPSDevice::set_desired_accuracy(int value)
 
 nsapi_error_t SIM5320GPSDevice::get_desired_accuracy(int &value)
 {
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
 
     _at.cmd_start("AT+CGPSHOR?");
     _at.cmd_stop();
@@ -170,7 +174,7 @@ nsapi_error_t SIM5320GPSDevice::get_coord(bool &has_coordinates, SIM5320GPSDevic
     char utc_time_str[10];
     char alt_str[10];
 
-    ATHandlerLocker locker(_at);
+    ATHandlerLocker locker(_at, SIM5320ATScheduler::PRIORITY_INTERACTIVE);
 
     _at.cmd_start("AT+CGPSINFO");
     _at.cmd_stop();
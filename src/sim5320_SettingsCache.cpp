@@ -0,0 +1,138 @@
+#include "sim5320_SettingsCache.h"
+#include "sim5320_utils.h"
+#include "string.h"
+
+using namespace sim5320;
+
+SIM5320SettingsCache::SIM5320SettingsCache()
+    : _size(0)
+{
+    reset_stats();
+}
+
+SIM5320SettingsCache::~SIM5320SettingsCache()
+{
+}
+
+nsapi_error_t SIM5320SettingsCache::write(ATHandler &at, const char *cmd)
+{
+    return write(at, &cmd, 1);
+}
+
+nsapi_error_t SIM5320SettingsCache::write(ATHandler &at, const char *const *cmds, int count)
+{
+    if (count > ATCommandBatch::MAX_COMMANDS) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    if (at.get_last_error()) {
+        return at.get_last_error();
+    }
+
+    // find changed settings
+    int batch_cmds[ATCommandBatch::MAX_COMMANDS];
+    int batch_size = 0;
+    _mutex.lock();
+    for (int i = 0; i < count; i++) {
+        entry_t *entry = _find_entry(_get_key_hash(cmds[i]));
+        if (entry && entry->value_hash == _hash(cmds[i], strlen(cmds[i]))) {
+            _stats.skips++;
+        } else {
+            _stats.writes++;
+            batch_cmds[batch_size++] = i;
+        }
+    }
+    _mutex.unlock();
+    if (batch_size == 0) {
+        return NSAPI_ERROR_OK;
+    }
+
+    ATCommandBatch batch(at);
+    nsapi_error_t err = NSAPI_ERROR_OK;
+    for (int i = 0; i < batch_size && !err; i++) {
+        err = batch.add(cmds[batch_cmds[i]]);
+    }
+    err = any_error(err, batch.send());
+    int failed_index = batch.get_failed_index();
+
+    _mutex.lock();
+    for (int i = 0; i < batch_size; i++) {
+        const char *cmd = cmds[batch_cmds[i]];
+        if (!err || (failed_index >= 0 && i < failed_index)) {
+            _set_entry(_get_key_hash(cmd), _hash(cmd, strlen(cmd)));
+        } else if (failed_index < 0 || i == failed_index) {
+            // the setting state is unknown
+            _remove_entry(_get_key_hash(cmd));
+        }
+    }
+    _mutex.unlock();
+    return err;
+}
+
+void SIM5320SettingsCache::clear()
+{
+    _mutex.lock();
+    _size = 0;
+    _mutex.unlock();
+}
+
+void SIM5320SettingsCache::get_stats(SIM5320SettingsCache::stats_t &stats)
+{
+    _mutex.lock();
+    stats = _stats;
+    _mutex.unlock();
+}
+
+void SIM5320SettingsCache::reset_stats()
+{
+    _mutex.lock();
+    memset(&_stats, 0, sizeof(_stats));
+    _mutex.unlock();
+}
+
+SIM5320SettingsCache::entry_t *SIM5320SettingsCache::_find_entry(uint32_t key_hash)
+{
+    for (int i = 0; i < _size; i++) {
+        if (_entries[i].key_hash == key_hash) {
+            return &_entries[i];
+        }
+    }
+    return NULL;
+}
+
+void SIM5320SettingsCache::_set_entry(uint32_t key_hash, uint32_t value_hash)
+{
+    entry_t *entry = _find_entry(key_hash);
+    if (!entry && _size < MAX_SETTINGS) {
+        entry = &_entries[_size++];
+        entry->key_hash = key_hash;
+    }
+    if (entry) {
+        entry->value_hash = value_hash;
+    }
+}
+
+void SIM5320SettingsCache::_remove_entry(uint32_t key_hash)
+{
+    entry_t *entry = _find_entry(key_hash);
+    if (entry) {
+        *entry = _entries[--_size];
+    }
+}
+
+uint32_t SIM5320SettingsCache::_get_key_hash(const char *cmd)
+{
+    // setting name is a command part before '='
+    const char *eq_pos = strchr(cmd, '=');
+    return _hash(cmd, eq_pos ? eq_pos - cmd : strlen(cmd));
+}
+
+uint32_t SIM5320SettingsCache::_hash(const char *str, size_t len)
+{
+    // FNV-1a hash
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
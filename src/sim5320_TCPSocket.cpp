@@ -0,0 +1,24 @@
+#include "sim5320_TCPSocket.h"
+
+using namespace sim5320;
+
+SIM5320TCPSocket::SIM5320TCPSocket()
+{
+}
+
+SIM5320TCPSocket::~SIM5320TCPSocket()
+{
+}
+
+nsapi_size_or_error_t SIM5320TCPSocket::sendmsg(const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    nsapi_size_or_error_t result;
+    _lock.lock();
+    if (!_socket) {
+        result = NSAPI_ERROR_NO_SOCKET;
+    } else {
+        result = static_cast<SIM5320CellularStack *>(_stack)->socket_sendmsg(_socket, NULL, iov, iov_count);
+    }
+    _lock.unlock();
+    return result;
+}
@@ -0,0 +1,37 @@
+#include "sim5320_UDPSocket.h"
+
+using namespace sim5320;
+
+SIM5320UDPSocket::SIM5320UDPSocket()
+{
+}
+
+SIM5320UDPSocket::~SIM5320UDPSocket()
+{
+}
+
+nsapi_size_or_error_t SIM5320UDPSocket::sendto_batch(SIM5320CellularStack::udp_datagram_t *datagrams, int count)
+{
+    nsapi_size_or_error_t result;
+    _lock.lock();
+    if (!_socket) {
+        result = NSAPI_ERROR_NO_SOCKET;
+    } else {
+        result = static_cast<SIM5320CellularStack *>(_stack)->socket_sendto_batch(_socket, datagrams, count);
+    }
+    _lock.unlock();
+    return result;
+}
+
+nsapi_size_or_error_t SIM5320UDPSocket::sendmsg(const SocketAddress &address, const SIM5320CellularStack::iovec_t *iov, int iov_count)
+{
+    nsapi_size_or_error_t result;
+    _lock.lock();
+    if (!_socket) {
+        result = NSAPI_ERROR_NO_SOCKET;
+    } else {
+        result = static_cast<SIM5320CellularStack *>(_stack)->socket_sendmsg(_socket, &address, iov, iov_count);
+    }
+    _lock.unlock();
+    return result;
+}
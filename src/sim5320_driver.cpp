@@ -1,15 +1,46 @@
 ﻿#include "sim5320_driver.h"
+#include "sim5320_CellularContext.h"
 #include "sim5320_CellularNetwork.h"
 #include "sim5320_utils.h"
 using namespace sim5320;
 
+// default UART baudrate of the modem after startup
 static const int SIM5320_SERIAL_BAUDRATE = 115200;
 
+#ifdef MBED_CONF_SIM5320_DRIVER_UART_BAUDRATE
+#define SIM5320_UART_BAUDRATE MBED_CONF_SIM5320_DRIVER_UART_BAUDRATE
+#else
+#define SIM5320_UART_BAUDRATE 115200
+#endif
+
+#ifdef MBED_CONF_SIM5320_DRIVER_UART_HW_FLOW_CTRL_BAUDRATE
+#define SIM5320_UART_HW_FLOW_CTRL_BAUDRATE MBED_CONF_SIM5320_DRIVER_UART_HW_FLOW_CTRL_BAUDRATE
+#else
+#define SIM5320_UART_HW_FLOW_CTRL_BAUDRATE 460800
+#endif
+
+// baudrates that are checked, if modem doesn't respond with current one
+static const int SIM5320_PROBE_BAUDRATES[] = { 115200, 921600, 460800, 230400, 3200000, 3686400, 4000000, 57600, 9600 };
+// timeout of the UART check with AT command
+static const int SIM5320_UART_CHECK_TIMEOUT = 500;
+// number of the UART checks after baudrate changing
+static const int SIM5320_UART_CHECK_NUM = 3;
+// delay between AT+IPR response and new baudrate usage
+static const int SIM5320_UART_SWITCH_DELAY = 50;
+// multiplexer virtual channels
+static const int SIM5320_CMUX_CHANNEL_NUM = 3;
+static const int SIM5320_CMUX_CONTROL_CHANNEL = 1;
+static const int SIM5320_CMUX_CONTEXT_CHANNEL = 2;
+static const int SIM5320_CMUX_AUX_CHANNEL = 3;
+// AT+CMUX <port_speed> codes of the 3GPP TS 27.007
+static const int SIM5320_CMUX_PORT_SPEEDS[] = { 9600, 19200, 38400, 57600, 115200, 230400 };
+
 SIM5320::SIM5320(UARTSerial *serial_ptr, PinName rts, PinName cts, PinName rst)
     : _rts(rts)
     , _cts(cts)
     , _serial_ptr(serial_ptr)
     , _cleanup_uart(false)
+    , _fh(serial_ptr)
     , _rst(rst)
 {
     _init_driver();
@@ -20,6 +51,18 @@ SIM5320::SIM5320(PinName tx, PinName rx, PinName rts, PinName cts, PinName rst)
     , _cts(cts)
     , _serial_ptr(new UARTSerial(tx, rx))
     , _cleanup_uart(true)
+    , _fh(_serial_ptr)
+    , _rst(rst)
+{
+    _init_driver();
+}
+
+SIM5320::SIM5320(FileHandle *fh, PinName rst)
+    : _rts(NC)
+    , _cts(NC)
+    , _serial_ptr(NULL)
+    , _cleanup_uart(false)
+    , _fh(fh)
     , _rst(rst)
 {
     _init_driver();
@@ -28,8 +71,13 @@ SIM5320::SIM5320(PinName tx, PinName rx, PinName rts, PinName cts, PinName rst)
 void SIM5320::_init_driver()
 {
     // configure serial parameters
-    _serial_ptr->set_baud(SIM5320_SERIAL_BAUDRATE);
-    _serial_ptr->set_format(8, UARTSerial::None, 1);
+    _uart_baudrate = SIM5320_SERIAL_BAUDRATE;
+    _target_uart_baudrate = SIM5320_UART_BAUDRATE;
+    _uart_auto_flow_ctrl = false;
+    if (_serial_ptr) {
+        _serial_ptr->set_baud(SIM5320_SERIAL_BAUDRATE);
+        _serial_ptr->set_format(8, UARTSerial::None, 1);
+    }
 
     // configure hardware reset pin
     if (_rst != NC) {
@@ -39,16 +87,15 @@ void SIM5320::_init_driver()
     }
 
     // create driver interface
-    _device = new SIM5320CellularDevice(_serial_ptr);
-    _information = _device->open_information(_serial_ptr);
-    _network = _device->open_network(_serial_ptr);
-    _sms = _device->open_sms(_serial_ptr);
-    _context = _device->create_context(_serial_ptr);
-    _gps = _device->open_gps(_serial_ptr);
-    _ftp_client = _device->open_ftp_client(_serial_ptr);
+    _device = new SIM5320CellularDevice(_fh);
+    _information = _device->open_information(_fh);
+    _network = _device->open_network(_fh);
+    _sms = _device->open_sms(_fh);
+    _open_subsystems(_fh, _fh);
 
     _startup_request_count = 0;
-    _at = _device->get_at_handler(_serial_ptr);
+    _at = _device->get_at_handler(_fh);
+    _cmux = NULL;
 }
 
 SIM5320::~SIM5320()
@@ -56,11 +103,12 @@ SIM5320::~SIM5320()
     _device->close_information();
     _device->close_network();
     _device->close_sms();
-    _device->delete_context(_context);
-    _device->close_gps();
+    _close_subsystems();
     _device->release_at_handler(_at);
-    _device->close_ftp_client();
     delete _device;
+    if (_cmux) {
+        delete _cmux;
+    }
 
     if (_rst_out_ptr) {
         delete _rst_out_ptr;
@@ -73,7 +121,10 @@ SIM5320::~SIM5320()
 
 nsapi_error_t SIM5320::start_uart_hw_flow_ctrl()
 {
-    ATHandlerLocker locker(*_at);
+    if (!_serial_ptr) {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
     if (_rts != NC && _cts != NC) {
         _serial_ptr->set_flow_control(UARTSerial::RTSCTS, _rts, _cts);
         _at->cmd_start("AT+IFC=2,2");
@@ -95,7 +146,10 @@ nsapi_error_t SIM5320::start_uart_hw_flow_ctrl()
 
 nsapi_error_t SIM5320::stop_uart_hw_flow_ctrl()
 {
-    ATHandlerLocker locker(*_at);
+    if (!_serial_ptr) {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
     if (_rts != NC || _cts != NC) {
         _serial_ptr->set_flow_control(SerialBase::Disabled, _rts, _cts);
         _at->cmd_start("AT+IFC=0,0");
@@ -104,13 +158,102 @@ nsapi_error_t SIM5320::stop_uart_hw_flow_ctrl()
     return _at->get_last_error();
 }
 
+nsapi_error_t SIM5320::set_uart_baudrate(int baudrate)
+{
+    if (!_serial_ptr || _cmux) {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    if (baudrate <= 0) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    nsapi_error_t err = _change_uart_baudrate(baudrate);
+    if (!err) {
+        _target_uart_baudrate = baudrate;
+    }
+    return err;
+}
+
+int SIM5320::get_uart_baudrate() const
+{
+    return _uart_baudrate;
+}
+
+nsapi_error_t SIM5320::start_cmux()
+{
+    nsapi_error_t err;
+    if (_cmux) {
+        return NSAPI_ERROR_OK;
+    }
+    if (_startup_request_count > 0) {
+        return NSAPI_ERROR_BUSY;
+    }
+
+    _close_subsystems();
+    _cmux = new SIM5320CMUX(_fh, _device->get_queue());
+    err = _open_cmux();
+    if (err) {
+        _detach_cmux();
+        delete _cmux;
+        _cmux = NULL;
+        _open_subsystems(_fh, _fh);
+        return err;
+    }
+    _open_subsystems(_cmux->get_channel(SIM5320_CMUX_CONTEXT_CHANNEL), _cmux->get_channel(SIM5320_CMUX_AUX_CHANNEL));
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t SIM5320::stop_cmux()
+{
+    nsapi_error_t err;
+    if (!_cmux) {
+        return NSAPI_ERROR_OK;
+    }
+    if (_startup_request_count > 0) {
+        return NSAPI_ERROR_BUSY;
+    }
+
+    _close_subsystems();
+    {
+        ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
+        err = _cmux->close();
+        _at->set_file_handle(_fh);
+        delete _cmux;
+        _cmux = NULL;
+        // modem returns to AT command mode without any messages, so check it
+        _at->flush();
+        _at->clear_error();
+        _at->cmd_start("AT");
+        _at->cmd_stop_read_resp();
+        if (!err) {
+            err = _at->get_last_error();
+        }
+    }
+    _open_subsystems(_fh, _fh);
+    return err;
+}
+
+bool SIM5320::is_cmux_enabled() const
+{
+    return _cmux != NULL;
+}
+
 nsapi_error_t SIM5320::init()
 {
     nsapi_error_t err;
+    // find current modem baudrate, as it can be changed before MCU restart
+    if (_serial_ptr && (err = _probe_uart_baudrate())) {
+        return err;
+    }
     // check that UART works and perform basic UART configuration
     if ((err = _device->init_at_interface())) {
         return err;
     }
+    // switch to configured baudrate
+    if (_serial_ptr && _uart_baudrate != _target_uart_baudrate) {
+        if ((err = _change_uart_baudrate(_target_uart_baudrate))) {
+            return err;
+        }
+    }
 
     // force power mode to 0
     if ((err = _device->set_power_level(0))) {
@@ -128,7 +271,8 @@ nsapi_error_t SIM5320::init()
 
 nsapi_error_t SIM5320::set_factory_settings()
 {
-    ATHandlerLocker locker(*_at);
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
+    _device->get_settings_cache()->clear();
     _at->cmd_start("AT&F");
     _at->cmd_stop_read_resp();
     _at->cmd_start("AT&F1");
@@ -174,6 +318,8 @@ nsapi_error_t SIM5320::reset(SIM5320::ResetMode reset_mode)
         func_level = 0;
     }
 
+    // modem settings are restored to the saved ones after reset
+    _device->get_settings_cache()->clear();
     switch (reset_mode) {
     case sim5320::SIM5320::RESET_MODE_DEFAULT:
         err = _reset_soft();
@@ -197,11 +343,36 @@ nsapi_error_t SIM5320::reset(SIM5320::ResetMode reset_mode)
         return err;
     }
 
+    // restore UART baudrate
+    if (_serial_ptr && _uart_baudrate != _target_uart_baudrate) {
+        err = _change_uart_baudrate(_target_uart_baudrate);
+        if (err) {
+            return err;
+        }
+    }
+
+    // restore multiplexer
+    if (_cmux) {
+        err = _open_cmux();
+        if (err) {
+            return err;
+        }
+    }
+
     err = _device->set_power_level(func_level);
     if (err) {
         return err;
     }
 
+    // restore registration URCs
+    SIM5320CellularNetwork *network = static_cast<SIM5320CellularNetwork *>(_network);
+    if (network->is_registration_cache_enabled()) {
+        err = network->set_registration_cache(true);
+        if (err) {
+            return err;
+        }
+    }
+
     return NSAPI_ERROR_OK;
 }
 
@@ -252,10 +423,30 @@ SIM5320FTPClient *SIM5320::get_ftp_client()
     return _ftp_client;
 }
 
+nsapi_error_t SIM5320::get_socket_stats(int link_id, SIM5320CellularStack::socket_stats_t &stats)
+{
+    return static_cast<SIM5320CellularContext *>(_context)->get_sim5320_stack()->get_socket_stats(link_id, stats);
+}
+
+void SIM5320::reset_socket_stats()
+{
+    static_cast<SIM5320CellularContext *>(_context)->get_sim5320_stack()->reset_socket_stats();
+}
+
+void SIM5320::get_at_scheduler_stats(SIM5320ATScheduler::PriorityClass priority, SIM5320ATScheduler::stats_t &stats)
+{
+    SIM5320ATScheduler::get_instance()->get_stats(priority, stats);
+}
+
+void SIM5320::reset_at_scheduler_stats()
+{
+    SIM5320ATScheduler::get_instance()->reset_stats();
+}
+
 nsapi_error_t SIM5320::_reset_soft()
 {
     {
-        ATHandlerLocker locker(*_at);
+        ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
         // send reset command
         _at->cmd_start("AT+CRESET");
         _at->cmd_stop_read_resp();
@@ -264,6 +455,9 @@ nsapi_error_t SIM5320::_reset_soft()
         if (_at->get_last_error()) {
             return _at->get_last_error();
         }
+        // modem starts with default UART settings
+        _reset_uart_settings();
+        _detach_cmux();
     }
 
     // wait device startup messages
@@ -277,6 +471,9 @@ nsapi_error_t SIM5320::_reset_hard()
         _rst_out_ptr->write(0);
         wait_ms(100);
         _rst_out_ptr->write(1);
+        // modem starts with default UART settings
+        _reset_uart_settings();
+        _detach_cmux();
         // wait startup
         wait_ms(200);
         _at->flush();
@@ -291,7 +488,7 @@ nsapi_error_t SIM5320::_skip_initialization_messages()
 {
     int res;
 
-    ATHandlerLocker locker(*_at, _STARTUP_TIMEOUT_MS);
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, _STARTUP_TIMEOUT_MS);
     _at->resp_start("START", true);
     res = _at->get_last_error();
     // if there is not error, wait PB DONE
@@ -301,3 +498,190 @@ nsapi_error_t SIM5320::_skip_initialization_messages()
 
     return res;
 }
+
+void SIM5320::_set_host_uart_baudrate(int baudrate)
+{
+    _serial_ptr->set_baud(baudrate);
+    _uart_baudrate = baudrate;
+}
+
+nsapi_error_t SIM5320::_check_uart()
+{
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND, SIM5320_UART_CHECK_TIMEOUT);
+    _at->flush();
+    _at->clear_error();
+    _at->cmd_start("AT");
+    _at->cmd_stop_read_resp();
+    return _at->get_last_error();
+}
+
+nsapi_error_t SIM5320::_probe_uart_baudrate()
+{
+    if (!_check_uart()) {
+        return NSAPI_ERROR_OK;
+    }
+    int current_baudrate = _uart_baudrate;
+    for (size_t i = 0; i < sizeof(SIM5320_PROBE_BAUDRATES) / sizeof(SIM5320_PROBE_BAUDRATES[0]); i++) {
+        if (SIM5320_PROBE_BAUDRATES[i] == current_baudrate) {
+            continue;
+        }
+        _set_host_uart_baudrate(SIM5320_PROBE_BAUDRATES[i]);
+        if (!_check_uart()) {
+            tr_debug("Modem UART baudrate is %d", _uart_baudrate);
+            return NSAPI_ERROR_OK;
+        }
+    }
+    _set_host_uart_baudrate(current_baudrate);
+    return NSAPI_ERROR_DEVICE_ERROR;
+}
+
+nsapi_error_t SIM5320::_change_uart_baudrate(int baudrate)
+{
+    nsapi_error_t err;
+    int prev_baudrate = _uart_baudrate;
+    bool flow_ctrl = baudrate >= SIM5320_UART_HW_FLOW_CTRL_BAUDRATE && _rts != NC && _cts != NC;
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
+
+    // enable flow control before switching to high baudrate
+    if (flow_ctrl && !_uart_auto_flow_ctrl) {
+        if ((err = start_uart_hw_flow_ctrl())) {
+            return err;
+        }
+        _uart_auto_flow_ctrl = true;
+    }
+
+    if (baudrate != prev_baudrate) {
+        _at->cmd_start("AT+IPR=");
+        _at->write_int(baudrate);
+        _at->cmd_stop_read_resp();
+        if ((err = _at->get_last_error())) {
+            // modem doesn't support this baudrate
+            return err;
+        }
+        wait_ms(SIM5320_UART_SWITCH_DELAY);
+        _set_host_uart_baudrate(baudrate);
+
+        // check new baudrate
+        for (int i = 0; i < SIM5320_UART_CHECK_NUM; i++) {
+            if (!(err = _check_uart())) {
+                break;
+            }
+        }
+        if (err) {
+            // fallback to previous baudrate
+            tr_debug("Modem doesn't respond with UART baudrate %d", baudrate);
+            _set_host_uart_baudrate(prev_baudrate);
+            if (_probe_uart_baudrate() == NSAPI_ERROR_OK && _uart_baudrate != prev_baudrate) {
+                _at->cmd_start("AT+IPR=");
+                _at->write_int(prev_baudrate);
+                _at->cmd_stop_read_resp();
+                wait_ms(SIM5320_UART_SWITCH_DELAY);
+                _set_host_uart_baudrate(prev_baudrate);
+                _check_uart();
+            }
+            _at->clear_error();
+            if (_uart_auto_flow_ctrl && prev_baudrate < SIM5320_UART_HW_FLOW_CTRL_BAUDRATE) {
+                stop_uart_hw_flow_ctrl();
+                _uart_auto_flow_ctrl = false;
+            }
+            return NSAPI_ERROR_DEVICE_ERROR;
+        }
+    }
+
+    // disable automatic flow control after switching to low baudrate
+    if (!flow_ctrl && _uart_auto_flow_ctrl) {
+        if ((err = stop_uart_hw_flow_ctrl())) {
+            return err;
+        }
+        _uart_auto_flow_ctrl = false;
+    }
+    return NSAPI_ERROR_OK;
+}
+
+void SIM5320::_reset_uart_settings()
+{
+    if (!_serial_ptr) {
+        return;
+    }
+    if (_uart_auto_flow_ctrl) {
+        _serial_ptr->set_flow_control(SerialBase::Disabled, _rts, _cts);
+        _uart_auto_flow_ctrl = false;
+    }
+    _set_host_uart_baudrate(SIM5320_SERIAL_BAUDRATE);
+}
+
+void SIM5320::_open_subsystems(FileHandle *context_fh, FileHandle *aux_fh)
+{
+    _context = _device->create_context(context_fh);
+    _gps = _device->open_gps(aux_fh);
+    _ftp_client = _device->open_ftp_client(aux_fh);
+}
+
+void SIM5320::_close_subsystems()
+{
+    _device->delete_context(_context);
+    _context = NULL;
+    _device->close_gps();
+    _gps = NULL;
+    _device->close_ftp_client();
+    _ftp_client = NULL;
+}
+
+nsapi_error_t SIM5320::_open_cmux()
+{
+    nsapi_error_t err;
+    char cmd[32];
+    int port_speed = 0;
+    for (size_t i = 0; i < sizeof(SIM5320_CMUX_PORT_SPEEDS) / sizeof(SIM5320_CMUX_PORT_SPEEDS[0]); i++) {
+        if (SIM5320_CMUX_PORT_SPEEDS[i] == _uart_baudrate) {
+            port_speed = i + 1;
+            break;
+        }
+    }
+    // negotiate maximal frame size, as default N1 (31 bytes) adds 20% of framing overhead
+    // note: port speed without code is left unchanged
+    if (port_speed) {
+        snprintf(cmd, sizeof(cmd), "AT+CMUX=0,0,%d,%d", port_speed, (int)SIM5320CMUX::FRAME_DATA_SIZE);
+    } else {
+        snprintf(cmd, sizeof(cmd), "AT+CMUX=0,0,,%d", (int)SIM5320CMUX::FRAME_DATA_SIZE);
+    }
+    ATHandlerLocker locker(*_at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
+    _at->cmd_start(cmd);
+    _at->cmd_stop_read_resp();
+    if ((err = _at->get_last_error())) {
+        return err;
+    }
+
+    if ((err = _cmux->open(SIM5320_CMUX_CHANNEL_NUM))) {
+        _at->flush();
+        _at->clear_error();
+        return err;
+    }
+    _at->set_file_handle(_cmux->get_channel(SIM5320_CMUX_CONTROL_CHANNEL));
+
+    // each channel has own command interpreter, so disable echo everywhere
+    for (int dlci = 1; dlci <= SIM5320_CMUX_CHANNEL_NUM; dlci++) {
+        ATHandler *at = _device->get_at_handler(_cmux->get_channel(dlci));
+        {
+            ATHandlerLocker channel_locker(*at, SIM5320ATScheduler::PRIORITY_BACKGROUND);
+            at->cmd_start("ATE0");
+            at->cmd_stop_read_resp();
+            err = at->get_last_error();
+        }
+        _device->release_at_handler(at);
+        if (err) {
+            return err;
+        }
+    }
+    return NSAPI_ERROR_OK;
+}
+
+void SIM5320::_detach_cmux()
+{
+    if (!_cmux) {
+        return;
+    }
+    // modem leaves multiplexer mode after reset
+    _cmux->detach();
+    _at->set_file_handle(_fh);
+}
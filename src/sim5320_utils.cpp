@@ -91,30 +91,248 @@ int sim5320::vread_full_fuzzy_response(ATHandler &at, bool wait_response_after_o
     return err ? err : result;
 }
 
+sim5320::ByteRingBuffer::ByteRingBuffer(size_t capacity)
+    : _buf(new uint8_t[capacity])
+    , _capacity(capacity)
+    , _start(0)
+    , _size(0)
+{
+}
+
+sim5320::ByteRingBuffer::~ByteRingBuffer()
+{
+    delete[] _buf;
+}
+
+size_t sim5320::ByteRingBuffer::push(const uint8_t *data, size_t len)
+{
+    if (len > _capacity - _size) {
+        len = _capacity - _size;
+    }
+    size_t end = (_start + _size) % _capacity;
+    size_t first_part = _capacity - end;
+    if (first_part > len) {
+        first_part = len;
+    }
+    memcpy(_buf + end, data, first_part);
+    memcpy(_buf, data + first_part, len - first_part);
+    _size += len;
+    return len;
+}
+
+size_t sim5320::ByteRingBuffer::pop(uint8_t *data, size_t len)
+{
+    if (len > _size) {
+        len = _size;
+    }
+    size_t first_part = _capacity - _start;
+    if (first_part > len) {
+        first_part = len;
+    }
+    if (data) {
+        memcpy(data, _buf + _start, first_part);
+        memcpy(data + first_part, _buf, len - first_part);
+    }
+    _start = (_start + len) % _capacity;
+    _size -= len;
+    return len;
+}
+
+size_t sim5320::ByteRingBuffer::size() const
+{
+    return _size;
+}
+
+size_t sim5320::ByteRingBuffer::free_space() const
+{
+    return _capacity - _size;
+}
+
+void sim5320::ByteRingBuffer::clear()
+{
+    _start = 0;
+    _size = 0;
+}
+
 sim5320::ATHandlerLocker::ATHandlerLocker(ATHandler &at, int timeout)
     : _at(at)
     , _timeout(timeout)
-    , _lock_count(1)
+    , _scheduled(false)
+    , _priority(SIM5320ATScheduler::PRIORITY_DATA)
+    , _deadline(-1)
+    , _granted(false)
+{
+    _acquire();
+}
+
+sim5320::ATHandlerLocker::ATHandlerLocker(ATHandler &at, SIM5320ATScheduler::PriorityClass priority, int timeout, int deadline)
+    : _at(at)
+    , _timeout(timeout)
+    , _scheduled(true)
+    , _priority(priority)
+    , _deadline(deadline)
+    , _granted(false)
+{
+    _acquire();
+}
+
+sim5320::ATHandlerLocker::~ATHandlerLocker()
+{
+    _release();
+}
+
+void sim5320::ATHandlerLocker::reset_timeout()
+{
+    // note: ATHandler::lock resets timeout, and the nested lock is released at once
+    _at.lock();
+    _at.unlock();
+}
+
+bool sim5320::ATHandlerLocker::yield(int slice_time)
+{
+    if (rtos::Kernel::get_ms_count() - _lock_time < (uint64_t)slice_time) {
+        reset_timeout();
+        return false;
+    }
+    // note: waiting scheduled operations are queued by SIM5320ATScheduler, so the released turn is granted to the best
+    // of them, and the current thread waits its turn again in the _acquire; without waiters the handler is locked
+    // again immediately
+    _release();
+    rtos::ThisThread::yield();
+    _acquire();
+    return true;
+}
+
+void sim5320::ATHandlerLocker::pause(int time_ms)
 {
+    _release();
+    rtos::ThisThread::sleep_for(time_ms);
+    _acquire();
+}
+
+void sim5320::ATHandlerLocker::_acquire()
+{
+    if (_scheduled) {
+        _granted = SIM5320ATScheduler::get_instance()->acquire(_at, _priority, _deadline);
+    }
     _at.lock();
-    if (timeout >= 0) {
-        _at.set_at_timeout(timeout);
+    if (!_granted) {
+        SIM5320ATScheduler::get_instance()->direct_lock(_at);
+    }
+    if (_timeout >= 0) {
+        _at.set_at_timeout(_timeout);
     }
+    _lock_time = rtos::Kernel::get_ms_count();
 }
 
-sim5320::ATHandlerLocker::~ATHandlerLocker()
+void sim5320::ATHandlerLocker::_release()
 {
     if (_timeout >= 0) {
         _at.restore_at_timeout();
-        //_at.set_at_timeout(SIM5320_DEFAULT_TIMEOUT, true);
     }
-    for (int i = 0; i < _lock_count; i++) {
-        _at.unlock();
+    if (!_granted) {
+        SIM5320ATScheduler::get_instance()->direct_unlock(_at);
+    }
+    _at.unlock();
+    if (_granted) {
+        SIM5320ATScheduler::get_instance()->release(_at);
+        _granted = false;
     }
 }
 
-void sim5320::ATHandlerLocker::reset_timeout()
+sim5320::ATCommandBatch::ATCommandBatch(ATHandler &at)
+    : _at(at)
+    , _line_len(0)
+    , _cmd_num(0)
+    , _sent_cmd_num(0)
+    , _failed_index(-1)
 {
-    _at.lock();
-    _lock_count++;
+    _line[0] = '\0';
+}
+
+nsapi_error_t sim5320::ATCommandBatch::add(const char *cmd)
+{
+    nsapi_error_t err;
+    if (strncmp(cmd, "AT", 2) != 0) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    // skip "AT" prefix
+    cmd += 2;
+    size_t cmd_len = strlen(cmd);
+    if (cmd_len + 2 > MAX_LINE_LEN) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    if (_cmd_num >= MAX_COMMANDS || _line_len + cmd_len + 1 > MAX_LINE_LEN) {
+        if ((err = send())) {
+            return err;
+        }
+    }
+
+    if (_cmd_num == 0) {
+        memcpy(_line, "AT", 2);
+        _line_len = 2;
+    } else {
+        _line[_line_len++] = ';';
+    }
+    _cmd_offsets[_cmd_num++] = _line_len;
+    memcpy(_line + _line_len, cmd, cmd_len);
+    _line_len += cmd_len;
+    _line[_line_len] = '\0';
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t sim5320::ATCommandBatch::send()
+{
+    if (_cmd_num == 0) {
+        return _at.get_last_error();
+    }
+    int cmd_num = _cmd_num;
+    _cmd_num = 0;
+    _sent_cmd_num += cmd_num;
+    _failed_index = -1;
+    if (_at.get_last_error()) {
+        return _at.get_last_error();
+    }
+
+    _at.cmd_start(_line);
+    _at.cmd_stop_read_resp();
+    nsapi_error_t err = _at.get_last_error();
+    if (!err) {
+        return NSAPI_ERROR_OK;
+    }
+    if (_at.get_last_device_error().errType == DeviceErrorTypeNoError) {
+        // it isn't a command error (timeout, etc.), so failed command is unknown
+        return err;
+    }
+    if (cmd_num == 1) {
+        _failed_index = _sent_cmd_num - 1;
+        return err;
+    }
+
+    // modem returns one final result for the whole line without position of the failed command,
+    // so repeat commands one by one till the failed one
+    _at.clear_error();
+    char cmd_line[MAX_LINE_LEN + 1];
+    memcpy(cmd_line, "AT", 2);
+    for (int i = 0; i < cmd_num; i++) {
+        size_t cmd_end = i + 1 < cmd_num ? _cmd_offsets[i + 1] - 1 : _line_len;
+        size_t cmd_len = cmd_end - _cmd_offsets[i];
+        memcpy(cmd_line + 2, _line + _cmd_offsets[i], cmd_len);
+        cmd_line[cmd_len + 2] = '\0';
+        _at.cmd_start(cmd_line);
+        _at.cmd_stop_read_resp();
+        if ((err = _at.get_last_error())) {
+            if (_at.get_last_device_error().errType != DeviceErrorTypeNoError) {
+                _failed_index = _sent_cmd_num - cmd_num + i;
+            }
+            return err;
+        }
+    }
+    // all commands have been executed by the repeated lines
+    return NSAPI_ERROR_OK;
+}
+
+int sim5320::ATCommandBatch::get_failed_index() const
+{
+    return _failed_index;
 }